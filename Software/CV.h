@@ -1,7 +1,6 @@
 #pragma once
-#include "pico/stdlib.h"
+#include "shared.h"
 
-#define CV_ARRAY_SIZE 1024
 // All CVs are 8-bit numbers or bytes ranging from (0 - 255)dec = (0b00000000 - 0b11111111)bin = (0x00 - 0xFF)hex
 // IMPORTANT NOTE : CV_1 @ array_index = 0; CV_2 @ array_index = 1; CV_3 @ array_index = 2; ...; 
 // This effectively means: array_index = cv_index - 1
@@ -65,7 +64,7 @@ uint8_t CV_ARRAY_DEFAULT [CV_ARRAY_SIZE] = {
    // Speed controller - Configuration /////////////////////////////////////////////////////////////////////////////////
    0b11100110,         //CV_47  -   Feed-forward factor k_ff in % = CV_47/255  Default = 230 -> 0.902 = 90.2%         //
    0b00001010,         //CV_48  -   PID Control low pass filter time constant (tau) in ms                             //
-   0b00000101,         //CV_49  -   PID Control sampling time t in ms                                                 //
+   0b00000101,         //CV_49  -   PID Control sampling time t in ms (see CV_179)                                    //
    0b00011001,         //CV_50  -   PID Control I_Factor        =   CV_50/10        Default = 25 -> 2.5               //
    0b00110010,         //CV_51  -   PID Control D_Factor        =   CV_51/10000     Default = 50 -> 0.005             //
    0b01100100,         //CV_52  -   PID Integral Limit positive =   CV_52*10        Default = 100 -> +1000            //
@@ -212,11 +211,11 @@ uint8_t CV_ARRAY_DEFAULT [CV_ARRAY_SIZE] = {
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
    0b00000001,         //CV_174  -  Additional motor-PWM clock divider.
    0b00000111,         //CV_175  -  speed_helper timer delay -  can be used to adjust accel/decel rate
-   0b00000000,         //CV_176  -  
-   0b00000000,         //CV_177  -  
-   0b00000000,         //CV_178  -  
-   0b00000000,         //CV_179  -  
-   0b00000000,         //CV_180  -
+   0b00000000,         //CV_176  -  DCC decoder mode - bit0: strict half-bit validation & glitch filter; bit1: adaptive bit threshold
+   0b00000000,         //CV_177  -  CV programming transaction mode - bit0: stage CV writes in RAM and commit when the programming session ends
+   0b01000000,         //CV_178  -  Brightness of dimmed effect outputs (rule 17 dimming) = (CV_178+1)/256   Default: 64 -> 25%
+   0b00000000,         //CV_179  -  Control period in motor PWM periods (PWM wrap divisor), 0 = CV_49 rounded to PWM periods  Default: 0
+   0b00000000,         //CV_180  -  Motor controller autotune: 1 = armed, 0 = done, 2/3 = failed (autotune_status_t)  Default: 0
    0b00000000,         //CV_181  -
    0b00000000,         //CV_182  -
    0b00000000,         //CV_183  -
@@ -618,134 +617,167 @@ uint8_t CV_ARRAY_DEFAULT [CV_ARRAY_SIZE] = {
    0b00000000,         //CV_511  -  byte 1
    0b00000000,         //CV_512  -  byte 0
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-   0b00000000,         //CV_513  -    
-   0b00000000,         //CV_514  -    
-   0b00000000,         //CV_515  -    
-   0b00000000,         //CV_516  -    
-   0b00000000,         //CV_517  -    
-   0b00000000,         //CV_518  -    
-   0b00000000,         //CV_519  -    
-   0b00000000,         //CV_520  -    
-   0b00000000,         //CV_521  -    
-   0b00000000,         //CV_522  -    
-   0b00000000,         //CV_523  -    
-   0b00000000,         //CV_524  -    
-   0b00000000,         //CV_525  -    
-   0b00000000,         //CV_526  -    
-   0b00000000,         //CV_527  -    
-   0b00000000,         //CV_528  -    
-   0b00000000,         //CV_529  -    
-   0b00000000,         //CV_530  -    
-   0b00000000,         //CV_531  -    
-   0b00000000,         //CV_532  -    
-   0b00000000,         //CV_533  -    
-   0b00000000,         //CV_534  -    
-   0b00000000,         //CV_535  -    
-   0b00000000,         //CV_536  -    
-   0b00000000,         //CV_537  -    
-   0b00000000,         //CV_538  -    
-   0b00000000,         //CV_539  -    
-   0b00000000,         //CV_540  -    
-   0b00000000,         //CV_541  -    
-   0b00000000,         //CV_542  -    
-   0b00000000,         //CV_543  -    
-   0b00000000,         //CV_544  -    
-   0b00000000,         //CV_545  -    
-   0b00000000,         //CV_546  -    
-   0b00000000,         //CV_547  -    
-   0b00000000,         //CV_548  -    
-   0b00000000,         //CV_549  -    
-   0b00000000,         //CV_550  -    
-   0b00000000,         //CV_551  -    
-   0b00000000,         //CV_552  -    
-   0b00000000,         //CV_553  -    
-   0b00000000,         //CV_554  -    
-   0b00000000,         //CV_555  -    
-   0b00000000,         //CV_556  -    
-   0b00000000,         //CV_557  -    
-   0b00000000,         //CV_558  -    
-   0b00000000,         //CV_559  -    
-   0b00000000,         //CV_560  -    
-   0b00000000,         //CV_561  -    
-   0b00000000,         //CV_562  -    
-   0b00000000,         //CV_563  -    
-   0b00000000,         //CV_564  -    
-   0b00000000,         //CV_565  -    
-   0b00000000,         //CV_566  -    
-   0b00000000,         //CV_567  -    
-   0b00000000,         //CV_568  -    
-   0b00000000,         //CV_569  -    
-   0b00000000,         //CV_570  -    
-   0b00000000,         //CV_571  -    
-   0b00000000,         //CV_572  -    
-   0b00000000,         //CV_573  -    
-   0b00000000,         //CV_574  -    
-   0b00000000,         //CV_575  -    
-   0b00000000,         //CV_576  -    
-   0b00000000,         //CV_577  -    
-   0b00000000,         //CV_578  -    
-   0b00000000,         //CV_579  -    
-   0b00000000,         //CV_580  -    
-   0b00000000,         //CV_581  -    
-   0b00000000,         //CV_582  -    
-   0b00000000,         //CV_583  -    
-   0b00000000,         //CV_584  -    
-   0b00000000,         //CV_585  -    
-   0b00000000,         //CV_586  -    
-   0b00000000,         //CV_587  -    
-   0b00000000,         //CV_588  -    
-   0b00000000,         //CV_589  -    
-   0b00000000,         //CV_590  -    
-   0b00000000,         //CV_591  -    
-   0b00000000,         //CV_592  -    
-   0b00000000,         //CV_593  -    
-   0b00000000,         //CV_594  -    
-   0b00000000,         //CV_595  -    
-   0b00000000,         //CV_596  -    
-   0b00000000,         //CV_597  -    
-   0b00000000,         //CV_598  -    
-   0b00000000,         //CV_599  -    
-   0b00000000,         //CV_600  -    
-   0b00000000,         //CV_601  -    
-   0b00000000,         //CV_602  -    
-   0b00000000,         //CV_603  -    
-   0b00000000,         //CV_604  -    
-   0b00000000,         //CV_605  -    
-   0b00000000,         //CV_606  -    
-   0b00000000,         //CV_607  -    
-   0b00000000,         //CV_608  -    
-   0b00000000,         //CV_609  -    
-   0b00000000,         //CV_610  -    
-   0b00000000,         //CV_611  -    
-   0b00000000,         //CV_612  -    
-   0b00000000,         //CV_613  -    
-   0b00000000,         //CV_614  -    
-   0b00000000,         //CV_615  -    
-   0b00000000,         //CV_616  -    
-   0b00000000,         //CV_617  -    
-   0b00000000,         //CV_618  -    
-   0b00000000,         //CV_619  -    
-   0b00000000,         //CV_620  -    
-   0b00000000,         //CV_621  -    
-   0b00000000,         //CV_622  -    
-   0b00000000,         //CV_623  -    
-   0b00000000,         //CV_624  -    
-   0b00000000,         //CV_625  -    
-   0b00000000,         //CV_626  -    
-   0b00000000,         //CV_627  -    
-   0b00000000,         //CV_628  -    
-   0b00000000,         //CV_629  -    
-   0b00000000,         //CV_630  -    
-   0b00000000,         //CV_631  -    
-   0b00000000,         //CV_632  -    
-   0b00000000,         //CV_633  -    
-   0b00000000,         //CV_634  -    
-   0b00000000,         //CV_635  -    
-   0b00000000,         //CV_636  -    
-   0b00000000,         //CV_637  -    
-   0b00000000,         //CV_638  -    
-   0b00000000,         //CV_639  -    
-   0b00000000,         //CV_640  -    
+//GPIO 0 lighting effect
+   0b00000000,         //CV_513  -  effect type
+   0b00000000,         //CV_514  -  brightness
+   0b00000000,         //CV_515  -  effect period
+   0b00000000,         //CV_516  -  flags
+//GPIO 1 lighting effect
+   0b00000000,         //CV_517  -  effect type
+   0b00000000,         //CV_518  -  brightness
+   0b00000000,         //CV_519  -  effect period
+   0b00000000,         //CV_520  -  flags
+//GPIO 2 lighting effect
+   0b00000000,         //CV_521  -  effect type
+   0b00000000,         //CV_522  -  brightness
+   0b00000000,         //CV_523  -  effect period
+   0b00000000,         //CV_524  -  flags
+//GPIO 3 lighting effect
+   0b00000000,         //CV_525  -  effect type
+   0b00000000,         //CV_526  -  brightness
+   0b00000000,         //CV_527  -  effect period
+   0b00000000,         //CV_528  -  flags
+//GPIO 4 lighting effect
+   0b00000000,         //CV_529  -  effect type
+   0b00000000,         //CV_530  -  brightness
+   0b00000000,         //CV_531  -  effect period
+   0b00000000,         //CV_532  -  flags
+//GPIO 5 lighting effect
+   0b00000000,         //CV_533  -  effect type
+   0b00000000,         //CV_534  -  brightness
+   0b00000000,         //CV_535  -  effect period
+   0b00000000,         //CV_536  -  flags
+//GPIO 6 lighting effect
+   0b00000000,         //CV_537  -  effect type
+   0b00000000,         //CV_538  -  brightness
+   0b00000000,         //CV_539  -  effect period
+   0b00000000,         //CV_540  -  flags
+//GPIO 7 lighting effect
+   0b00000000,         //CV_541  -  effect type
+   0b00000000,         //CV_542  -  brightness
+   0b00000000,         //CV_543  -  effect period
+   0b00000000,         //CV_544  -  flags
+//GPIO 8 lighting effect
+   0b00000000,         //CV_545  -  effect type
+   0b00000000,         //CV_546  -  brightness
+   0b00000000,         //CV_547  -  effect period
+   0b00000000,         //CV_548  -  flags
+//GPIO 9 lighting effect
+   0b00000000,         //CV_549  -  effect type
+   0b00000000,         //CV_550  -  brightness
+   0b00000000,         //CV_551  -  effect period
+   0b00000000,         //CV_552  -  flags
+//GPIO 10 lighting effect
+   0b00000000,         //CV_553  -  effect type
+   0b00000000,         //CV_554  -  brightness
+   0b00000000,         //CV_555  -  effect period
+   0b00000000,         //CV_556  -  flags
+//GPIO 11 lighting effect
+   0b00000000,         //CV_557  -  effect type
+   0b00000000,         //CV_558  -  brightness
+   0b00000000,         //CV_559  -  effect period
+   0b00000000,         //CV_560  -  flags
+//GPIO 12 lighting effect
+   0b00000000,         //CV_561  -  effect type
+   0b00000000,         //CV_562  -  brightness
+   0b00000000,         //CV_563  -  effect period
+   0b00000000,         //CV_564  -  flags
+//GPIO 13 lighting effect
+   0b00000000,         //CV_565  -  effect type
+   0b00000000,         //CV_566  -  brightness
+   0b00000000,         //CV_567  -  effect period
+   0b00000000,         //CV_568  -  flags
+//GPIO 14 lighting effect
+   0b00000000,         //CV_569  -  effect type
+   0b00000000,         //CV_570  -  brightness
+   0b00000000,         //CV_571  -  effect period
+   0b00000000,         //CV_572  -  flags
+//GPIO 15 lighting effect
+   0b00000000,         //CV_573  -  effect type
+   0b00000000,         //CV_574  -  brightness
+   0b00000000,         //CV_575  -  effect period
+   0b00000000,         //CV_576  -  flags
+//GPIO 16 lighting effect
+   0b00000000,         //CV_577  -  effect type
+   0b00000000,         //CV_578  -  brightness
+   0b00000000,         //CV_579  -  effect period
+   0b00000000,         //CV_580  -  flags
+//GPIO 17 lighting effect
+   0b00000000,         //CV_581  -  effect type
+   0b00000000,         //CV_582  -  brightness
+   0b00000000,         //CV_583  -  effect period
+   0b00000000,         //CV_584  -  flags
+//GPIO 18 lighting effect
+   0b00000000,         //CV_585  -  effect type
+   0b00000000,         //CV_586  -  brightness
+   0b00000000,         //CV_587  -  effect period
+   0b00000000,         //CV_588  -  flags
+//GPIO 19 lighting effect
+   0b00000000,         //CV_589  -  effect type
+   0b00000000,         //CV_590  -  brightness
+   0b00000000,         //CV_591  -  effect period
+   0b00000000,         //CV_592  -  flags
+//GPIO 20 lighting effect
+   0b00000000,         //CV_593  -  effect type
+   0b00000000,         //CV_594  -  brightness
+   0b00000000,         //CV_595  -  effect period
+   0b00000000,         //CV_596  -  flags
+//GPIO 21 lighting effect
+   0b00000000,         //CV_597  -  effect type
+   0b00000000,         //CV_598  -  brightness
+   0b00000000,         //CV_599  -  effect period
+   0b00000000,         //CV_600  -  flags
+//GPIO 22 lighting effect
+   0b00000000,         //CV_601  -  effect type
+   0b00000000,         //CV_602  -  brightness
+   0b00000000,         //CV_603  -  effect period
+   0b00000000,         //CV_604  -  flags
+//GPIO 23 lighting effect
+   0b00000000,         //CV_605  -  effect type
+   0b00000000,         //CV_606  -  brightness
+   0b00000000,         //CV_607  -  effect period
+   0b00000000,         //CV_608  -  flags
+//GPIO 24 lighting effect
+   0b00000000,         //CV_609  -  effect type
+   0b00000000,         //CV_610  -  brightness
+   0b00000000,         //CV_611  -  effect period
+   0b00000000,         //CV_612  -  flags
+//GPIO 25 lighting effect
+   0b00000000,         //CV_613  -  effect type
+   0b00000000,         //CV_614  -  brightness
+   0b00000000,         //CV_615  -  effect period
+   0b00000000,         //CV_616  -  flags
+//GPIO 26 lighting effect
+   0b00000000,         //CV_617  -  effect type
+   0b00000000,         //CV_618  -  brightness
+   0b00000000,         //CV_619  -  effect period
+   0b00000000,         //CV_620  -  flags
+//GPIO 27 lighting effect
+   0b00000000,         //CV_621  -  effect type
+   0b00000000,         //CV_622  -  brightness
+   0b00000000,         //CV_623  -  effect period
+   0b00000000,         //CV_624  -  flags
+//GPIO 28 lighting effect
+   0b00000000,         //CV_625  -  effect type
+   0b00000000,         //CV_626  -  brightness
+   0b00000000,         //CV_627  -  effect period
+   0b00000000,         //CV_628  -  flags
+//GPIO 29 lighting effect
+   0b00000000,         //CV_629  -  effect type
+   0b00000000,         //CV_630  -  brightness
+   0b00000000,         //CV_631  -  effect period
+   0b00000000,         //CV_632  -  flags
+//GPIO 30 lighting effect
+   0b00000000,         //CV_633  -  effect type
+   0b00000000,         //CV_634  -  brightness
+   0b00000000,         //CV_635  -  effect period
+   0b00000000,         //CV_636  -  flags
+//GPIO 31 lighting effect
+   0b00000000,         //CV_637  -  effect type
+   0b00000000,         //CV_638  -  brightness
+   0b00000000,         //CV_639  -  effect period
+   0b00000000,         //CV_640  -  flags
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
    0b00000000,         //CV_641  -    
    0b00000000,         //CV_642  -    
    0b00000000,         //CV_643  -    
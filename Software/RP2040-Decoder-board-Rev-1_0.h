@@ -48,8 +48,11 @@
 #define PICO_FLASH_SIZE_BYTES 8388608
 #endif
 
-// Offset from base address used for saving CV_ARRAY_FLASH - in this case one sector size from the end of flash
-#define FLASH_TARGET_OFFSET (PICO_FLASH_SIZE_BYTES-FLASH_SECTOR_SIZE)
+// Number of sectors at the end of flash used for storing the CVs (CV journal, see cv_journal_t in core0.h)
+#define CV_STORE_SECTORS 4
+
+// Offset from base address used for saving the CVs - in this case CV_STORE_SECTORS sector sizes from the end of flash
+#define FLASH_TARGET_OFFSET (PICO_FLASH_SIZE_BYTES-CV_STORE_SECTORS*FLASH_SECTOR_SIZE)
 
 // For some reason the clock divider of 4 is necessary, otherwise the controller occasionally hard faults
 // Another workaround could be to run code from RAM but this seems to work fine
@@ -9,24 +9,48 @@
 // Define pointer to CV array stored in flash memory, FLASH_TARGET_OFFSET is defined in CMakeLists.txt and depending on flash size,
 // it gets stored in the highest address flash sector possible, to avoid interference with the program code.
 // CMakelists.txt also checks for program code exceeding past the last sector. Just have to make sure the correct flash size is set in CMakeLists.txt
-const uint8_t *CV_ARRAY_FLASH = (const uint8_t *) (XIP_BASE + FLASH_TARGET_OFFSET);
+const uint8_t *CV_ARRAY_FLASH = (const uint8_t *) (XIP_BASE + CV_LEGACY_OFFSET);
 
 // level_table is used to store pwm levels for any output using PWM
 uint16_t level_table[sizeof(uint32_t)*8] = {0};
 
-// Volatile due to modification in gpio interrupt context 
-volatile absolute_time_t falling_edge_time, rising_edge_time;
+// Function mapping lookup tables and currently set outputs, see set_outputs()
+output_map_t output_map = {0};
+output_state_t output_state = {0};
 
-// Input bit buffer for DCC signal
-uint64_t input_bit_buffer = 0;
-dcc_ring_buffer_t dcc_r_buf = {0};
+// Lighting effects of PWM outputs, animated by output_effects_timer_callback()
+output_effects_t output_effects = {0};
 
+// State machine running the dcc_rx PIO program (see dcc_rx.pio) and DMA channel transferring half-bit durations
+uint dcc_rx_sm;
+uint dcc_rx_dma_chan;
+
+// Ring buffer containing half-bit durations in us written by DMA, aligned to its size for DMA address wrapping
+uint32_t dcc_half_bit_buf[DCC_HALF_BIT_BUF_LEN] __attribute__((aligned(DCC_HALF_BIT_BUF_LEN * sizeof(uint32_t))));
+dcc_half_bit_stats_t dcc_half_bit_stats = {0};
+dcc_half_bit_decoder_t dcc_half_bit_decoder = {0};
+
+// State of the CV journal in flash, see load_cv_journal()
+cv_journal_t cv_journal = {0};
+
+// CV writes which aren't persisted yet, see commit_cv_transaction()
+cv_transaction_t cv_transaction = {0};
+
+// Queue of flash jobs executed by run_flash_writer() in idle gaps of the DCC signal
+flash_job_t flash_job_buf[FLASH_JOB_QUEUE_LEN];
+spsc_queue_t flash_job_queue;
+flash_writer_t flash_writer = {0};
+
+// Framer state for assembling DCC packets bit by bit
+dcc_framer_t dcc_framer = {0};
+
+// Active address of the decoder, see update_dcc_address()
+dcc_address_t dcc_address = {0};
+
+// Queue of detected DCC packets, written by process_dcc_bit() and read by the main loop
+dcc_packet_t dcc_packet_buf[RING_BUFFER_PACKETS];
+spsc_queue_t dcc_packet_queue;
 
-static void increment_ring_buffer_idx(size_t * idx, uint8_t ring_buffer_length) {
-    // Takes index variable as a pointer and increments it by 1. When index reaches the end of the ring buffer, it wraps around.
-    // The wrap around value is the length of the ring buffer.
-    *idx = (*idx + 1) % ring_buffer_length;
-}
 
 static size_t get_flash_size() {
     // Function to read the flash size of the chip, used for debugging/testing purposes
@@ -59,6 +83,10 @@ void hardfault_handler(void) {
     // Log hardfault
     LOG(1, "HARDFAULT @ core%u!\n", get_core_num());
     LOG(1, "Rebooting...\n")
+    // core0 is the only consumer of the log rings, after a fault of core1 its main loop keeps flushing until the reset
+    if (get_core_num() == 0) {
+        log_flush();
+    }
 
     // Hardfault can't be recovered, trigger the watchdog to reset the system
     watchdog_reboot(0, 0, 1);
@@ -101,6 +129,257 @@ static void call_flash_range_program(void *param) {
     flash_range_program(offset, data, byte_count);
 }
 
+static const uint8_t *get_cv_journal_sector(uint8_t const sector) {
+    return (const uint8_t *) (XIP_BASE + FLASH_TARGET_OFFSET + sector * FLASH_SECTOR_SIZE);
+}
+
+static uint8_t get_cv_journal_record_check(uint16_t const cv_index, uint8_t const cv_data) {
+    // 0x5A makes sure an erased record (0xFFFF, 0xFF, 0xFF) is never valid
+    return (cv_index & 0xFF) ^ (cv_index >> 8) ^ cv_data ^ 0x5A;
+}
+
+static void load_cv_journal() {
+    // Find the active sector (valid header with the highest sequence number)
+    memset(&cv_journal, 0, sizeof(cv_journal));
+    for (uint8_t sector = 0; sector < CV_STORE_SECTORS; sector++) {
+        const cv_journal_header_t *header = (const cv_journal_header_t *) get_cv_journal_sector(sector);
+        if (header->magic != CV_JOURNAL_MAGIC || header->sequence != ~header->sequence_inv) continue;
+        if (!cv_journal.valid || header->sequence > cv_journal.sequence) {
+            cv_journal.valid = true;
+            cv_journal.sector = sector;
+            cv_journal.sequence = header->sequence;
+        }
+    }
+    if (!cv_journal.valid) {
+        // Factory state or CVs written by firmware without journal, migrated by cv_setup_check()
+        LOG(1, "No valid CV journal sector found, loading CVs from legacy location...\n");
+        load_cv_array_ram(CV_ARRAY_FLASH);
+        return;
+    }
+
+    // Load snapshot and replay the records in order
+    const uint8_t *sector = get_cv_journal_sector(cv_journal.sector);
+    load_cv_array_ram(sector + CV_JOURNAL_SNAPSHOT_OFFSET);
+    const cv_journal_record_t *records = (const cv_journal_record_t *) (sector + CV_JOURNAL_RECORDS_OFFSET);
+    for (uint16_t i = 0; i < CV_JOURNAL_RECORDS; i++) {
+        const cv_journal_record_t record = records[i];
+        if (record.cv_index == 0xFFFF && record.cv_data == 0xFF && record.check == 0xFF) continue;
+        // Records after a partially programmed record are still valid, the next record is always appended after the last used one
+        cv_journal.next_record = i + 1;
+        if (record.cv_index >= CV_ARRAY_SIZE || record.check != get_cv_journal_record_check(record.cv_index, record.cv_data)) {
+            cv_journal.invalid_records++;
+            continue;
+        }
+        write_cv_array_ram(record.cv_index, record.cv_data);
+    }
+    LOG(1, "Loaded CV journal: sector %u, sequence %u, %u records, %u invalid records\n", cv_journal.sector,
+        cv_journal.sequence, cv_journal.next_record, cv_journal.invalid_records);
+}
+
+static bool run_cv_journal_compaction_step() {
+    // The next sector is the oldest one, the active sector stays valid until the new header is programmed
+    const uint8_t sector = cv_journal.valid ? (cv_journal.sector + 1) % CV_STORE_SECTORS : 0;
+    const uint32_t sector_offset = FLASH_TARGET_OFFSET + sector * FLASH_SECTOR_SIZE;
+    switch (flash_writer.step) {
+        case FLASH_WRITER_IDLE:
+        case FLASH_WRITER_ERASE: {
+            LOG(2, "Compacting CV journal into sector %u...\n", sector);
+            uintptr_t params_erase[] = {sector_offset, FLASH_SECTOR_SIZE};
+            int ret_val = flash_safe_execute(call_flash_range_erase, params_erase, FLASH_TIMEOUT_IN_MS);
+            if (ret_val != PICO_OK){
+                set_error(FLASH_SAFE_EXECUTE_ERASE_FAILURE);
+                return false;
+            }
+            flash_writer.step = FLASH_WRITER_SNAPSHOT;
+            return true;
+        }
+        case FLASH_WRITER_SNAPSHOT: {
+            // Snapshot of the CVs at this point in time, later CV writes are appended as records
+            uintptr_t params_snapshot[] = {sector_offset + CV_JOURNAL_SNAPSHOT_OFFSET, CV_ARRAY_SIZE, (uintptr_t)CV_ARRAY_RAM};
+            int ret_val = flash_safe_execute(call_flash_range_program, params_snapshot, FLASH_TIMEOUT_IN_MS);
+            if (ret_val != PICO_OK){
+                set_error(FLASH_SAFE_EXECUTE_PROGRAM_FAILURE);
+                return false;
+            }
+            flash_writer.step = FLASH_WRITER_HEADER;
+            return true;
+        }
+        case FLASH_WRITER_HEADER: {
+            uint8_t page[FLASH_PAGE_SIZE];
+            memset(page, 0xFF, sizeof(page));
+            const uint32_t sequence = cv_journal.valid ? cv_journal.sequence + 1 : 0;
+            const cv_journal_header_t header = {.magic = CV_JOURNAL_MAGIC, .sequence = sequence, .sequence_inv = ~sequence};
+            memcpy(page, &header, sizeof(header));
+            if (!program_cv_journal_page(sector_offset, page)) {
+                return false;
+            }
+            cv_journal.valid = true;
+            cv_journal.sector = sector;
+            cv_journal.sequence = sequence;
+            cv_journal.next_record = 0;
+            flash_writer.step = FLASH_WRITER_IDLE;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool program_cv_journal_page(uint32_t const page_offset, const uint8_t *const page) {
+    uintptr_t params_program[] = {page_offset, FLASH_PAGE_SIZE, (uintptr_t)page};
+    int ret_val = flash_safe_execute(call_flash_range_program, params_program, FLASH_TIMEOUT_IN_MS);
+    if (ret_val != PICO_OK){
+        set_error(FLASH_SAFE_EXECUTE_PROGRAM_FAILURE);
+        return false;
+    }
+    return true;
+}
+
+static bool append_cv_transaction() {
+    // Fill the pages with consecutive records and program every page once
+    const uint32_t records_offset = FLASH_TARGET_OFFSET + cv_journal.sector * FLASH_SECTOR_SIZE + CV_JOURNAL_RECORDS_OFFSET;
+    uint32_t page_offset = (records_offset + cv_journal.next_record * sizeof(cv_journal_record_t)) & ~(FLASH_PAGE_SIZE - 1);
+    uint8_t page[FLASH_PAGE_SIZE];
+    memset(page, 0xFF, sizeof(page));
+    for (uint16_t cv_index = 0; cv_index < CV_ARRAY_SIZE; cv_index++) {
+        if (!(cv_transaction.dirty[cv_index / 32] & (1u << (cv_index % 32)))) continue;
+        const uint32_t record_offset = records_offset + cv_journal.next_record * sizeof(cv_journal_record_t);
+        if (record_offset - page_offset >= FLASH_PAGE_SIZE) {
+            // Record belongs to the next page
+            if (!program_cv_journal_page(page_offset, page)) {
+                return false;
+            }
+            page_offset = record_offset & ~(FLASH_PAGE_SIZE - 1);
+            memset(page, 0xFF, sizeof(page));
+        }
+        const uint8_t cv_data = CV_ARRAY_RAM[cv_index];
+        const cv_journal_record_t record = {.cv_index = cv_index, .cv_data = cv_data, .check = get_cv_journal_record_check(cv_index, cv_data)};
+        memcpy(&page[record_offset - page_offset], &record, sizeof(record));
+        cv_journal.next_record++;
+    }
+    return program_cv_journal_page(page_offset, page);
+}
+
+static void stage_cv_write(uint16_t const cv_index) {
+    const uint32_t mask = 1u << (cv_index % 32);
+    if (!(cv_transaction.dirty[cv_index / 32] & mask)) {
+        cv_transaction.dirty[cv_index / 32] |= mask;
+        cv_transaction.pending++;
+    }
+}
+
+static void commit_cv_transaction() {
+    if (!cv_transaction.pending) return;
+    // CVs staged until the job is executed are included as well
+    LOG(1, "Committing %u staged CV writes...\n", cv_transaction.pending);
+    cv_transaction.pending = 0;
+    submit_flash_job(FLASH_JOB_COMMIT_TRANSACTION);
+}
+
+static void check_cv_transaction() {
+    if (cv_transaction.pending &&
+        absolute_time_diff_us(cv_transaction.last_packet, get_absolute_time()) > CV_TRANSACTION_TIMEOUT_MS * 1000) {
+        commit_cv_transaction();
+    }
+}
+
+static void apply_autotune_result() {
+    // CVs computed by the autotune on core1 are persisted with a single commit, see autotune_result_t
+    if (autotune_result.state != AUTOTUNE_RESULT_READY) return;
+    __dmb();
+    for (uint8_t i = 0; i < autotune_result.count; i++) {
+        write_cv_array_ram(autotune_result.cv_index[i], autotune_result.cv_data[i]);
+        stage_cv_write(autotune_result.cv_index[i]);
+    }
+    commit_cv_transaction();
+    // core1 reinitializes the controller from CV_ARRAY_RAM as soon as it sees the new state
+    __dmb();
+    autotune_result.state = AUTOTUNE_RESULT_APPLIED;
+}
+
+static uint32_t submit_flash_job(flash_job_type_t const type) {
+    // A waiting job of the same type reads the staged CVs and CV_ARRAY_RAM only when it is started
+    uint32_t *const waiting = type == FLASH_JOB_COMMIT_TRANSACTION ? &flash_writer.waiting_commit
+                                                                   : &flash_writer.waiting_compaction;
+    if (*waiting != 0) {
+        return *waiting;
+    }
+    flash_job_t *const job = spsc_queue_write_slot(&flash_job_queue);
+    if (job == NULL) {
+        // Can't happen with at most one waiting job per type, see FLASH_JOB_QUEUE_LEN
+        LOG(1, "Flash job queue full, job dropped\n");
+        return 0;
+    }
+    job->type = type;
+    spsc_queue_commit(&flash_job_queue);
+    *waiting = ++flash_writer.submitted;
+    return *waiting;
+}
+
+static void complete_flash_job(bool const success) {
+    spsc_queue_release(&flash_job_queue);
+    flash_writer.step = FLASH_WRITER_IDLE;
+    flash_writer.completed++;
+    if (!success) {
+        flash_writer.failed++;
+        flash_writer.last_failed = flash_writer.completed;
+    }
+}
+
+static bool run_flash_writer() {
+    const flash_job_t *job = spsc_queue_read_slot(&flash_job_queue);
+    if (job == NULL) {
+        return false;
+    }
+    if (flash_writer.step != FLASH_WRITER_IDLE) {
+        // Continue compaction started by the current job
+        const bool success = run_cv_journal_compaction_step();
+        if (!success || flash_writer.step == FLASH_WRITER_IDLE) {
+            complete_flash_job(success);
+        }
+        return true;
+    }
+    switch (job->type) {
+        case FLASH_JOB_COMMIT_TRANSACTION: {
+            // CVs written from now on need a new job
+            flash_writer.waiting_commit = 0;
+            uint16_t staged = 0;
+            for (uint16_t i = 0; i < CV_ARRAY_SIZE / 32; i++) {
+                staged += __builtin_popcount(cv_transaction.dirty[i]);
+            }
+            const bool fits = cv_journal.valid && cv_journal.next_record + staged <= CV_JOURNAL_RECORDS;
+            const bool success = !staged || !fits || append_cv_transaction();
+            // When the records don't fit, the snapshot of the compacted sector contains all staged CVs
+            memset(&cv_transaction.dirty, 0, sizeof(cv_transaction.dirty));
+            if (fits || !staged) {
+                complete_flash_job(success);
+                return true;
+            }
+            break;
+        }
+        case FLASH_JOB_COMPACT_CV_JOURNAL:
+            flash_writer.waiting_compaction = 0;
+            break;
+    }
+    // Start compaction with the first step, the job is completed after the last step
+    flash_writer.step = FLASH_WRITER_ERASE;
+    if (!run_cv_journal_compaction_step()) {
+        complete_flash_job(false);
+    }
+    return true;
+}
+
+static void flush_flash_writer() {
+    while (run_flash_writer()) {
+        watchdog_update();
+    }
+}
+
+static bool is_dcc_idle_gap() {
+    // Between packets the framer waits for the preamble, evaluating the previous packet is already done
+    return dcc_framer.state == DCC_FRAMER_PREAMBLE && spsc_queue_count(&dcc_packet_queue) == 0 &&
+           dcc_half_bit_stats.consumed == get_dcc_half_bits_produced();
+}
+
 static void call_flash_do_cmd(void *param) {
     // This function will be called when it's safe to call flash_do_cmd
     // Cast void pointer to void pointer array
@@ -190,27 +469,15 @@ static void adc_offset_adjustment(uint32_t const n) {
 
     LOG(1, "New ADC Offset value CV_172 = %u\n", overall_avg_offset);
 
-    // Create temporary array -> change CV 172 in temp array -> erase flash -> write temp array to flash
-    uint8_t CV_ARRAY_TEMP[CV_ARRAY_SIZE];
-    memcpy(CV_ARRAY_TEMP, CV_ARRAY_FLASH, sizeof(CV_ARRAY_TEMP));
-    CV_ARRAY_TEMP[171] = overall_avg_offset;
-    uintptr_t params_erase[] = {FLASH_TARGET_OFFSET, FLASH_SECTOR_SIZE};
-    int ret_val = flash_safe_execute(call_flash_range_erase, params_erase, FLASH_TIMEOUT_IN_MS);
-    if (ret_val != PICO_OK){
-        set_error(FLASH_SAFE_EXECUTE_ERASE_FAILURE);
-        return;
-    }
-    uintptr_t params_program[] = {FLASH_TARGET_OFFSET, sizeof(CV_ARRAY_TEMP), (uintptr_t)CV_ARRAY_TEMP};
-    ret_val = flash_safe_execute(call_flash_range_program, params_program, FLASH_TIMEOUT_IN_MS);
-    if(ret_val != PICO_OK){
-        set_error(FLASH_SAFE_EXECUTE_PROGRAM_FAILURE);
-        return;
-    }
+    // Change CV 172 in RAM and append it to the CV journal
+    write_cv_array_ram(171, overall_avg_offset);
+    stage_cv_write(171);
+    commit_cv_transaction();
 }
 
 static void acknowledge() {
     // Acknowledge a CV rd/wr instruction by pulsing the motor in both directions
-    const uint16_t max_lvl = _125M / (CV_ARRAY_FLASH[8] * 100 + 10000);
+    const uint16_t max_lvl = cv_fields.motor_max_level;
     pwm_set_gpio_level(MOTOR_FWD_PIN, max_lvl);
     busy_wait_ms(3);
     pwm_set_gpio_level(MOTOR_FWD_PIN, 0);
@@ -222,7 +489,7 @@ static void acknowledge() {
 static void verify_cv_bit(uint16_t const cv_address, const bool bit_val, uint8_t const bit_pos) {
     // Check for matching bit, when found call acknowledge()
     const uint8_t mask = 0b00000001;
-    const bool res = ((CV_ARRAY_FLASH[cv_address] >> bit_pos) & mask) == bit_val;
+    const bool res = ((CV_ARRAY_RAM[cv_address] >> bit_pos) & mask) == bit_val;
     if (res) {
         acknowledge();
     }
@@ -230,44 +497,37 @@ static void verify_cv_bit(uint16_t const cv_address, const bool bit_val, uint8_t
 
 static void verify_cv_byte(uint16_t const cv_address, uint8_t const cv_data) {
     // Check for matching byte, when found call acknowledge()
-    if (CV_ARRAY_FLASH[cv_address] == cv_data) acknowledge();
+    if (CV_ARRAY_RAM[cv_address] == cv_data) acknowledge();
 }
 
 static void write_cv_byte(uint16_t cv_address, uint8_t cv_data) {
-    // Write the specified CV byte to flash
-    uint8_t CV_ARRAY_TEMP[CV_ARRAY_SIZE];
-    memcpy(CV_ARRAY_TEMP, CV_ARRAY_FLASH, sizeof(CV_ARRAY_TEMP));
-    CV_ARRAY_TEMP[cv_address] = cv_data;
-    // First erase necessary amount of  blocks in flash and then rewrite to flash
-    uintptr_t params_erase[] = {FLASH_TARGET_OFFSET, FLASH_SECTOR_SIZE};
-    int ret_val = flash_safe_execute(call_flash_range_erase, params_erase, FLASH_TIMEOUT_IN_MS);
-    if (ret_val != PICO_OK){
-        set_error(FLASH_SAFE_EXECUTE_ERASE_FAILURE);
-        return;
-    }
-    uintptr_t params_program[] = { FLASH_TARGET_OFFSET, sizeof(CV_ARRAY_TEMP), (uintptr_t)CV_ARRAY_TEMP};
-    ret_val = flash_safe_execute(call_flash_range_program, params_program, FLASH_TIMEOUT_IN_MS);
-    if(ret_val != PICO_OK){
-        set_error(FLASH_SAFE_EXECUTE_PROGRAM_FAILURE);
-        return;
+    // Update the RAM copy of the CV array and stage the CV write for the CV journal in flash
+    // Writing an unchanged value doesn't need any flash access
+    if (CV_ARRAY_RAM[cv_address] != cv_data) {
+        write_cv_array_ram(cv_address, cv_data);
+        update_dcc_address();
+        if ((cv_address >= 111 && cv_address <= 114) || cv_address == 177 || (cv_address >= 256 && cv_address < EFFECT_CV_OFFSET + 4 * 32)) {
+            // PWM configuration, function mapping or lighting effects
+            build_output_map();
+        }
+        stage_cv_write(cv_address);
+        if (!(CV_ARRAY_RAM[176] & 0b1)) {
+            // Persisted by the flash writer in the next idle gap of the DCC signal, in transaction mode (CV_177 bit0)
+            // when the programming session ends
+            commit_cv_transaction();
+        }
     }
     acknowledge();
 }
 
 static void reset_cv_array_to_default(){
-    // Reset all CVs to default (CV_ARRAY_DEFAULT)
-    uintptr_t params_erase[] = {FLASH_TARGET_OFFSET, FLASH_SECTOR_SIZE};
-    int ret_val = flash_safe_execute(call_flash_range_erase, params_erase, FLASH_TIMEOUT_IN_MS);
-    if (ret_val != PICO_OK){
-        set_error(FLASH_SAFE_EXECUTE_ERASE_FAILURE);
-        return;
-    }
-    uintptr_t params_program[] = {FLASH_TARGET_OFFSET, sizeof(CV_ARRAY_DEFAULT), (uintptr_t)CV_ARRAY_DEFAULT};
-    ret_val = flash_safe_execute(call_flash_range_program, params_program, FLASH_TIMEOUT_IN_MS);
-    if(ret_val != PICO_OK){
-        set_error(FLASH_SAFE_EXECUTE_PROGRAM_FAILURE);
-        return;
-    }
+    // Reset all CVs to default (CV_ARRAY_DEFAULT), the journal is compacted into a new sector containing only the defaults
+    load_cv_array_ram(CV_ARRAY_DEFAULT);
+    update_dcc_address();
+    build_output_map();
+    memset(&cv_transaction.dirty, 0, sizeof(cv_transaction.dirty));
+    cv_transaction.pending = 0;
+    submit_flash_job(FLASH_JOB_COMPACT_CV_JOURNAL);
 }
 
 static void write_cv_handler(uint16_t const cv_index, uint8_t const cv_data) {
@@ -301,17 +561,27 @@ static void write_cv_handler(uint16_t const cv_index, uint8_t const cv_data) {
         case 16: // CV_17
             // CV_17 must have a value between 11000000->(192dec) and 11100111->(231dec) inclusive
             // CV_17 == 192 && CV_18 == 0 -> Address = 0 is also not valid and therefore shall not be set
-            if ((cv_data < 192 || cv_data > 231) || (CV_ARRAY_FLASH[17] == 0 && cv_data == 192)) {
+            if ((cv_data < 192 || cv_data > 231) || (CV_ARRAY_RAM[17] == 0 && cv_data == 192)) {
                 break;
             }
             write_cv_byte(cv_index, cv_data);
             break;
         case 17: // CV_18
-            if(CV_ARRAY_FLASH[16] == 192 && cv_data == 0){
+            if(CV_ARRAY_RAM[16] == 192 && cv_data == 0){
                 break;
             }
             write_cv_byte(cv_index, cv_data);
             break;
+        case 176: // CV_177
+            // Transaction mode - staged CV writes are committed first, CV_177 itself is always persisted immediately
+            commit_cv_transaction();
+            if (CV_ARRAY_RAM[176] != cv_data) {
+                write_cv_array_ram(cv_index, cv_data);
+                stage_cv_write(cv_index);
+                commit_cv_transaction();
+            }
+            acknowledge();
+            break;
         case 30: // CV_31 & CV_32 Index isn't implemented and shall not be set
             break;
         case 31: // CV_31 & CV_32 Index isn't implemented and shall not be set
@@ -355,40 +625,158 @@ static void program_mode(size_t const number_of_bytes, const uint8_t *const byte
     }
 }
 
-static void set_outputs(uint32_t const functions_to_set_bitmask) {
-    // Get outputs with pwm enabled and preset outputs_to_set_PWM variable with resulting GPIO Bitmask
-    const uint32_t PWM_enabled_outputs = get_32bit_CV(111);
-    uint32_t outputs_to_set_PWM = PWM_enabled_outputs;
+static void build_output_map() {
+    output_map.pwm_enabled = get_32bit_CV(111) & GPIO_ALLOWED_OUTPUTS;
+    for (uint8_t dir = 0; dir < 2; dir++) {
+        for (uint8_t nibble = 0; nibble < OUTPUT_MAP_NIBBLES; nibble++) {
+            uint32_t *const table = output_map.outputs[dir][nibble];
+            table[0] = 0;
+            for (uint8_t value = 1; value < 16; value++) {
+                // Entry of value without its lowest set bit, ORed with the configuration of the function of that bit
+                const uint8_t bit = __builtin_ctz(value);
+                const uint8_t function = nibble * 4 + bit;
+                table[value] = table[value & (value - 1)] | (get_32bit_CV(function * 8 + 260 - 4 * dir) & GPIO_ALLOWED_OUTPUTS);
+            }
+        }
+    }
+    build_output_effects();
+}
 
-    // Get enabled output configuration corresponding to set functions and direction
-    uint32_t outputs_to_set = 0;
-    uint32_t temp_mask = 1;
+static void build_output_effects() {
+    // Stop animating while the effects are decoded, the timer callback must not see partially decoded effects
+    if (output_effects.timer_running) {
+        cancel_repeating_timer(&output_effects.timer);
+        output_effects.timer_running = false;
+    }
+    const uint32_t prev_active = output_effects.active;
+    output_effects.active = 0;
+    output_effects.dim_scale = CV_ARRAY_RAM[177] + 1;
+    if (output_effects.random == 0) {
+        output_effects.random = 0x2545F491;
+    }
     for (uint8_t i = 0; i < 32; i++) {
-        if (temp_mask & functions_to_set_bitmask) {
-            const direction_t dir  = get_direction_of_speed_step(speed_step_target);
-            outputs_to_set |= get_32bit_CV(i * 8 + 260 - 4 * dir);
+        const uint8_t *const descriptor = &CV_ARRAY_RAM[EFFECT_CV_OFFSET + 4 * i];
+        output_effect_t *const effect = &output_effects.output[i];
+        effect->type = descriptor[0] < EFFECT_TYPES ? descriptor[0] : EFFECT_NONE;
+        effect->scale = descriptor[1] + 1;
+        effect->period = descriptor[2] ? descriptor[2] : 1;
+        effect->start_phase = (descriptor[3] & 0b00100000) ? effect->period / 2 : 0;
+        effect->phase = effect->start_phase;
+        effect->dim_function = (descriptor[3] & 0b10000000) ? (descriptor[3] & 0b00011111) : 0xFF;
+        effect->step = (effect->type == EFFECT_FADE) ? 256 / effect->period : 0;
+        effect->brightness = 0;
+        effect->level = UINT32_MAX;
+        if (effect->type != EFFECT_NONE && ((output_map.pwm_enabled >> i) & 1)) {
+            output_effects.active |= 1u << i;
+        }
+    }
+    // Outputs which lost their effect are set to their static level again
+    for (uint32_t removed = prev_active & ~output_effects.active; removed; removed &= removed - 1) {
+        const uint8_t i = __builtin_ctz(removed);
+        pwm_set_gpio_level(i, (output_state.pwm >> i) & 1 ? level_table[i] : 0);
+    }
+    if (output_effects.active) {
+        output_effects.timer_running = add_repeating_timer_ms(-EFFECT_TICK_MS, output_effects_timer_callback, NULL, &output_effects.timer);
+        if (!output_effects.timer_running) {
+            LOG(1, "Failed to start lighting effects timer!\n");
         }
-        temp_mask <<= 1;
     }
-    outputs_to_set_PWM &= outputs_to_set;                       // Outputs with PWM to be enabled
-    outputs_to_set &= ~outputs_to_set_PWM;                      // Outputs without PWM to be enabled
+}
 
-    // Set regular outputs without PWM, preventing illegal GPIO by masking with GPIO_ALLOWED_OUTPUTS
-    gpio_put_masked(GPIO_ALLOWED_OUTPUTS, outputs_to_set);
+static uint16_t get_effect_brightness(output_effect_t *const effect, bool const on) {
+    // Fading effects keep animating after being switched off, all others restart at their start phase when switched on
+    if (effect->type == EFFECT_FADE) {
+        const uint16_t target = on ? 256 : 0;
+        if (effect->brightness < target) {
+            effect->brightness = (target - effect->brightness > effect->step) ? effect->brightness + effect->step : target;
+        }
+        else if (effect->brightness > target) {
+            effect->brightness = (effect->brightness - target > effect->step) ? effect->brightness - effect->step : target;
+        }
+        return effect->brightness;
+    }
+    if (!on) {
+        effect->phase = effect->start_phase;
+        effect->brightness = 0;
+        return 0;
+    }
+    const uint8_t phase = effect->phase;
+    effect->phase = (phase + 1 < effect->period) ? phase + 1 : 0;
+    switch (effect->type) {
+        case EFFECT_MARS:
+            return 64 + ((192 * effect_wave_table[(phase * 64) / effect->period]) >> 8);
+        case EFFECT_FLICKER:
+            // New random target every period, the brightness follows it with a first order low pass
+            if (phase == 0 || effect->step == 0) {
+                uint32_t x = output_effects.random;
+                x ^= x << 13;
+                x ^= x >> 17;
+                x ^= x << 5;
+                output_effects.random = x;
+                effect->step = 96 + (x & 0x9F);
+            }
+            effect->brightness = (effect->brightness * 3 + effect->step) >> 2;
+            return effect->brightness;
+        case EFFECT_STROBE:
+            return (phase < EFFECT_STROBE_TICKS) ? 256 : 0;
+        case EFFECT_DOUBLE_STROBE:
+            return (phase < EFFECT_STROBE_TICKS || (phase >= 2 * EFFECT_STROBE_TICKS && phase < 3 * EFFECT_STROBE_TICKS)) ? 256 : 0;
+        case EFFECT_BLINK:
+            return (phase < (effect->period + 1) / 2) ? 256 : 0;
+        default:
+            return 256;
+    }
+}
 
-    // Set PWM enabled outputs to desired level
-    temp_mask = 1;
-    for (uint8_t i = 0; i < 32; ++i) {
-        if (temp_mask & outputs_to_set_PWM) {
-            pwm_set_gpio_level(i, level_table[i]);
-            pwm_gpio_to_channel(i);
-            pwm_gpio_to_slice_num(i);
+static bool __not_in_flash_func(output_effects_timer_callback)(__unused struct repeating_timer *t) {
+    const uint32_t on = output_effects.on;
+    const uint32_t functions = output_effects.functions;
+    for (uint32_t outputs = output_effects.active; outputs; outputs &= outputs - 1) {
+        const uint8_t i = __builtin_ctz(outputs);
+        output_effect_t *const effect = &output_effects.output[i];
+        uint32_t brightness = (get_effect_brightness(effect, (on >> i) & 1) * effect->scale) >> 8;
+        // Rule 17 dimming
+        if (effect->dim_function < 32 && ((functions >> effect->dim_function) & 1)) {
+            brightness = (brightness * output_effects.dim_scale) >> 8;
         }
-        else if (temp_mask & PWM_enabled_outputs) {
-            pwm_set_gpio_level(i, 0);
+        const uint32_t level = (level_table[i] * brightness) >> 8;
+        if (level != effect->level) {
+            pwm_set_gpio_level(i, level);
+            effect->level = level;
         }
-        temp_mask <<= 1;
     }
+    return true;
+}
+
+static void set_outputs(uint32_t const functions_to_set_bitmask) {
+    PROFILE_START(PROFILE_SET_OUTPUTS);
+    // Get enabled output configuration corresponding to set functions and direction
+    const direction_t dir = get_direction_of_speed_step(speed_step_target);
+    uint32_t outputs_to_set = 0;
+    for (uint8_t nibble = 0; nibble < OUTPUT_MAP_NIBBLES; nibble++) {
+        outputs_to_set |= output_map.outputs[dir][nibble][(functions_to_set_bitmask >> (4 * nibble)) & 0xF];
+    }
+    const uint32_t outputs_to_set_PWM = outputs_to_set & output_map.pwm_enabled;    // Outputs with PWM to be enabled
+    outputs_to_set &= ~outputs_to_set_PWM;                                          // Outputs without PWM to be enabled
+
+    // Set regular outputs without PWM which changed
+    const uint32_t changed = outputs_to_set ^ output_state.gpio;
+    if (changed) {
+        gpio_put_masked(changed, outputs_to_set);
+    }
+
+    // Effect outputs are animated by output_effects_timer_callback()
+    output_effects.functions = functions_to_set_bitmask;
+    output_effects.on = outputs_to_set_PWM & output_effects.active;
+
+    // Set PWM enabled outputs without effect which changed to desired level or 0
+    for (uint32_t changed_PWM = (outputs_to_set_PWM ^ output_state.pwm) & ~output_effects.active; changed_PWM; changed_PWM &= changed_PWM - 1) {
+        const uint8_t i = __builtin_ctz(changed_PWM);
+        pwm_set_gpio_level(i, (outputs_to_set_PWM >> i) & 1 ? level_table[i] : 0);
+    }
+    output_state.gpio = outputs_to_set;
+    output_state.pwm = outputs_to_set_PWM;
+    PROFILE_END(PROFILE_SET_OUTPUTS);
 }
 
 static void update_active_functions(uint32_t new_function_bitmask, const uint8_t clr_bit_ind, bool const direction_change) {
@@ -417,15 +805,6 @@ static void update_active_functions(uint32_t new_function_bitmask, const uint8_t
     }
 }
 
-static bool error_detection(size_t const number_of_bytes, const uint8_t *const byte_array) {
-    // Bitwise XOR for all Bytes -> when result is: "0b00000000" error check is passed.
-    uint8_t xor_byte = 0;
-    for (int i = 0; i < number_of_bytes; i++) {
-        xor_byte = xor_byte ^ byte_array[i];
-    }
-    return (0 == xor_byte);
-}
-
 static bool is_long_address(size_t const number_of_bytes, const uint8_t *const byte_array) {
     // Check for long address. Function returns true for long address, false for short address.
     if ((byte_array[number_of_bytes - 1] >> 6) == 0b00000011) {
@@ -434,6 +813,39 @@ static bool is_long_address(size_t const number_of_bytes, const uint8_t *const b
     return false;
 }
 
+static void update_dcc_address() {
+    // Long/extended address decoder configuration (CV_29 Bit5)
+    dcc_address.long_address = (CV_ARRAY_RAM[28] & 0b00100000) >> 5;
+    if (dcc_address.long_address) {
+        // start of transmission -> address_byte_1 -> address_byte_0 -> ... -> end of transmission
+        dcc_address.first_byte = CV_ARRAY_RAM[16] | 0b11000000;
+        dcc_address.second_byte = CV_ARRAY_RAM[17];
+    }
+    else {
+        // start of transmission ->  address_byte_0 -> ... -> end of transmission
+        dcc_address.first_byte = CV_ARRAY_RAM[0];
+        dcc_address.second_byte = 0;
+    }
+    LOG(2, "Active address: %u (%s)\n", dcc_address.long_address ? get_16bit_CV(16) & 0x3FFF : dcc_address.first_byte,
+        dcc_address.long_address ? "long" : "short");
+}
+
+static bool accept_dcc_address_bytes(const uint8_t *const data, size_t const length) {
+    const uint8_t first_byte = data[0];
+    if (length == 1) {
+        // Broadcast (reset) and service mode packets are evaluated regardless of the address, see evaluate_packet()
+        if (first_byte == 0 || (first_byte >= 112 && first_byte <= 127)) {
+            return true;
+        }
+        return first_byte == dcc_address.first_byte;
+    }
+    // The second byte is only part of the address for long addresses
+    if (!dcc_address.long_address || first_byte != dcc_address.first_byte) {
+        return true;
+    }
+    return data[1] == dcc_address.second_byte;
+}
+
 static bool address_evaluation(size_t const number_of_bytes, const uint8_t *const byte_array) {
     // First checks for idle message and then evaluates address included in byte_array[] which contains the received DCC message
     // Check for idle message
@@ -441,33 +853,12 @@ static bool address_evaluation(size_t const number_of_bytes, const uint8_t *cons
         return false;
     }
 
-    // Long/extended address decoder configuration (CV_29 Bit5)
-    const bool CV_29_bit5 = (CV_ARRAY_FLASH[28] & 0b00100000) >> 5;
-    uint16_t read_address;
-    // Check if decoder is configured to receive long/extended address (CV_29 Bit5 set)
-    if (CV_29_bit5) {
-        // Check DCC message for long address format
-        if (is_long_address(number_of_bytes, byte_array)) {
-            // DCC message received has long address format
-            // start of transmission -> address_byte_1 -> address_byte_0 -> ... -> end of transmission
-            const uint16_t address_byte_1 = (byte_array[number_of_bytes - 1]) - 192;  // Remove long address identifier bits
-            const uint16_t address_byte_0 = (byte_array[number_of_bytes - 2]);
-            read_address = (address_byte_1 << 8) + address_byte_0;
-            const uint16_t long_address = get_16bit_CV(16) & 0x3FFF;      // &Mask to remove long address identifier bits
-            return (long_address == read_address);
-        }
-        else {
-            // DCC message received does not have long address format
-            return false;
-        }
-    }
-    else {
-        // Else decoder is configured to receive short address (CV_29 Bit5 not set)
-        // Short address message:
-        // start of transmission ->  address_byte_0 -> ... -> end of transmission
-        read_address = byte_array[number_of_bytes - 1];
-        return CV_ARRAY_FLASH[0] == read_address;
+    // Compare with the active address precomputed by update_dcc_address()
+    if (byte_array[number_of_bytes - 1] != dcc_address.first_byte) {
+        return false;
     }
+    // For long addresses the second byte has to match as well
+    return !dcc_address.long_address || byte_array[number_of_bytes - 2] == dcc_address.second_byte;
 }
 
 static void instruction_evaluation(size_t const number_of_bytes, const uint8_t *const byte_array) {
@@ -545,91 +936,213 @@ static bool reset_message_check(size_t const number_of_bytes, const uint8_t *con
     return false;
 }
 
-static size_t detect_dcc_packet() {
-    // Checks for valid package - looking for correct preamble using bitmasks
-    // returns number of bytes if valid bit-pattern is found. Otherwise INVALID_PACKAGE is returned.
-    // INVALID_PACKAGE is defined in core0.h as SIZE_MAX (maximum value of size_t)
-    size_t number_of_bytes = INVALID_PACKAGE;
-    const uint64_t masked_message_3_bytes = input_bit_buffer & MESSAGE_MASK_3_BYTES;
-    if (masked_message_3_bytes == MESSAGE_3_BYTES) number_of_bytes = 3;
-    const uint64_t masked_message_4_bytes = input_bit_buffer & MESSAGE_MASK_4_BYTES;
-    if (masked_message_4_bytes == MESSAGE_4_BYTES) number_of_bytes = 4;
-    const uint64_t masked_message_5_bytes = input_bit_buffer & MESSAGE_MASK_5_BYTES;
-    if (masked_message_5_bytes == MESSAGE_5_BYTES) number_of_bytes = 5;
-    return number_of_bytes;
+static void evaluate_packet(const dcc_packet_t * packet) {
+    // DCC packet evaluation
+    // Error detection byte has already been checked by the framer (see process_dcc_bit())
+    static bool reset_message_flag;
+    // Check for matching address
+    if (address_evaluation(packet->length, packet->data)) {
+        reset_message_flag = false;
+        instruction_evaluation(packet->length, packet->data);
+    }
+    else if (reset_message_flag) {
+        // When previous packet was a reset message -> enter program mode
+        program_mode(packet->length, packet->data);
+        cv_transaction.last_packet = get_absolute_time();
+    }
+    else {
+        // Check for reset message and set flag when reset message is received
+        reset_message_flag = reset_message_check(packet->length, packet->data);
+        if (reset_message_flag) cv_transaction.last_packet = get_absolute_time();
+    }
 }
 
-static void bits_to_dcc_packet_data(dcc_packet_t * packet) {
-    // Writes data in input_bit_buffer to dcc_packet_t struct instance
-    //start of transmission -> byte_n(address byte) -> ... -> byte_0(error detection byte) -> end of transmission
-    for (uint8_t i = 0; i < packet->length; i++) {
-        packet->data[i] = input_bit_buffer >> (i * 9 + 1);
+static void push_dcc_packet() {
+    // Write data directly into the next free slot of the packet queue
+    dcc_packet_t *packet = spsc_queue_write_slot(&dcc_packet_queue);
+    if (packet == NULL) {
+        // Queue full - packet is dropped instead of overwriting unread packets
+        LOG(1, "DCC packet queue overflow (%lu dropped)\n", dcc_packet_queue.overflows);
+        return;
+    }
+    // start of transmission -> byte_n(address byte) -> ... -> byte_0(error detection byte) -> end of transmission
+    packet->length = dcc_framer.length;
+    for (uint8_t i = 0; i < dcc_framer.length; i++) {
+        packet->data[dcc_framer.length - 1 - i] = dcc_framer.data[i];
     }
+    spsc_queue_commit(&dcc_packet_queue);
 }
 
-static void evaluate_packet(dcc_packet_t * packet) {
-    // DCC packet evaluation
-    static bool reset_message_flag;
-    // Check for errors
-    if (error_detection(packet->length, packet->data)) {
-        // Check for matching address
-        if (address_evaluation(packet->length, packet->data)) {
-            reset_message_flag = false;
-            instruction_evaluation(packet->length, packet->data);
-        }
-        else if (reset_message_flag) {
-            // When previous packet was a reset message -> enter program mode
-            program_mode(packet->length, packet->data);
-        }
-        else {
-            // Check for reset message and set flag when reset message is received
-            reset_message_flag = reset_message_check(packet->length, packet->data);
-        }
+static void process_dcc_bit(bool const bit) {
+    switch (dcc_framer.state) {
+        case DCC_FRAMER_PREAMBLE:
+            if (bit) {
+                if (dcc_framer.preamble_bits < UINT8_MAX) dcc_framer.preamble_bits++;
+            }
+            else if (dcc_framer.preamble_bits >= DCC_PREAMBLE_MIN_BITS) {
+                // Packet start bit after a valid preamble
+                dcc_framer.state = DCC_FRAMER_DATA_BYTE;
+                dcc_framer.length = 0;
+                dcc_framer.bit_count = 0;
+                dcc_framer.checksum = 0;
+            }
+            else {
+                dcc_framer.preamble_bits = 0;
+            }
+            break;
+        case DCC_FRAMER_DATA_BYTE:
+            dcc_framer.byte = (dcc_framer.byte << 1) | bit;
+            if (++dcc_framer.bit_count == 8) {
+                if (dcc_framer.length == RING_BUFFER_BYTES) {
+                    // Packet exceeds maximum length -> discard and wait for next preamble
+                    dcc_framer.preamble_bits = 0;
+                    dcc_framer.state = DCC_FRAMER_PREAMBLE;
+                    break;
+                }
+                dcc_framer.data[dcc_framer.length++] = dcc_framer.byte;
+                dcc_framer.checksum ^= dcc_framer.byte;
+                if (dcc_framer.length <= 2 && !accept_dcc_address_bytes(dcc_framer.data, dcc_framer.length)) {
+                    // Packet for another decoder -> discard and wait for next preamble
+                    dcc_framer.filtered++;
+                    dcc_framer.preamble_bits = 0;
+                    dcc_framer.state = DCC_FRAMER_PREAMBLE;
+                    break;
+                }
+                dcc_framer.state = DCC_FRAMER_SEPARATOR;
+            }
+            break;
+        case DCC_FRAMER_SEPARATOR:
+            if (!bit) {
+                // Data byte start bit -> another byte follows
+                dcc_framer.bit_count = 0;
+                dcc_framer.state = DCC_FRAMER_DATA_BYTE;
+                break;
+            }
+            // Packet end bit, XOR of all bytes including the error detection byte has to be zero
+            if (dcc_framer.length >= DCC_PACKET_MIN_BYTES && dcc_framer.checksum == 0) {
+                push_dcc_packet();
+            }
+            else {
+                dcc_framer.rejected++;
+            }
+            // Packet end bit may be part of the next preamble
+            dcc_framer.preamble_bits = 1;
+            dcc_framer.state = DCC_FRAMER_PREAMBLE;
+            break;
     }
 }
 
-static void gpio_irq_cb(uint gpio, uint32_t events) {
-    absolute_time_t start_time = get_absolute_time();
-    // Check for rising edge on DCC input pin
-    if ((events & GPIO_IRQ_EDGE_RISE) && (gpio == DCC_INPUT_PIN)) {
-        track_signal_rise(gpio, events);
+static void adapt_dcc_threshold(uint32_t duration_us, bool const bit) {
+    // Exponentially weighted moving averages with alpha = 1/16, durations in 28.4 fixed point
+    if (duration_us > DCC_ADAPTIVE_ZERO_HALF_BIT_LIMIT_US) duration_us = DCC_ADAPTIVE_ZERO_HALF_BIT_LIMIT_US;
+    uint32_t *const avg = bit ? &dcc_half_bit_decoder.one_avg : &dcc_half_bit_decoder.zero_avg;
+    *avg = *avg - (*avg >> 4) + duration_us;
+    uint32_t threshold = (dcc_half_bit_decoder.one_avg + dcc_half_bit_decoder.zero_avg) >> 5;
+    if (threshold <= DCC_ONE_HALF_BIT_MAX_US) threshold = DCC_ONE_HALF_BIT_MAX_US + 1;
+    if (threshold >= DCC_ZERO_HALF_BIT_MIN_US) threshold = DCC_ZERO_HALF_BIT_MIN_US - 1;
+    dcc_half_bit_decoder.threshold_us = threshold;
+}
+
+static int8_t classify_dcc_half_bit(uint32_t const duration_us) {
+    if (duration_us < DCC_ONE_HALF_BIT_MIN_US || duration_us > DCC_ZERO_HALF_BIT_MAX_US) return -1;
+    if (dcc_half_bit_decoder.mode & DCC_DECODER_MODE_ADAPTIVE) return duration_us <= dcc_half_bit_decoder.threshold_us;
+    if (duration_us <= DCC_ONE_HALF_BIT_MAX_US) return 1;
+    if (duration_us >= DCC_ZERO_HALF_BIT_MIN_US) return 0;
+    return -1;
+}
+
+static void process_dcc_half_bit_strict(uint32_t const duration_us) {
+    const int8_t half = classify_dcc_half_bit(duration_us);
+    if (!dcc_half_bit_decoder.second_half) {
+        dcc_half_bit_decoder.first_half = half;
+        dcc_half_bit_decoder.first_half_us = duration_us;
+        dcc_half_bit_decoder.second_half = true;
+        return;
     }
-    // Check for falling edge on DCC input pin
-    else if ((events & GPIO_IRQ_EDGE_FALL) && (gpio == DCC_INPUT_PIN)) {
-        track_signal_fall(gpio, events);
+    if (half < 0 || half != dcc_half_bit_decoder.first_half) {
+        // Invalid bit, discard the current packet and use this half-bit as first half of the next bit
+        dcc_half_bit_stats.invalid_bits++;
+        dcc_framer.preamble_bits = 0;
+        dcc_framer.state = DCC_FRAMER_PREAMBLE;
+        dcc_half_bit_decoder.first_half = half;
+        dcc_half_bit_decoder.first_half_us = duration_us;
+        return;
     }
-    absolute_time_t end_time = get_absolute_time();
-    if (absolute_time_diff_us(start_time, end_time) > 20) {
-        LOG(1, "Time gpio_irq_cb: %lld us\n", absolute_time_diff_us(start_time, end_time));
+    dcc_half_bit_decoder.second_half = false;
+    if (dcc_half_bit_decoder.mode & DCC_DECODER_MODE_ADAPTIVE) {
+        adapt_dcc_threshold(dcc_half_bit_decoder.first_half_us, half);
+        adapt_dcc_threshold(duration_us, half);
     }
-    
+    process_dcc_bit(half);
 }
 
-static void track_signal_rise() {
-    // DCC-Signal pin rising edge. Write current time to rising_edge_time
-    rising_edge_time = get_absolute_time();
+static void filter_dcc_half_bit(uint32_t const duration_us) {
+    // A glitch splits a half-bit into pieces, only the half-bit in progress is merged. It is complete as soon as it
+    // reaches the shortest valid half-bit, so pieces are never added to a half-bit which is already complete.
+    if (duration_us < DCC_GLITCH_MAX_US) {
+        dcc_half_bit_stats.glitches++;
+    }
+    dcc_half_bit_decoder.held_us += duration_us;
+    if (dcc_half_bit_decoder.held_us >= DCC_ONE_HALF_BIT_MIN_US) {
+        process_dcc_half_bit_strict(dcc_half_bit_decoder.held_us);
+        dcc_half_bit_decoder.held_us = 0;
+    }
 }
 
-static void track_signal_fall() {
-    // DCC-Signal pin falling edge. Write current time to falling_edge_time
-    falling_edge_time = get_absolute_time();
-    // Time difference is equal to the time the signal was in a logical high state
-    const int64_t time_logical_high = absolute_time_diff_us(rising_edge_time, falling_edge_time);
-    // When logical high was longer than 87us write 0 bit into buffer otherwise 1
-    bool bit;
-    if (time_logical_high > 87) bit = 0;
-    else bit = 1;
-    input_bit_buffer <<= 1;
-    input_bit_buffer |= bit;
-    // Check if input buffer contains a valid dcc packet
-    // number_of_bytes contains the length of the packet when detected, otherwise -1
-    dcc_r_buf.packets[dcc_r_buf.wr_idx].length = detect_dcc_packet();
-    if (dcc_r_buf.packets[dcc_r_buf.wr_idx].length != INVALID_PACKAGE) {
-        // Write data into ring buffer containing dcc_packet_t struct instances
-        bits_to_dcc_packet_data(&dcc_r_buf.packets[dcc_r_buf.wr_idx]);
-        // Increment write index of ring buffer
-        increment_ring_buffer_idx(&dcc_r_buf.wr_idx, RING_BUFFER_PACKETS);
+static uint32_t get_dcc_half_bits_produced() {
+    // Number of half-bit durations written by DMA so far, counting continues across DMA restarts
+    uint32_t remaining = dma_channel_hw_addr(dcc_rx_dma_chan)->transfer_count;
+    if (remaining == 0) {
+        // Transfer count exhausted, restart the channel. The write address keeps wrapping inside the ring buffer.
+        dcc_half_bit_stats.produced_base += DCC_HALF_BIT_DMA_TRANSFERS;
+        dma_channel_set_trans_count(dcc_rx_dma_chan, DCC_HALF_BIT_DMA_TRANSFERS, true);
+        remaining = DCC_HALF_BIT_DMA_TRANSFERS;
+    }
+    return dcc_half_bit_stats.produced_base + (DCC_HALF_BIT_DMA_TRANSFERS - remaining);
+}
+
+static void decode_dcc_half_bits() {
+    // Decode the half-bits written to the ring buffer since the last call, until the packet queue is full. The rest
+    // stays in the ring buffer until packets have been evaluated, a half-bit completes at most one packet.
+    // Unsigned arithmetic takes care of counter overflows
+    const uint32_t produced = get_dcc_half_bits_produced();
+    if (produced == dcc_half_bit_stats.consumed) {
+        return;
+    }
+    PROFILE_START(PROFILE_DECODE_HALF_BITS);
+    uint32_t backlog = produced - dcc_half_bit_stats.consumed;
+    if (backlog > dcc_half_bit_stats.backlog_max) {
+        dcc_half_bit_stats.backlog_max = backlog;
+    }
+    if (backlog > DCC_HALF_BIT_BUF_LEN) {
+        // DMA has overwritten half-bits that weren't decoded yet, skip to the latest half of the ring buffer
+        dcc_half_bit_stats.overruns++;
+        dcc_half_bit_stats.consumed = produced - DCC_HALF_BIT_BUF_LEN / 2;
+        LOG(1, "DCC half-bit ring buffer overrun (backlog: %u)\n", backlog);
     }
+    if (dcc_half_bit_decoder.mode & DCC_DECODER_MODE_STRICT) {
+        while (dcc_half_bit_stats.consumed != produced && spsc_queue_count(&dcc_packet_queue) < RING_BUFFER_PACKETS) {
+            filter_dcc_half_bit(dcc_half_bit_buf[dcc_half_bit_stats.consumed & (DCC_HALF_BIT_BUF_LEN - 1)]);
+            dcc_half_bit_stats.consumed++;
+        }
+        PROFILE_END(PROFILE_DECODE_HALF_BITS);
+        return;
+    }
+    while (dcc_half_bit_stats.consumed != produced && spsc_queue_count(&dcc_packet_queue) < RING_BUFFER_PACKETS) {
+        const uint32_t idx = dcc_half_bit_stats.consumed & (DCC_HALF_BIT_BUF_LEN - 1);
+        // Durations at even indices belong to high half-bits, see dcc_rx.pio
+        // When logical high was longer than the threshold (default DCC_HIGH_HALF_BIT_THRESHOLD_US) the bit is a 0, otherwise 1
+        if ((idx & 1u) == 0) {
+            const uint32_t duration_us = dcc_half_bit_buf[idx];
+            const bool bit = duration_us <= dcc_half_bit_decoder.threshold_us;
+            if (dcc_half_bit_decoder.mode & DCC_DECODER_MODE_ADAPTIVE) {
+                adapt_dcc_threshold(duration_us, bit);
+            }
+            process_dcc_bit(bit);
+        }
+        dcc_half_bit_stats.consumed++;
+    }
+    PROFILE_END(PROFILE_DECODE_HALF_BITS);
 }
 
 static void init_outputs() {
@@ -644,7 +1157,7 @@ static void init_outputs() {
             const uint32_t channel = pwm_gpio_to_channel(i);   // Channel A = "0"; Channel B = "1"
             const uint16_t wrap = get_16bit_CV(115 + 7 * slice);
             const uint16_t level = get_16bit_CV(118 + 7 * slice + 2 * channel);
-            const uint8_t clock_divider = CV_ARRAY_FLASH[117 + 7 * slice] + 1;
+            const uint8_t clock_divider = CV_ARRAY_RAM[117 + 7 * slice] + 1;
             gpio_set_function(i, GPIO_FUNC_PWM);
             pwm_set_wrap(slice, wrap);
             pwm_set_gpio_level(i, 0);
@@ -655,19 +1168,28 @@ static void init_outputs() {
         }
         mask <<= 1;
     }
+    output_state.gpio = 0;
+    output_state.pwm = 0;
+    output_effects.on = 0;
+    build_output_map();
 }
 
 static void cv_setup_check() {
     LOG(1, "Checking CV array for factory state of flash or missing ADC offset setup...\n");
     // Check for flash factory setting and set CV_FLASH_ARRAY to default values when factory condition ("0xFF") is found.
-    if (CV_ARRAY_FLASH[64] == 0xFF) {
-        LOG(1, "Detected flash memory factory condidition (CV_65 == %u), resetting all CVs to default values...\n", CV_ARRAY_FLASH[64]);
+    if (CV_ARRAY_RAM[64] == 0xFF) {
+        LOG(1, "Detected flash memory factory condidition (CV_65 == %u), resetting all CVs to default values...\n", CV_ARRAY_RAM[64]);
         reset_cv_array_to_default();
     }
+    // Migrate CVs written by firmware versions without CV journal
+    else if (!cv_journal.valid) {
+        LOG(1, "Migrating CVs into the CV journal...\n");
+        submit_flash_job(FLASH_JOB_COMPACT_CV_JOURNAL);
+    }
 
     // Check for existing ADC offset setup
-    if (CV_ARRAY_FLASH[171] == 0xFF) {
-        LOG(1, "Detected ADC offset factory condidition (CV_172 == %u), running offset adjustment measurement function...\n", CV_ARRAY_FLASH[171]);
+    if (CV_ARRAY_RAM[171] == 0xFF) {
+        LOG(1, "Detected ADC offset factory condidition (CV_172 == %u), running offset adjustment measurement function...\n", CV_ARRAY_RAM[171]);
         adc_offset_adjustment(ADC_CALIBRATION_ITERATIONS);
     }
     LOG(1, "CV check done! Setting wait_for_cv_setup_check flag to false!\n");
@@ -680,15 +1202,15 @@ static void init_motor_pwm(uint8_t const gpio) {
     // Set GPIO pin to PWM functionality
     gpio_set_function(gpio, GPIO_FUNC_PWM);
     // Set wrap counter value saved in CV
-    const uint16_t wrap_counter = (_125M / (CV_ARRAY_FLASH[8] * 100 + 10000)) - 1;
+    const uint16_t wrap_counter = cv_fields.motor_max_level - 1;
     const uint32_t slice_num = pwm_gpio_to_slice_num(gpio);
-    pwm_set_clkdiv_int_frac(slice_num, CV_ARRAY_FLASH[173], 0);
+    pwm_set_clkdiv_int_frac(slice_num, CV_ARRAY_RAM[173], 0);
     pwm_set_wrap(slice_num, wrap_counter);
     // Set initial level to 0
     pwm_set_gpio_level(gpio, 0);
     // Enable PWM
     pwm_set_enabled(slice_num, true);
-    LOG(2, "Initialized motor PWM on pin: %u; wrap_counter %u; clkdiv %d;\n", gpio, wrap_counter, CV_ARRAY_FLASH[173]);
+    LOG(2, "Initialized motor PWM on pin: %u; wrap_counter %u; clkdiv %d;\n", gpio, wrap_counter, CV_ARRAY_RAM[173]);
 }
 
 static void init_adc() {
@@ -698,8 +1220,8 @@ static void init_adc() {
     // Set ADC GPIO pins to ADC functionality
     adc_gpio_init(FWD_V_EMF_ADC_PIN);
     adc_gpio_init(REV_V_EMF_ADC_PIN);
-    // Configure ADC FIFO
-    adc_fifo_setup(true, false, 0, false, false);
+    // Configure ADC FIFO, DMA requests are used for back-EMF measurements on core1 (see measure())
+    adc_fifo_setup(true, true, 1, false, false);
     LOG(1, "ADC initialization done!\n")
 }
 
@@ -711,16 +1233,43 @@ static void init_digital_input() {
     LOG(1, "DCC input pin initialization done!\n");
 }
 
+static void init_dcc_rx() {
+    LOG(1, "Initializing DCC half-bit timer state machine and DMA...\n");
+    // Decoder mode configured in CV_176, averages start at nominal "1" and stretched "0" timing -> initial threshold 87us
+    dcc_half_bit_decoder = (dcc_half_bit_decoder_t) {
+        .mode = CV_ARRAY_RAM[175] & (DCC_DECODER_MODE_STRICT | DCC_DECODER_MODE_ADAPTIVE),
+        .threshold_us = DCC_HIGH_HALF_BIT_THRESHOLD_US,
+        .one_avg = 58 << 4,
+        .zero_avg = 116 << 4,
+    };
+    const uint offset = pio_add_program(DCC_PIO, &dcc_rx_program);
+    dcc_rx_sm = pio_claim_unused_sm(DCC_PIO, true);
+    // DMA channel paced by the RX FIFO of the state machine writes the half-bit durations into the ring buffer
+    dcc_rx_dma_chan = dma_claim_unused_channel(true);
+    dma_channel_config c = dma_channel_get_default_config(dcc_rx_dma_chan);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_ring(&c, true, DCC_HALF_BIT_BUF_RING_BITS);
+    channel_config_set_dreq(&c, pio_get_dreq(DCC_PIO, dcc_rx_sm, false));
+    dma_channel_configure(dcc_rx_dma_chan, &c, dcc_half_bit_buf, &DCC_PIO->rxf[dcc_rx_sm], DCC_HALF_BIT_DMA_TRANSFERS, true);
+    // Start the state machine
+    dcc_rx_program_init(DCC_PIO, dcc_rx_sm, offset, DCC_INPUT_PIN);
+    LOG(1, "DCC half-bit timer running on PIO%u SM%u, DMA channel %u!\n", pio_get_index(DCC_PIO), dcc_rx_sm, dcc_rx_dma_chan);
+}
+
 static void wait_for_stdio_input() {
     while (true) {
         //watchdog_update();
         // Send a message to the user asking them to acknowledge it by sending a reply
         LOG(1, "Send any character to continue.\n");
+        log_flush();
         // Wait for a character
         int received_char = getchar_timeout_us(1e6);
         if ((received_char != PICO_ERROR_TIMEOUT) && (received_char > 0)) {
             // If a character is received, exit the function
             LOG(1, "Character '%c' received. Continuing...\n", (char)received_char);
+            log_flush();
             return;
         }
         // If no character is received, retry...
@@ -754,6 +1303,7 @@ int main() {
     #endif
 
     LOG(1, "core0 Initialization...\n");
+    profile_init();
     
     // Check for reboot by watchdog and set error when true
     if (watchdog_caused_reboot()) {
@@ -761,6 +1311,10 @@ int main() {
         set_error(REBOOT_BY_WATCHDOG);
     }
 
+    // Load CVs from the CV journal in flash into RAM, all CVs are read from CV_ARRAY_RAM from now on
+    spsc_queue_init(&flash_job_queue, flash_job_buf, sizeof(flash_job_t), FLASH_JOB_QUEUE_LEN);
+    load_cv_journal();
+
     // Initialize Motor PWM pins
     init_motor_pwm(MOTOR_FWD_PIN);
     init_motor_pwm(MOTOR_REV_PIN);
@@ -771,7 +1325,7 @@ int main() {
     // Initialize ADC
     init_adc();
 
-    // Initialize digital inputs and track signal irq
+    // Initialize digital inputs
     init_digital_input();
     
     LOG(1, "core0 initialization done!\n");
@@ -782,17 +1336,19 @@ int main() {
     // Wait for core1 to call flash_safe_execute_core_init() and set the flash_safe_execute_core_init_done flag
     LOG(1, "Waiting for flash_safe_execute_core_init_done flag...\n");
     while (!flash_safe_execute_core_init_done) {
+        log_drain();
         watchdog_update();
     }
     
     // Check CV array for factory state of flash or missing ADC offset setup
     cv_setup_check();
+
+    // Precompute the active address used for packet filtering
+    update_dcc_address();
     
-    // Register GPIO IRQ callback
-    gpio_set_irq_callback(gpio_irq_cb);
-    // Enable IRQ
-    gpio_set_irq_enabled(DCC_INPUT_PIN, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, true);
-    irq_set_enabled(IO_IRQ_BANK0, true);
+    // Start decoding the DCC signal
+    spsc_queue_init(&dcc_packet_queue, dcc_packet_buf, sizeof(dcc_packet_t), RING_BUFFER_PACKETS);
+    init_dcc_rx();
     
     // Enable the watchdog, requiring the watchdog to be updated every WATCHDOG_TIMER_IN_MS milliseconds or the chip will reboot
     // second arg is pause on debug which means the watchdog will pause when stepping through code
@@ -801,17 +1357,42 @@ int main() {
     
     // Endless loop
     while (true) {
-        // Check for new messages in ring buffer
-        if (dcc_r_buf.wr_idx != dcc_r_buf.rd_idx) {
-            absolute_time_t start_time = get_absolute_time();
-            evaluate_packet(&dcc_r_buf.packets[dcc_r_buf.rd_idx]);
-            increment_ring_buffer_idx(&dcc_r_buf.rd_idx, RING_BUFFER_PACKETS);
-            absolute_time_t end_time = get_absolute_time();
-            if (absolute_time_diff_us(start_time, end_time) > 40) {
-                LOG(1, "Time to evaluate message: %lld us\n", absolute_time_diff_us(start_time, end_time));
-            }
+        // Decode half-bits received by the PIO state machine
+        decode_dcc_half_bits();
+        // Check for new messages in packet queue
+        const dcc_packet_t *packet = spsc_queue_read_slot(&dcc_packet_queue);
+        if (packet != NULL) {
+            PROFILE_START(PROFILE_EVALUATE_PACKET);
+            evaluate_packet(packet);
+            PROFILE_END(PROFILE_EVALUATE_PACKET);
+            spsc_queue_release(&dcc_packet_queue);
         }
         else {
+            // Persist staged CV writes once the programming session has ended
+            check_cv_transaction();
+            // Persist the results of the autotune on core1
+            apply_autotune_result();
+            // Run pending flash jobs step by step while no packet is being received
+            if (is_dcc_idle_gap()) {
+                PROFILE_START(PROFILE_FLASH_WRITER);
+                if (run_flash_writer()) {
+                    PROFILE_END(PROFILE_FLASH_WRITER);
+                }
+            }
+            // Emit one deferred log record per idle pass, see LOG_DEFERRED
+            log_drain();
+            // Send one controller telemetry frame per idle pass, see TELEMETRY
+            telemetry_send();
+            #if PROFILING && LOGLEVEL > 0
+                // Profiler control via stdio: 'p' prints the statistics, 'r' clears them
+                const int received_char = getchar_timeout_us(0);
+                if (received_char == 'p') {
+                    profile_dump();
+                }
+                else if (received_char == 'r') {
+                    profile_reset();
+                }
+            #endif
             watchdog_update();
         }
     }
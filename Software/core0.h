@@ -8,54 +8,103 @@
 
 #include "shared.h"
 #include "CV.h"
+#include "spsc_queue.h"
+#include "dcc_rx.pio.h"
 
 /**
- * @def MESSAGE_3_BYTES
- * @brief Comparison bitmask for detecting 3 byte long DCC messages/packets
+ * @def DCC_PIO
+ * @brief PIO instance running the DCC bit decoder program (see dcc_rx.pio)
  */
-#define MESSAGE_3_BYTES 0b11111111110000000000000000000000000001
+#define DCC_PIO pio0
+
+/**
+ * @def DCC_HALF_BIT_BUF_LEN
+ * @brief Number of half-bit durations retained in the DMA ring buffer, must be a power of two.
+ *
+ * 2048 half-bits correspond to roughly 118ms of DCC signal consisting only of "1" bits.
+ */
+#define DCC_HALF_BIT_BUF_LEN 2048
+/**
+ * @def DCC_HALF_BIT_BUF_RING_BITS
+ * @brief log2 of the ring buffer size in bytes, used for DMA write address wrapping
+ */
+#define DCC_HALF_BIT_BUF_RING_BITS 13
+_Static_assert((DCC_HALF_BIT_BUF_LEN * sizeof(uint32_t)) == (1u << DCC_HALF_BIT_BUF_RING_BITS), "DCC_HALF_BIT_BUF_RING_BITS does not match DCC_HALF_BIT_BUF_LEN");
+/**
+ * @def DCC_HALF_BIT_DMA_TRANSFERS
+ * @brief Transfer count of the half-bit DMA channel, the channel is restarted when the count is exhausted
+ */
+#define DCC_HALF_BIT_DMA_TRANSFERS UINT32_MAX
+/**
+ * @def DCC_HIGH_HALF_BIT_THRESHOLD_US
+ * @brief High half-bits longer than this threshold are decoded as logical 0, otherwise as logical 1 (NMRA S-9.1 / RCN-210)
+ */
+#define DCC_HIGH_HALF_BIT_THRESHOLD_US 87
+/**
+ * @def DCC_ONE_HALF_BIT_MIN_US
+ * @brief Shortest valid "1" half-bit in strict decoder mode (NMRA S-9.1: 52us, minus 2us not measured while pushing)
+ */
+#define DCC_ONE_HALF_BIT_MIN_US 50
+/**
+ * @def DCC_ONE_HALF_BIT_MAX_US
+ * @brief Longest valid "1" half-bit in strict decoder mode (NMRA S-9.1)
+ */
+#define DCC_ONE_HALF_BIT_MAX_US 64
+/**
+ * @def DCC_ZERO_HALF_BIT_MIN_US
+ * @brief Shortest valid "0" half-bit in strict decoder mode (NMRA S-9.1: 90us, minus 2us not measured while pushing)
+ */
+#define DCC_ZERO_HALF_BIT_MIN_US 88
 /**
- * @def MESSAGE_MASK_3_BYTES
- * @brief Bitmask for detecting 3 byte long DCC messages/packets, input_bit_buffer is bitwise ANDed with the mask
+ * @def DCC_ZERO_HALF_BIT_MAX_US
+ * @brief Longest valid "0" half-bit in strict decoder mode (NMRA S-9.1)
  */
-#define MESSAGE_MASK_3_BYTES 0b11111111111000000001000000001000000001
+#define DCC_ZERO_HALF_BIT_MAX_US 10000
 /**
- * @def MESSAGE_4_BYTES
- * @brief Comparison bitmask for detecting 4 byte long DCC messages/packets
+ * @def DCC_GLITCH_MAX_US
+ * @brief Durations shorter than this are counted as glitches in strict decoder mode (see filter_dcc_half_bit())
  */
-#define MESSAGE_4_BYTES 0b11111111110000000000000000000000000000000000001
+#define DCC_GLITCH_MAX_US 30
 /**
- * @def MESSAGE_MASK_4_BYTES
- * @brief Bitmask for detecting 4 byte long DCC messages/packets, input_bit_buffer is bitwise ANDed with the mask
+ * @def DCC_ADAPTIVE_ZERO_HALF_BIT_LIMIT_US
+ * @brief "0" half-bits are limited to this duration before averaging, so stretched zeros don't distort the average
  */
-#define MESSAGE_MASK_4_BYTES 0b11111111111000000001000000001000000001000000001
+#define DCC_ADAPTIVE_ZERO_HALF_BIT_LIMIT_US 200
 /**
- * @def MESSAGE_5_BYTES
- * @brief Comparison bitmask for detecting 5 byte long DCC messages/packets
+ * @def DCC_DECODER_MODE_STRICT
+ * @brief CV_176 bit0: validate both half-bits of every bit and filter glitches
  */
-#define MESSAGE_5_BYTES 0b11111111110000000000000000000000000000000000000000000001
+#define DCC_DECODER_MODE_STRICT 0b00000001
 /**
- * @def MESSAGE_MASK_5_BYTES
- * @brief Bitmask for detecting 5 byte long DCC messages/packets, input_bit_buffer is bitwise ANDed with the mask
+ * @def DCC_DECODER_MODE_ADAPTIVE
+ * @brief CV_176 bit1: adapt the "1"/"0" threshold to the timing of the command station
  */
-#define MESSAGE_MASK_5_BYTES 0b11111111111000000001000000001000000001000000001000000001
+#define DCC_DECODER_MODE_ADAPTIVE 0b00000010
 
 /**
- * @def INVALID_PACKAGE
- * @brief Return value of detect_dcc_packet() when the packet is invalid, meaning no packet was detected
+ * @def DCC_PREAMBLE_MIN_BITS
+ * @brief Minimum number of consecutive "1" bits accepted as preamble (NMRA S-9.2)
  */
-#define INVALID_PACKAGE SIZE_MAX
+#define DCC_PREAMBLE_MIN_BITS 10
+/**
+ * @def DCC_PACKET_MIN_BYTES
+ * @brief Minimum length of a DCC packet including the error detection byte
+ */
+#define DCC_PACKET_MIN_BYTES 3
 
 /**
  * @def RING_BUFFER_PACKETS
- * @brief First dimension of dcc ring buffer array - meaning RING_BUFFER_PACKETS can be retained inside the buffer
+ * @brief Capacity of the dcc packet queue - meaning RING_BUFFER_PACKETS can be retained inside the queue, must be a power of two
  */
 #define RING_BUFFER_PACKETS 8
+_Static_assert((RING_BUFFER_PACKETS & (RING_BUFFER_PACKETS - 1)) == 0, "RING_BUFFER_PACKETS must be a power of two");
 /**
  * @def RING_BUFFER_BYTES
- * @brief Secoond dimension of dcc ring buffer array - meaning each packet can have a maximum size of RING_BUFFER_BYTES
+ * @brief Size of the data array of a dcc packet - meaning each packet can have a maximum size of RING_BUFFER_BYTES
+ *
+ * 6 bytes including the error detection byte is the maximum packet length according to NMRA S-9.2.1.
  */
-#define RING_BUFFER_BYTES 5
+#define RING_BUFFER_BYTES 6
 
 /**
  * @def FLASH_CMD_READ_JEDEC_ID
@@ -68,6 +117,45 @@
  */
 #define FLASH_TIMEOUT_IN_MS 500
 
+/**
+ * @def CV_JOURNAL_MAGIC
+ * @brief Marks a valid CV journal sector ("CVJL"), see cv_journal_header_t
+ */
+#define CV_JOURNAL_MAGIC 0x4C4A5643
+/**
+ * @def CV_JOURNAL_SNAPSHOT_OFFSET
+ * @brief Offset of the CV array snapshot within a CV journal sector, the first page contains the header
+ */
+#define CV_JOURNAL_SNAPSHOT_OFFSET FLASH_PAGE_SIZE
+/**
+ * @def CV_JOURNAL_RECORDS_OFFSET
+ * @brief Offset of the first CV journal record within a CV journal sector
+ */
+#define CV_JOURNAL_RECORDS_OFFSET (CV_JOURNAL_SNAPSHOT_OFFSET + CV_ARRAY_SIZE)
+/**
+ * @def CV_JOURNAL_RECORDS
+ * @brief Number of CV writes that can be appended to a CV journal sector before it has to be compacted
+ */
+#define CV_JOURNAL_RECORDS ((FLASH_SECTOR_SIZE - CV_JOURNAL_RECORDS_OFFSET) / sizeof(cv_journal_record_t))
+/**
+ * @def FLASH_JOB_QUEUE_LEN
+ * @brief Maximum number of queued flash jobs (see flash_writer_t), must be a power of two
+ *
+ * Jobs of the same type are combined, so at most the job in progress and one waiting job of each type are queued.
+ */
+#define FLASH_JOB_QUEUE_LEN 4
+_Static_assert((FLASH_JOB_QUEUE_LEN & (FLASH_JOB_QUEUE_LEN - 1)) == 0, "FLASH_JOB_QUEUE_LEN must be a power of two");
+/**
+ * @def CV_TRANSACTION_TIMEOUT_MS
+ * @brief Time without reset or service mode packets after which staged CV writes are committed, see cv_transaction_t
+ */
+#define CV_TRANSACTION_TIMEOUT_MS 200
+/**
+ * @def CV_LEGACY_OFFSET
+ * @brief Offset of the plain CV array written by firmware versions without CV journal (last sector of flash)
+ */
+#define CV_LEGACY_OFFSET (PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE)
+
 /**
  * @def ADC_CALIBRATION_ITERATIONS
  * @brief Iterations for measuring adc offset
@@ -100,6 +188,138 @@ const uint32_t clr_bit_arr[6] = {
 };
 
 
+/**
+ * @def OUTPUT_MAP_NIBBLES
+ * @brief Number of 4-bit groups of functions F0 - F31 in the output map, see output_map_t
+ */
+#define OUTPUT_MAP_NIBBLES 8
+
+/**
+ * @brief Function mapping CVs (CV_257 - CV_512) compiled into lookup tables.
+ *
+ * The 32 function bits are split into nibbles, for every direction, nibble and nibble value the table contains the
+ * OR of the output configurations of all functions set in the nibble. The outputs of any function bitmask are the OR
+ * of OUTPUT_MAP_NIBBLES table entries. Built by build_output_map().
+ *
+ * @typedef output_map_t
+ * @struct output_map_t
+ */
+typedef struct output_map_t {
+        /*! GPIO bitmask of outputs to enable, indexed by direction (see direction_t), nibble and nibble value. */
+        uint32_t outputs[2][OUTPUT_MAP_NIBBLES][16];
+        /*! GPIO bitmask of allowed outputs with PWM enabled (CV_112 - CV_115). */
+        uint32_t pwm_enabled;
+} output_map_t;
+
+/**
+ * @brief Outputs currently set by set_outputs(), used to only update outputs which change.
+ *
+ * @typedef output_state_t
+ * @struct output_state_t
+ */
+typedef struct output_state_t {
+        /*! GPIO bitmask of enabled outputs without PWM. */
+        uint32_t gpio;
+        /*! GPIO bitmask of enabled outputs with PWM. */
+        uint32_t pwm;
+} output_state_t;
+
+/**
+ * @def EFFECT_TICK_MS
+ * @brief Update interval of the lighting effects in ms, see output_effects_timer_callback()
+ */
+#define EFFECT_TICK_MS 10
+/**
+ * @def EFFECT_CV_OFFSET
+ * @brief CV array index of the first effect descriptor (CV_513), 4 CVs per GPIO
+ */
+#define EFFECT_CV_OFFSET 512
+/**
+ * @def EFFECT_STROBE_TICKS
+ * @brief Duration of a single strobe flash in ticks of EFFECT_TICK_MS
+ */
+#define EFFECT_STROBE_TICKS 2
+
+/**
+ * @brief Lighting effects of PWM outputs, configured by the first CV of the effect descriptor of an output.
+ *
+ * @typedef effect_type_t
+ * @enum effect_type_t
+ */
+typedef enum effect_type_t {
+        EFFECT_NONE,            /*!< Output is set directly by set_outputs() */
+        EFFECT_DIM,             /*!< Constant brightness */
+        EFFECT_FADE,            /*!< Fades in and out over the effect period */
+        EFFECT_MARS,            /*!< Mars light, oscillates between 25% and full brightness once per effect period */
+        EFFECT_FLICKER,         /*!< Firebox flicker, new random brightness every effect period */
+        EFFECT_STROBE,          /*!< Single flash every effect period */
+        EFFECT_DOUBLE_STROBE,   /*!< Double flash every effect period */
+        EFFECT_BLINK,           /*!< On for the first half of the effect period */
+        EFFECT_TYPES            /*!< Number of effect types */
+} effect_type_t;
+
+/**
+ * @brief Effect of a single output, decoded from the effect descriptor CVs by build_output_effects().
+ *
+ * @typedef output_effect_t
+ * @struct output_effect_t
+ */
+typedef struct output_effect_t {
+        /*! Effect type, see effect_type_t. */
+        uint8_t type;
+        /*! Effect period in ticks of EFFECT_TICK_MS, at least 1. */
+        uint8_t period;
+        /*! Phase in ticks the effect starts with when the output is switched on. */
+        uint8_t start_phase;
+        /*! Current phase in ticks. */
+        uint8_t phase;
+        /*! Function dimming the output (rule 17 dimming), 0xFF if none. */
+        uint8_t dim_function;
+        /*! Brightness scale 1 - 256 (CV value + 1). */
+        uint16_t scale;
+        /*! Fade step per tick (EFFECT_FADE) or current flicker target (EFFECT_FLICKER). */
+        uint16_t step;
+        /*! Current brightness 0 - 256 of fading effects. */
+        uint16_t brightness;
+        /*! PWM level last written to the output, UINT32_MAX forces writing the next level. */
+        uint32_t level;
+} output_effect_t;
+
+/**
+ * @brief Lighting effects engine, the effects are animated by a repeating timer independent of DCC packets.
+ *
+ * @typedef output_effects_t
+ * @struct output_effects_t
+ */
+typedef struct output_effects_t {
+        /*! Effect of every GPIO. */
+        output_effect_t output[32];
+        /*! GPIO bitmask of PWM outputs with an effect, these are skipped by set_outputs(). */
+        uint32_t active;
+        /*! GPIO bitmask of effect outputs switched on by set_outputs(). */
+        volatile uint32_t on;
+        /*! Active functions F0 - F31 as last passed to set_outputs(), used for rule 17 dimming. */
+        volatile uint32_t functions;
+        /*! Brightness scale 1 - 256 of dimmed outputs (CV_178 + 1). */
+        uint16_t dim_scale;
+        /*! State of the xorshift random number generator used by EFFECT_FLICKER. */
+        uint32_t random;
+        /*! Repeating timer calling output_effects_timer_callback(), running while active is not 0. */
+        struct repeating_timer timer;
+        /*! true while timer is running. */
+        bool timer_running;
+} output_effects_t;
+
+/**
+ * @brief sin² over half a period in 64 steps (0 - 255), used for the Mars light effect
+ */
+const uint8_t effect_wave_table[64] = {
+        0, 1, 2, 5, 10, 15, 21, 29, 37, 47, 57, 67, 79, 90, 103, 115,
+        127, 140, 152, 165, 176, 188, 198, 208, 218, 226, 234, 240, 245, 250, 253, 254,
+        255, 254, 253, 250, 245, 240, 234, 226, 218, 208, 198, 188, 176, 165, 152, 140,
+        128, 115, 103, 90, 79, 67, 57, 47, 37, 29, 21, 15, 10, 5, 2, 1
+};
+
 /**
  * @brief Structure representing a DCC packet.
  * 
@@ -119,35 +339,252 @@ typedef struct dcc_packet_t {
 }dcc_packet_t;
 
 /**
- * @brief Structure representing a ring buffer for DCC packets.
- * 
- * This structure is used to manage a ring buffer that stores DCC packets.
- * It contains an array of packets and indices for writing and reading.
- * 
- * @typedef dcc_ring_buffer_t
- * @struct dcc_ring_buffer_t
+ * @brief States of the DCC packet framer.
+ *
+ * @typedef dcc_framer_state_t
+ */
+typedef enum dcc_framer_state_t {
+        DCC_FRAMER_PREAMBLE,    /**< Counting preamble bits, waiting for the packet start bit */
+        DCC_FRAMER_DATA_BYTE,   /**< Shifting in the 8 bits of a data byte */
+        DCC_FRAMER_SEPARATOR,   /**< Waiting for a data byte start bit ("0") or the packet end bit ("1") */
+} dcc_framer_state_t;
+
+/**
+ * @brief Structure containing the state of the DCC packet framer.
+ *
+ * Bytes are stored in transmission order, the XOR checksum is updated with every completed byte.
+ *
+ * @typedef dcc_framer_t
+ * @struct dcc_framer_t
+ */
+typedef struct dcc_framer_t {
+        /*! Current state. */
+        dcc_framer_state_t state;
+        /*! Number of consecutive "1" bits received in DCC_FRAMER_PREAMBLE state (saturating). */
+        uint8_t preamble_bits;
+        /*! Number of bits of the current data byte received so far. */
+        uint8_t bit_count;
+        /*! Data byte currently being shifted in. */
+        uint8_t byte;
+        /*! XOR of all completed bytes of the current packet. */
+        uint8_t checksum;
+        /*! Number of completed bytes of the current packet. */
+        size_t length;
+        /*! Completed bytes of the current packet in transmission order. */
+        uint8_t data[RING_BUFFER_BYTES];
+        /*! Number of packets discarded due to checksum errors or insufficient length (free running). */
+        uint32_t rejected;
+        /*! Number of packets discarded by the address fast path (free running), see accept_dcc_address_bytes(). */
+        uint32_t filtered;
+} dcc_framer_t;
+
+/**
+ * @brief Active address of the decoder, precomputed from CV_1, CV_17, CV_18 and CV_29.
+ *
+ * Kept in RAM, so the address of every packet on the track can be checked without reading the CVs from flash.
+ * Has to be updated by update_dcc_address() whenever one of these CVs changes.
+ *
+ * @typedef dcc_address_t
+ * @struct dcc_address_t
  */
-typedef struct dcc_ring_buffer_t {
-        /*! Array of DCC packets stored in the ring buffer. */
-        dcc_packet_t packets[RING_BUFFER_PACKETS];
-        /*! Index for the next write operation in the ring buffer. */
-        size_t wr_idx;
-        /*! Index for the next read operation in the ring buffer. */
-        size_t rd_idx;
-} dcc_ring_buffer_t;
+typedef struct dcc_address_t {
+        /*! Decoder uses the long address (CV_29 bit5). */
+        bool long_address;
+        /*! Expected first address byte: short address (CV_1) or high byte of the long address including the 0b11 prefix (CV_17). */
+        uint8_t first_byte;
+        /*! Expected second address byte: low byte of the long address (CV_18), only used for long addresses. */
+        uint8_t second_byte;
+} dcc_address_t;
 
+/**
+ * @brief Header in the first page of a CV journal sector.
+ *
+ * The header is programmed last when a sector is compacted, so only completely written sectors are valid.
+ * The valid sector with the highest sequence number is the active one.
+ *
+ * @typedef cv_journal_header_t
+ * @struct cv_journal_header_t
+ */
+typedef struct cv_journal_header_t {
+        /*! CV_JOURNAL_MAGIC for valid sectors. */
+        uint32_t magic;
+        /*! Incremented with every compaction. */
+        uint32_t sequence;
+        /*! Inverted sequence number, protects against partially programmed headers. */
+        uint32_t sequence_inv;
+} cv_journal_header_t;
 
+/**
+ * @brief CV write appended to a CV journal sector.
+ *
+ * Erased records (all bits set) mark the end of the journal, records with a wrong check byte are ignored.
+ *
+ * @typedef cv_journal_record_t
+ * @struct cv_journal_record_t
+ */
+typedef struct cv_journal_record_t {
+        /*! CV index, CV_1 has index 0. */
+        uint16_t cv_index;
+        /*! Value written to the CV. */
+        uint8_t cv_data;
+        /*! Check byte, see get_cv_journal_record_check(). */
+        uint8_t check;
+} cv_journal_record_t;
 
 /**
- * @brief Increment the index of a ring buffer.
+ * @brief State of the CV journal.
  *
- * This function increments the provided index of a ring buffer, wrapping around
- * to zero if the end of the buffer is reached.
+ * The CVs are stored in CV_STORE_SECTORS flash sectors starting at FLASH_TARGET_OFFSET. Every sector contains a header,
+ * a snapshot of the complete CV array and CV_JOURNAL_RECORDS records. CV writes are appended as records to the active
+ * sector. When the active sector is full, the CV array is compacted into the next sector, so erasing is spread across
+ * all sectors.
  *
- * @param idx Pointer to the index to be incremented.
- * @param ring_buffer_length The length of the ring buffer.
+ * @typedef cv_journal_t
+ * @struct cv_journal_t
  */
-static void increment_ring_buffer_idx(size_t * idx, uint8_t ring_buffer_length);
+typedef struct cv_journal_t {
+        /*! An active sector exists. */
+        bool valid;
+        /*! Active sector, 0 to CV_STORE_SECTORS - 1. */
+        uint8_t sector;
+        /*! Sequence number of the active sector. */
+        uint32_t sequence;
+        /*! Index of the next free record within the active sector. */
+        uint16_t next_record;
+        /*! Number of records found with a wrong check byte while loading. */
+        uint16_t invalid_records;
+} cv_journal_t;
+
+/**
+ * @brief CV writes staged in RAM until they are persisted in the CV journal.
+ *
+ * Staged CVs are already updated in CV_ARRAY_RAM. Outside of transaction mode a commit is submitted right away,
+ * in transaction mode (CV_177 bit0) it is deferred until the programming session ends (see check_cv_transaction()) or
+ * CV_177 is written. A commit persists all CVs staged until it is executed, so a burst of CV writes results in a
+ * single flash job.
+ *
+ * @typedef cv_transaction_t
+ * @struct cv_transaction_t
+ */
+typedef struct cv_transaction_t {
+        /*! Bitmask of CVs written since the last commit, bit n of word n / 32 corresponds to CV index n. */
+        uint32_t dirty[CV_ARRAY_SIZE / 32];
+        /*! Number of CVs set in dirty. */
+        uint16_t pending;
+        /*! Time of the last reset or service mode packet. */
+        absolute_time_t last_packet;
+} cv_transaction_t;
+
+/**
+ * @brief Types of flash jobs executed by the flash writer.
+ *
+ * @typedef flash_job_type_t
+ */
+typedef enum flash_job_type_t {
+        FLASH_JOB_COMMIT_TRANSACTION,   /**< Append all CV writes staged in cv_transaction_t to the CV journal */
+        FLASH_JOB_COMPACT_CV_JOURNAL,   /**< Write CV_ARRAY_RAM as snapshot into the next journal sector */
+} flash_job_type_t;
+
+/**
+ * @brief Flash job queued by submit_flash_job().
+ *
+ * @typedef flash_job_t
+ * @struct flash_job_t
+ */
+typedef struct flash_job_t {
+        /*! Type of the job. */
+        flash_job_type_t type;
+} flash_job_t;
+
+/**
+ * @brief Steps of the flash writer, compacting the CV journal is split into three steps.
+ *
+ * @typedef flash_writer_step_t
+ */
+typedef enum flash_writer_step_t {
+        FLASH_WRITER_IDLE,      /**< No job started, the next job is taken from the queue */
+        FLASH_WRITER_ERASE,     /**< Erase the next journal sector */
+        FLASH_WRITER_SNAPSHOT,  /**< Program the snapshot of CV_ARRAY_RAM */
+        FLASH_WRITER_HEADER,    /**< Program the header, the sector becomes the active sector */
+} flash_writer_step_t;
+
+/**
+ * @brief State and statistics of the flash writer.
+ *
+ * Flash jobs are queued and executed one flash operation at a time by the main loop, only while no DCC packet is
+ * being received (see is_dcc_idle_gap()). Jobs are numbered in order of submission starting with 1, a job is done when
+ * completed is greater than or equal to its number. All counters are free running.
+ *
+ * @typedef flash_writer_t
+ * @struct flash_writer_t
+ */
+typedef struct flash_writer_t {
+        /*! Current step of the job at the head of the queue. */
+        flash_writer_step_t step;
+        /*! Number of submitted jobs. */
+        uint32_t submitted;
+        /*! Number of completed jobs, successful or not. */
+        uint32_t completed;
+        /*! Number of jobs which failed due to flash errors, the error flags are set accordingly. */
+        uint32_t failed;
+        /*! Number of the last failed job. */
+        uint32_t last_failed;
+        /*! Number of the queued FLASH_JOB_COMMIT_TRANSACTION job which isn't started yet, 0 when none. */
+        uint32_t waiting_commit;
+        /*! Number of the queued FLASH_JOB_COMPACT_CV_JOURNAL job which isn't started yet, 0 when none. */
+        uint32_t waiting_compaction;
+} flash_writer_t;
+
+/**
+ * @brief Structure containing the consumer state and statistics of the DCC half-bit ring buffer.
+ *
+ * The DMA channel writes into the ring buffer continuously, the amount of half-bits written is derived from the
+ * remaining transfer count of the channel. All counters are free running and overflow.
+ *
+ * @typedef dcc_half_bit_stats_t
+ * @struct dcc_half_bit_stats_t
+ */
+typedef struct dcc_half_bit_stats_t {
+        /*! Half-bits written by DMA before the last restart of the DMA channel. */
+        uint32_t produced_base;
+        /*! Half-bits decoded so far. */
+        uint32_t consumed;
+        /*! Highest number of half-bits waiting to be decoded (high-water mark). */
+        uint32_t backlog_max;
+        /*! Number of times undecoded half-bits were overwritten by DMA. */
+        uint32_t overruns;
+        /*! Number of durations shorter than DCC_GLITCH_MAX_US merged into the half-bit in progress (strict decoder mode). */
+        uint32_t glitches;
+        /*! Number of bits with invalid or mismatching half-bits (strict decoder mode). */
+        uint32_t invalid_bits;
+} dcc_half_bit_stats_t;
+
+/**
+ * @brief Structure containing the configuration and state of the half-bit decoder.
+ *
+ * The configuration is read from CV_176 during initialization (see init_dcc_rx()).
+ *
+ * @typedef dcc_half_bit_decoder_t
+ * @struct dcc_half_bit_decoder_t
+ */
+typedef struct dcc_half_bit_decoder_t {
+        /*! Decoder mode bits (see DCC_DECODER_MODE_STRICT and DCC_DECODER_MODE_ADAPTIVE). */
+        uint8_t mode;
+        /*! Half-bits longer than the threshold are decoded as "0", otherwise as "1". */
+        uint32_t threshold_us;
+        /*! Average duration of "1" half-bits, 28.4 fixed point (adaptive mode). */
+        uint32_t one_avg;
+        /*! Average duration of "0" half-bits, 28.4 fixed point (adaptive mode). */
+        uint32_t zero_avg;
+        /*! Duration of the half-bit in progress, shorter than DCC_ONE_HALF_BIT_MIN_US, 0 when none (strict mode). */
+        uint32_t held_us;
+        /*! The next half-bit is the second half of a bit (strict mode). */
+        bool second_half;
+        /*! Classification of the first half of the current bit, 1, 0 or -1 for invalid (strict mode). */
+        int8_t first_half;
+        /*! Duration of the first half of the current bit (strict mode). */
+        uint32_t first_half_us;
+} dcc_half_bit_decoder_t;
 
 /*!
  * \brief Function for erasing a sector of flash memory.
@@ -172,6 +609,127 @@ static void call_flash_range_erase(void *param);
  */
 static void call_flash_range_program(void *param);
 
+/*!
+ * \brief Returns a pointer to a CV journal sector in flash (XIP).
+ *
+ * \param sector Sector index, 0 to CV_STORE_SECTORS - 1.
+ */
+static const uint8_t *get_cv_journal_sector(uint8_t sector);
+
+/*!
+ * \brief Computes the check byte of a CV journal record.
+ *
+ * An erased record never has a valid check byte.
+ */
+static uint8_t get_cv_journal_record_check(uint16_t cv_index, uint8_t cv_data);
+
+/*!
+ * \brief Loads the CVs from the CV journal into CV_ARRAY_RAM.
+ *
+ * Finds the active sector, loads its snapshot and replays all records. When no valid sector is found (factory state
+ * or firmware without journal) the plain CV array at CV_LEGACY_OFFSET is loaded instead, see cv_setup_check().
+ */
+static void load_cv_journal();
+
+/*!
+ * \brief Runs the next step of compacting the CV journal into the next sector, see flash_writer_step_t.
+ *
+ * The next sector is erased, the snapshot of CV_ARRAY_RAM is programmed and the header is programmed last, which makes
+ * the sector the active sector. The previously active sector stays intact until then.
+ *
+ * \return true on success, false on flash errors (error flags are set accordingly).
+ */
+static bool run_cv_journal_compaction_step();
+
+/*!
+ * \brief Programs a page of the active journal sector, 0xFF bytes leave the flash contents unchanged.
+ *
+ * \param page_offset Offset of the page in flash, aligned to FLASH_PAGE_SIZE.
+ * \param page FLASH_PAGE_SIZE bytes to program.
+ * \return true on success, false on flash errors (error flags are set accordingly).
+ */
+static bool program_cv_journal_page(uint32_t page_offset, const uint8_t *page);
+
+/*!
+ * \brief Appends the records of all CVs staged in cv_transaction_t to the active journal sector.
+ *
+ * The records are packed, so every touched page is programmed once. The records have to fit into the active sector.
+ *
+ * \return true on success, false on flash errors (error flags are set accordingly).
+ */
+static bool append_cv_transaction();
+
+/*!
+ * \brief Marks a CV as written but not yet persisted, see cv_transaction_t.
+ *
+ * \param cv_index CV index, CV_1 has index 0.
+ */
+static void stage_cv_write(uint16_t cv_index);
+
+/*!
+ * \brief Submits a flash job persisting all staged CV writes, unless such a job is already waiting.
+ *
+ * When the staged records don't fit into the active sector, the journal is compacted instead.
+ */
+static void commit_cv_transaction();
+
+/*!
+ * \brief Commits staged CV writes after CV_TRANSACTION_TIMEOUT_MS without reset or service mode packets.
+ *
+ * Called by the main loop when there are no packets to evaluate.
+ */
+static void check_cv_transaction();
+
+/*!
+ * \brief Persists the CVs computed by the autotune on core1 in one transaction commit, see autotune_result_t.
+ *
+ * Called by the main loop when there are no packets to evaluate. Does nothing unless a result is ready.
+ */
+static void apply_autotune_result();
+
+/*!
+ * \brief Queues a flash job for the flash writer, see flash_writer_t.
+ *
+ * A job of the same type which isn't started yet does the same work, in that case no new job is queued. This keeps
+ * the queue from filling up, submitting never blocks.
+ *
+ * \param type Type of the job.
+ * \return Number of the job doing the work, see flash_writer_t.
+ */
+static uint32_t submit_flash_job(flash_job_type_t type);
+
+/*!
+ * \brief Removes the job at the head of the queue and updates the statistics.
+ *
+ * \param success false when the job failed due to a flash error.
+ */
+static void complete_flash_job(bool success);
+
+/*!
+ * \brief Executes a single flash operation of the job at the head of the queue.
+ *
+ * Appending records takes a single operation, compacting the CV journal takes three (see flash_writer_step_t).
+ *
+ * \return true if a flash operation was executed, false if the queue is empty.
+ */
+static bool run_flash_writer();
+
+/*!
+ * \brief Completes all queued flash jobs.
+ */
+static void flush_flash_writer();
+
+/*!
+ * \brief Checks for an idle gap of the DCC signal in which flash jobs can be executed.
+ *
+ * No packet is being received, all received half-bits are decoded and all packets are evaluated. The DMA keeps
+ * recording the DCC signal into the half-bit ring buffer while the flash is busy, so nothing is lost as long as a flash
+ * operation takes less time than the ring buffer can hold.
+ *
+ * \return true during an idle gap.
+ */
+static bool is_dcc_idle_gap();
+
 /*!
  * \brief Function for executing a flash command via QSPI
  *
@@ -272,11 +830,49 @@ static void reset_cv_array_to_default();
  */
 static void program_mode(size_t number_of_bytes, const uint8_t *const byte_array);
 
+/*!
+ * \brief Compiles the function mapping in CV257 to CV512 and the PWM configuration in CV112 to CV115 into output_map.
+ *
+ * Called at initialization and whenever one of these CVs is written.
+ */
+static void build_output_map();
+
+/*!
+ * \brief Decodes the effect descriptors in CV513 to CV640 and CV178 into output_effects.
+ *
+ * Every GPIO has 4 CVs starting at CV513 + 4 * GPIO: effect type (see effect_type_t), brightness, effect period
+ * in ticks of EFFECT_TICK_MS and flags (bit0-4: dimming function, bit5: start at half period, bit7: enable dimming).
+ * Effects are only applied to outputs with PWM enabled. The effects timer is stopped while decoding and only
+ * restarted when at least one output has an effect. Called by build_output_map().
+ */
+static void build_output_effects();
+
+/*!
+ * \brief Returns the brightness (0 - 256) of an effect output for the current tick and advances the effect.
+ *
+ * \param effect Effect of the output
+ * \param on true when the output is switched on by its function mapping
+ * \return Brightness 0 - 256 before applying the brightness scale of the output
+ */
+static uint16_t get_effect_brightness(output_effect_t *effect, bool on);
+
+/*!
+ * \brief Repeating timer callback animating all effect outputs every EFFECT_TICK_MS.
+ *
+ * Calculates the PWM level of every output in output_effects.active and writes it when it changed.
+ * Runs in the timer interrupt of core0, DCC reception isn't affected as the half-bits are buffered by DMA.
+ *
+ * \return true to keep the timer running
+ */
+static bool output_effects_timer_callback(struct repeating_timer *t);
+
 /*!
  * \brief Set outputs according to function mapping in CV257 to CV512
  *
- * This function maps the functions and direction to the mapped outputs configured in CV257 to CV512.
- * Also enables PWM when enabled according to CV112 to CV115.
+ * This function maps the functions and direction to the mapped outputs configured in CV257 to CV512 using the
+ * lookup tables in output_map. Also enables PWM when enabled according to CV112 to CV115.
+ * Only outputs which change compared to output_state are updated. PWM outputs with an effect are only switched
+ * on or off in output_effects, their level is set by output_effects_timer_callback().
  *
  * \param functions_to_set_bitmask Function bitmask F0 is bit0, F1 is bit1, ...
  */
@@ -295,24 +891,32 @@ static void set_outputs(uint32_t functions_to_set_bitmask);
 static void update_active_functions(uint32_t new_function_bitmask, uint8_t clr_bit_ind, bool direction_change);
 
 /**
- * @brief Detect errors in the byte array using exor of all bytes.
- * 
- * Exor of all bytes is expected to be "0b00000000".
+ * @brief Check if the address is a long address.
  *
  * @param number_of_bytes Number of bytes in the array.
  * @param byte_array Pointer to the byte array.
- * @return true if no error is detected, false otherwise.
+ * @return true if it is a long address, false otherwise.
  */
-static bool error_detection(size_t number_of_bytes, const uint8_t *byte_array);
+static bool is_long_address(size_t number_of_bytes, const uint8_t byte_array[]);
 
 /**
- * @brief Check if the address is a long address.
+ * @brief Precomputes the active address of the decoder (see dcc_address_t) from the CVs stored in flash.
+ */
+static void update_dcc_address();
+
+/**
+ * @brief Address fast path of the framer, checks the address bytes of a packet while it is being received.
  *
- * @param number_of_bytes Number of bytes in the array.
- * @param byte_array Pointer to the byte array.
- * @return true if it is a long address, false otherwise.
+ * Called after the first and the second byte of a packet are complete. Packets which can't be relevant for this
+ * decoder are discarded before the rest of the packet is received, so they never reach the packet queue.
+ * Accepted are packets with matching address, broadcast packets (address 0, e.g. reset packets) and service mode
+ * packets ("address" 112-127), see evaluate_packet().
+ *
+ * @param data Bytes received so far in transmission order.
+ * @param length Number of bytes received so far (1 or 2).
+ * @return false if the packet can be discarded, true otherwise.
  */
-static bool is_long_address(size_t number_of_bytes, const uint8_t byte_array[]);
+static bool accept_dcc_address_bytes(const uint8_t *data, size_t length);
 
 /**
  * @brief Evaluate the address of the message.
@@ -339,59 +943,109 @@ static void instruction_evaluation(size_t  number_of_bytes, const uint8_t byte_a
 static bool reset_message_check(size_t number_of_bytes, const uint8_t *const byte_array);
 
 /**
- * @brief Verify DCC message
+ * @brief Copies the packet assembled by the framer into the packet queue.
  *
- * Procedure:
- * 1. Check for valid preamble using bitmasks
- * 2. Return number of bytes if valid bit-pattern is found. Otherwise -1 is returned.
- *
- * \return Number of bytes if valid bit-pattern is found. Otherwise return -1.
- */
-static size_t detect_dcc_packet();
-
-/**
- * @brief Convert sequence of bits to byte array
- *
- * For each byte in the byte array, shift the input bit buffer by 9 bits and save the result in the byte array.
  * Bytes are ordered as follows:
  * Start of transmission -> byte_n(address byte) -> ... -> byte_0(error detection byte) -> end of transmission
- * 
- * \param packet Pointer to dcc packet struct which contains data and length of packet.
+ * When the queue is full the packet is dropped and counted in dcc_packet_queue.overflows.
  */
-static void bits_to_dcc_packet_data(dcc_packet_t * packet);
+static void push_dcc_packet();
 
 /**
  * @brief Main message evaluation function
  *
  * Procedure:
- * 1. Check if input buffer contains a valid DCC message
- * 2. Split data into array of bytes
- * 3. Check for errors
- * 4. Check for matching address
- * 5. Check for reset message and set flag when reset message is received
+ * 1. Check for matching address
+ * 2. Enter program mode when previous packet was a reset message
+ * 3. Check for reset message and set flag when reset message is received
+ *
+ * \param packet Pointer to a packet already verified by the framer.
+ */
+static void evaluate_packet(const dcc_packet_t * packet);
+
+/*!
+ * \brief Processes a single decoded DCC bit
+ *
+ * Advances the packet framer state machine by one bit, doing constant work per bit:
+ * preamble (>= DCC_PREAMBLE_MIN_BITS "1" bits) -> packet start bit -> data byte -> separator bit -> ... -> packet end bit.
+ * The XOR checksum is computed incrementally, on the packet end bit packets with a valid checksum and at least
+ * DCC_PACKET_MIN_BYTES bytes are pushed into the packet queue (see push_dcc_packet()).
+ * Packets addressed to other decoders are discarded after their address bytes (see accept_dcc_address_bytes()).
+ * Packets longer than RING_BUFFER_BYTES are discarded.
  *
+ * \param bit Decoded bit value
  */
-static void evaluate_packet();
+static void process_dcc_bit(bool bit);
 
 /*!
- * \brief Track signal rising edge interrupt callback function
+ * \brief Updates the adaptive "1"/"0" threshold with a measured half-bit
  *
- * Saves timer counter value using get_absolute_time(), then disables rising edge IRQ and enables falling edge IRQ.
+ * The average durations of "1" and "0" half-bits are tracked as exponentially weighted moving averages, the
+ * threshold is set in the middle of both, but always between DCC_ONE_HALF_BIT_MAX_US and DCC_ZERO_HALF_BIT_MIN_US,
+ * so timing according to NMRA S-9.1 is always decoded correctly.
  *
+ * \param duration_us Half-bit duration in us
+ * \param bit Decoded bit value of the half-bit
  */
-static void track_signal_rise();
+static void adapt_dcc_threshold(uint32_t duration_us, bool bit);
 
 /*!
- * \brief Track signal falling edge interrupt callback function
+ * \brief Classifies a half-bit duration
  *
- * Saves timer counter value using get_absolute_time(), then calculates time difference between rising and falling edge.
- * When the time difference is greater than 87us, this bit is interpreted as a logical 0. Otherwise, it is interpreted as a logical 1.
- * Refers to NMRA S-9.1 and RCN-210 standards
- * Puts the latest bit value into 64 bit unsigned integer "buffer", then checks if the buffer contains a valid DCC packet.
- * When a valid packet is found, it is written into the ring buffer, and the write index gets incremented.
+ * In strict mode durations outside of the NMRA S-9.1 windows are invalid. Without adaptive mode durations between
+ * the "1" and the "0" window are invalid as well.
  *
+ * \param duration_us Half-bit duration in us
+ * \return 1 or 0 for the decoded bit value, -1 for an invalid half-bit
  */
-static void track_signal_fall();
+static int8_t classify_dcc_half_bit(uint32_t duration_us);
+
+/*!
+ * \brief Decodes a complete half-bit in strict mode
+ *
+ * Both half-bits of a bit have to be valid and of the same type, otherwise the bit is invalid and the packet currently
+ * received by the framer is discarded. On an invalid bit the second half-bit is used as the first half of the next bit,
+ * which re-synchronizes the decoder when it was paired with the wrong half-bit.
+ *
+ * \param duration_us Half-bit duration in us
+ */
+static void process_dcc_half_bit_strict(uint32_t duration_us);
+
+/*!
+ * \brief Merges the pieces of half-bits split by glitches in strict mode
+ *
+ * A glitch splits a half-bit into three durations. Durations are added to the half-bit in progress until it reaches
+ * DCC_ONE_HALF_BIT_MIN_US, then it is complete and passed on. A complete half-bit is never extended, so the pieces
+ * of a glitched half-bit can't spoil the half-bits around it.
+ *
+ * \param duration_us Measured duration in us
+ */
+static void filter_dcc_half_bit(uint32_t duration_us);
+
+/*!
+ * \brief Returns the total number of half-bit durations written into the ring buffer by DMA
+ *
+ * Restarts the DMA channel when its transfer count is exhausted.
+ *
+ * \return Free running count of half-bits written
+ */
+static uint32_t get_dcc_half_bits_produced();
+
+/*!
+ * \brief Decodes all half-bit durations written into the ring buffer since the last call
+ *
+ * The dcc_rx PIO program measures the duration of every half-bit, these durations are written into the ring buffer
+ * dcc_half_bit_buf by DMA. High half-bits are stored at even indices and low half-bits at odd indices.
+ * By default only the high half-bit is used: when it is longer than DCC_HIGH_HALF_BIT_THRESHOLD_US (87us) the bit is
+ * interpreted as a logical 0, otherwise as a logical 1. Refers to NMRA S-9.1 and RCN-210 standards.
+ * In strict mode (CV_176 bit0) both half-bits are validated, see filter_dcc_half_bit() and process_dcc_half_bit_strict().
+ * In adaptive mode (CV_176 bit1) the threshold follows the timing of the command station, see adapt_dcc_threshold().
+ *
+ * Called from the core0 main loop, every call decodes the backlog until the packet queue is full, so packets received
+ * during a stall (e.g. a flash erase) stay in the ring buffer instead of overflowing the queue. The backlog high-water
+ * mark and ring buffer overruns are recorded in dcc_half_bit_stats.
+ */
+static void decode_dcc_half_bits();
 
 /*!
  * \brief Output initialization function
@@ -423,4 +1077,10 @@ static void init_motor_pwm(uint8_t gpio);
  *
  * Function initializes ADC, corresponding GPIO pins specified in CMakeLists.txt, also configures ADC FIFO.
  */
-static void init_adc();
\ No newline at end of file
+static void init_adc();
+
+/*!
+ * \brief Loads the DCC half-bit timer program into DCC_PIO, starts a state machine on DCC_INPUT_PIN and a DMA channel
+ * transferring the measured durations into the ring buffer.
+ */
+static void init_dcc_rx();
\ No newline at end of file
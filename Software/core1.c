@@ -6,52 +6,136 @@
 
 #include "core1.h"
 
-struct repeating_timer pid_control_timer, speed_helper_timer;
-bool controller_flag, speed_helper_flag = false;
+// DMA channels and sample buffer for back-EMF measurements
+bemf_adc_t bemf_adc;
+
+// Motor PWM level last set by adjust_pwm_level(), restored by measure() after sampling
+uint16_t motor_pwm_level = 0;
+
+
+// Claims and configures the DMA channels used by measure()
+void init_bemf_adc() {
+    // Samples: 16-bit transfers from the ADC FIFO into the sample buffer, paced by the ADC
+    bemf_adc.sample_dma_chan = dma_claim_unused_channel(true);
+    bemf_adc.sample_config = dma_channel_get_default_config(bemf_adc.sample_dma_chan);
+    channel_config_set_transfer_data_size(&bemf_adc.sample_config, DMA_SIZE_16);
+    channel_config_set_read_increment(&bemf_adc.sample_config, false);
+    channel_config_set_write_increment(&bemf_adc.sample_config, true);
+    channel_config_set_dreq(&bemf_adc.sample_config, DREQ_ADC);
+    // Trigger: a single write of the ADC control register, paced by the wrap of the motor PWM slice
+    bemf_adc.trigger_dma_chan = dma_claim_unused_channel(true);
+    bemf_adc.trigger_config = dma_channel_get_default_config(bemf_adc.trigger_dma_chan);
+    channel_config_set_transfer_data_size(&bemf_adc.trigger_config, DMA_SIZE_32);
+    channel_config_set_read_increment(&bemf_adc.trigger_config, false);
+    channel_config_set_write_increment(&bemf_adc.trigger_config, false);
+    channel_config_set_dreq(&bemf_adc.trigger_config, pwm_get_dreq(pwm_gpio_to_slice_num(MOTOR_FWD_PIN)));
+    LOG(1, "Back-EMF sampling on DMA channels %u (samples) and %u (trigger)\n", bemf_adc.sample_dma_chan, bemf_adc.trigger_dma_chan);
+}
 
 
 // Measures Back-EMF voltage (proportional to the rotational speed of the motor) on GPIO 28 and GPIO 29 respectively (depending on direction)
-float measure(uint8_t total_iterations,
+q16_t measure(uint8_t total_iterations,
               uint8_t measurement_delay_us,
               uint8_t l_side_arr_cutoff,
               uint8_t r_side_arr_cutoff,
               direction_t direction){
-    uint32_t sum = 0;
-    uint16_t adc_val[total_iterations];
-    int32_t j = 0;
-    uint16_t key;
+    PROFILE_START(PROFILE_MEASURE);
+    uint32_t input = FWD_V_EMF_ADC_CHANNEL;
+    if (direction == DIRECTION_REVERSE) {
+        input = REV_V_EMF_ADC_CHANNEL;
+    } else if (direction != DIRECTION_FORWARD) {
+        set_error(INVALID_DIRECTION);
+    }
+    // Samples taken during the measurement delay are discarded instead of waiting in software
+    const uint32_t skipped = (measurement_delay_us + BEMF_ADC_SAMPLE_TIME_US - 1) / BEMF_ADC_SAMPLE_TIME_US;
+    uint16_t *const adc_val = &bemf_adc.buf[skipped];
+
+    // Switch off the motor, the new level takes effect at the next wrap of the PWM slice
+    const uint16_t level = motor_pwm_level;
     pwm_set_gpio_level(MOTOR_FWD_PIN, 0);
     pwm_set_gpio_level(MOTOR_REV_PIN, 0);
-    if (direction == DIRECTION_FORWARD) {
-        adc_select_input(FWD_V_EMF_ADC_CHANNEL);
-    } else if(direction == DIRECTION_REVERSE) {
-        adc_select_input(REV_V_EMF_ADC_CHANNEL);
-    } else{
-        set_error(INVALID_DIRECTION);
+    // Arm the sample channel, then let the trigger channel start the ADC at the PWM wrap
+    adc_fifo_drain();
+    bemf_adc.trigger_cs = ADC_CS_EN_BITS | ADC_CS_START_MANY_BITS | (input << ADC_CS_AINSEL_LSB);
+    dma_channel_configure(bemf_adc.sample_dma_chan, &bemf_adc.sample_config, bemf_adc.buf, &adc_hw->fifo, skipped + total_iterations, true);
+    dma_channel_configure(bemf_adc.trigger_dma_chan, &bemf_adc.trigger_config, &adc_hw->cs, &bemf_adc.trigger_cs, 1, true);
+    dma_channel_wait_for_finish_blocking(bemf_adc.sample_dma_chan);
+    adc_run(false);
+    // Power the motor again right away, the samples are processed while it is running
+    adjust_pwm_level(level);
+    adc_fifo_drain();
+
+    const q16_t mean = get_trimmed_mean(adc_val, total_iterations, l_side_arr_cutoff, r_side_arr_cutoff);
+    PROFILE_END(PROFILE_MEASURE);
+    return mean;
+}
+
+// Partially sorts values[lo..hi] so that values[k] is the element which would be at index k when fully sorted
+void select_nth_sample(uint16_t *const values, int32_t lo, int32_t hi, int32_t const k) {
+    while (hi - lo >= SELECT_INSERTION_SORT_LEN) {
+        // Median of three as pivot, then Hoare partition
+        const int32_t mid = lo + (hi - lo) / 2;
+        uint16_t a = values[lo], b = values[mid], c = values[hi];
+        const uint16_t pivot = (a < b) ? ((b < c) ? b : ((a < c) ? c : a)) : ((a < c) ? a : ((b < c) ? c : b));
+        int32_t i = lo;
+        int32_t j = hi;
+        while (i <= j) {
+            while (values[i] < pivot) i++;
+            while (values[j] > pivot) j--;
+            if (i <= j) {
+                const uint16_t tmp = values[i];
+                values[i] = values[j];
+                values[j] = tmp;
+                i++;
+                j--;
+            }
+        }
+        // values[lo..j] <= pivot <= values[i..hi], elements between j and i equal the pivot
+        if (k <= j) {
+            hi = j;
+        }
+        else if (k >= i) {
+            lo = i;
+        }
+        else {
+            return;
+        }
     }
-    busy_wait_us(measurement_delay_us);
-    adc_run(true);
-    for (int32_t i = 0; i < total_iterations; ++i) {
-        //Take adc value out of fifo when available, then do one step of insertion sort.
-        adc_val[i] = adc_fifo_get_blocking();
-        key = adc_val[i];
-        j = i - 1;
-        while (j >= 0 && adc_val[j] > key) {
-            adc_val[j + 1] = adc_val[j];
+    // Sorting the remaining short range is faster than partitioning it further
+    for (int32_t i = lo + 1; i <= hi; ++i) {
+        const uint16_t key = values[i];
+        int32_t j = i - 1;
+        while (j >= lo && values[j] > key) {
+            values[j + 1] = values[j];
             j--;
         }
-        adc_val[j + 1] = key;
+        values[j + 1] = key;
     }
-    adc_run(false);
-    //adc_fifo_drain();
-    //discard x entries beginning from the lowest entry of the array (counting up); x = msr.l_side_arr_cutoff
-    //discard y entries beginning from the highest index of the array (counting down); y = msr.r_side_arr_cutoff
-    for (int32_t i = l_side_arr_cutoff; i < total_iterations - r_side_arr_cutoff ; ++i) {
-        sum += adc_val[i];
+}
+
+// Average of the samples without the lowest l_side_arr_cutoff and highest r_side_arr_cutoff samples
+q16_t get_trimmed_mean(uint16_t *const values, uint8_t const total_iterations, uint8_t const l_side_arr_cutoff, uint8_t const r_side_arr_cutoff) {
+    const int32_t first = l_side_arr_cutoff;
+    const int32_t last = (int32_t) total_iterations - r_side_arr_cutoff - 1;
+    if (last < first) {
+        // Every sample is discarded
+        return 0;
+    }
+    // Move the discarded lowest values to the left and the discarded highest values to the right, in any order
+    if (first > 0) {
+        select_nth_sample(values, 0, total_iterations - 1, first);
+    }
+    if (last < total_iterations - 1) {
+        select_nth_sample(values, first, total_iterations - 1, last);
+    }
+    uint32_t sum = 0;
+    for (int32_t i = first; i <= last; ++i) {
+        sum += values[i];
     }
-    float res = (float)sum / (float)( total_iterations - (l_side_arr_cutoff + r_side_arr_cutoff) );
-    // return true to keep the repeating timer active
-    return res;
+    // Integer and fractional part are divided separately, so only 32-bit divisions are needed
+    const uint32_t count = last - first + 1;
+    const uint32_t remainder = sum % count;
+    return (q16_t) (((sum / count) << 16) | ((remainder << 16) / count));
 }
 
 // Get speed_step_table_index depending on speed_step
@@ -72,8 +156,8 @@ uint8_t get_speed_step_table_index_of_speed_step(uint8_t speed_step) {
 void speed_helper(controller_parameter_t * ctrl_par) {
     // ctrl_par->setpoint only gets adjusted when the speed_helper_counter is equal to the accel_rate/decel_rate
     // -> Time for 1 Speed Step := (speed_helper timer delay)*(accel_rate) or CV_175*CV_3 or CV_175*CV_4
-    const uint8_t accel_rate = CV_ARRAY_FLASH[2];
-    const uint8_t decel_rate = CV_ARRAY_FLASH[3];
+    const uint8_t accel_rate = cv_fields.accel_rate;
+    const uint8_t decel_rate = cv_fields.decel_rate;
     static uint8_t speed_helper_counter;
     static uint8_t speed_table_index;
 
@@ -120,6 +204,7 @@ void speed_helper(controller_parameter_t * ctrl_par) {
 
 // Helper function to adjust pwm level/duty cycle.
 void adjust_pwm_level(const uint16_t level) {
+    motor_pwm_level = level;
     direction_t dir =  get_direction_of_speed_step(speed_step_target);
     if (dir == DIRECTION_FORWARD) {
         // Forward
@@ -143,6 +228,40 @@ float get_kp(const controller_parameter_t *const ctrl_par) {
     return ctrl_par->pid.k_p_m_2 * (sp - ctrl_par->pid.k_p_x_1) + ctrl_par->pid.k_p_y_1;
 }
 
+// Multiplies two Q16.16 numbers, the result keeps 64 bits to avoid overflows before limiting
+static inline int64_t q16_mul(q16_t const a, q16_t const b) {
+    return ((int64_t) a * b) >> 16;
+}
+
+// Multiplies a Q8.24 coefficient with a Q16.16 number, the result is Q16.16
+static inline int64_t q24_mul(int32_t const coefficient, int64_t const x) {
+    return ((int64_t) coefficient * x) >> 24;
+}
+
+// Limits a Q16.16 intermediate result to the range of q16_t
+static inline q16_t q16_sat(int64_t const x) {
+    if (x > INT32_MAX) {
+        return INT32_MAX;
+    }
+    if (x < INT32_MIN) {
+        return INT32_MIN;
+    }
+    return (q16_t) x;
+}
+
+// Returns proportional gain value corresponding to current setpoint (fixed-point)
+q16_t get_kp_q16(const controller_parameter_t *const ctrl_par) {
+    const controller_q16_t *const q = &ctrl_par->q16;
+    const q16_t sp = Q16_FROM_INT(ctrl_par->setpoint);
+    if (sp < q->k_p_x_1) {
+        return q16_sat((int64_t) (q->k_p_y_1 - q->k_p_y_0) * sp / q->k_p_x_1 + q->k_p_y_0);
+    }
+    if (q->k_p_x_2 == 0) {
+        return q->k_p_y_1;
+    }
+    return q16_sat((int64_t) (q->k_p_y_2 - q->k_p_y_1) * (sp - q->k_p_x_1) / q->k_p_x_2 + q->k_p_y_1);
+}
+
 
 uint16_t get_initial_level(controller_parameter_t *const ctrl_par){
     uint32_t sum = 0;
@@ -156,6 +275,10 @@ uint16_t get_initial_level(controller_parameter_t *const ctrl_par){
             break;
         }
     }
+    if (i == 0) {
+        // No base level recorded yet, start ramping up from 0
+        return 0;
+    }
     return  ((sum / i)*2)/3;
 }
 
@@ -165,9 +288,9 @@ void controller_startup_mode(controller_parameter_t *const ctrl_par) {
         ctrl_par->startup.level = get_initial_level(ctrl_par);
     }
     if (ctrl_par->measurement_corrected < 7.5f){
-        const uint16_t max_level = _125M / (CV_ARRAY_FLASH[8] * 100 + 10000);
+        const uint16_t max_level = cv_fields.motor_max_level;
         adjust_pwm_level(ctrl_par->startup.level);
-        ctrl_par->startup.level += max_level / 250;
+        ctrl_par->startup.level += ctrl_par->startup.level_step;
         if (ctrl_par->startup.level > max_level) {
             // Try again with half value...
             ctrl_par->startup.level = get_initial_level(ctrl_par)/2;
@@ -185,6 +308,32 @@ void controller_startup_mode(controller_parameter_t *const ctrl_par) {
     }
 }
 
+// Controller - Startup mode (fixed-point)
+void controller_startup_mode_q16(controller_parameter_t *const ctrl_par) {
+    if(ctrl_par->startup.level == 0) {
+        ctrl_par->startup.level = get_initial_level(ctrl_par);
+    }
+    if (ctrl_par->q16.measurement_corrected < Q16_CONST(7.5)){
+        const uint16_t max_level = cv_fields.motor_max_level;
+        adjust_pwm_level(ctrl_par->startup.level);
+        ctrl_par->startup.level += ctrl_par->startup.level_step;
+        if (ctrl_par->startup.level > max_level) {
+            // Try again with half value...
+            ctrl_par->startup.level = get_initial_level(ctrl_par)/2;
+        }
+    }
+    else {
+        // Save level value in array
+        ctrl_par->startup.base_pwm_arr[ctrl_par->startup.base_pwm_arr_i] = ctrl_par->startup.level;
+        // Update index
+        ctrl_par->startup.base_pwm_arr_i = (ctrl_par->startup.base_pwm_arr_i+1)%BASE_PWM_ARR_LEN;
+        // Set ramp_up_mode flag to true
+        ctrl_par->mode = PID_MODE;
+        // Multiply with k_ff constant and set as current feed forward value
+        ctrl_par->q16.feed_fwd = q16_sat((int64_t) ctrl_par->q16.k_ff * ctrl_par->startup.level);
+    }
+}
+
 // Controller - PID control mode
 void controller_pid_mode(controller_parameter_t *const ctrl_par) {
     ctrl_par->pid.k_p = get_kp(ctrl_par);
@@ -219,6 +368,12 @@ void controller_pid_mode(controller_parameter_t *const ctrl_par) {
         }
     }
 
+    #if TELEMETRY
+        ctrl_par->telemetry.p = Q16_FROM_FLOAT(p);
+        ctrl_par->telemetry.i = Q16_FROM_FLOAT(i);
+        ctrl_par->telemetry.d = Q16_FROM_FLOAT(d);
+    #endif
+
     // Set PWM Level and discard results in adc fifo
     //adjust_pwm_level((uint16_t) roundf(output_f));
     adjust_pwm_level((uint16_t) output_f);
@@ -228,8 +383,323 @@ void controller_pid_mode(controller_parameter_t *const ctrl_par) {
     ctrl_par->pid.d_prev = d;
 }
 
+// Controller - PID control mode (fixed-point)
+void controller_pid_mode_q16(controller_parameter_t *const ctrl_par) {
+    controller_q16_t *const q = &ctrl_par->q16;
+    if (q->k_p_setpoint != ctrl_par->setpoint) {
+        q->k_p = get_kp_q16(ctrl_par);
+        q->k_p_setpoint = ctrl_par->setpoint;
+    }
+    // Proportional part, integral part and derivative part (including digital low-pass-filter with time constant tau)
+    const int64_t p = q16_mul(q->k_p, q->e);
+    int64_t i = q24_mul(q->ci_0, (int64_t) q->e + q->e_prev) + q->i_prev;
+    const q16_t d = q16_sat(q24_mul(q->cd_0, (int64_t) q->measurement - q->measurement_prev) + q24_mul(q->cd_1, q->d_prev));
+
+    // Check for limits on the integral part
+    if (i > q->int_lim_max) {
+        i = q->int_lim_max;
+    }
+    else if (i < q->int_lim_min) {
+        i = q->int_lim_min;
+    }
+
+    // Sum feed forward + all controller terms (p+i+d). Limit Output from 0% to 100% duty cycle
+    int64_t output = (int64_t) q->feed_fwd + p + i + d;
+    if (output < 0) {
+        output = 0;
+    }
+    else if (output > q->max_output) {
+        output = q->max_output;
+    }
+
+    if (LOGLEVEL >= 1) {
+        static int counter = 0;
+        counter++;
+        if (counter > 200) {
+            LOG(1, "ctrl_par error(%d/65536) output(%d/65536)\n", q->e, (q16_t) output);
+            counter = 0;
+        }
+    }
+
+    #if TELEMETRY
+        ctrl_par->telemetry.p = q16_sat(p);
+        ctrl_par->telemetry.i = (q16_t) i;
+        ctrl_par->telemetry.d = d;
+    #endif
+
+    // Set PWM Level, the fractional part is truncated like the float to integer conversion of controller_pid_mode()
+    adjust_pwm_level((uint16_t) (output >> 16));
+    // Save previous error, integrator, differentiator values
+    q->e_prev = q->e;
+    q->i_prev = (q16_t) i;
+    q->d_prev = d;
+}
+
+// Updates the controller with a new measurement using float arithmetic
+void controller_update(controller_parameter_t *const ctrl_par, q16_t const measurement) {
+    ctrl_par->measurement = Q16_TO_FLOAT(measurement);
+    ctrl_par->measurement_corrected = ctrl_par->measurement - ctrl_par->adc_offset;
+    ctrl_par->pid.e = (float) ctrl_par->setpoint - ctrl_par->measurement_corrected;
+
+    switch (ctrl_par->mode){
+        case STARTUP_MODE:
+            controller_startup_mode(ctrl_par);
+            break;
+        case PID_MODE:
+            controller_pid_mode(ctrl_par);
+            break;
+    }
+
+    // Save measurement value
+    ctrl_par->measurement_prev = ctrl_par->measurement;
+}
+
+// Updates the controller with a new measurement using Q16.16 fixed-point arithmetic
+void controller_update_q16(controller_parameter_t *const ctrl_par, q16_t const measurement) {
+    ctrl_par->q16.measurement = measurement;
+    ctrl_par->q16.measurement_corrected = measurement - ctrl_par->q16.adc_offset;
+    ctrl_par->q16.e = Q16_FROM_INT(ctrl_par->setpoint) - ctrl_par->q16.measurement_corrected;
+
+    switch (ctrl_par->mode){
+        case STARTUP_MODE:
+            controller_startup_mode_q16(ctrl_par);
+            break;
+        case PID_MODE:
+            controller_pid_mode_q16(ctrl_par);
+            break;
+    }
+
+    // Save measurement value
+    ctrl_par->q16.measurement_prev = ctrl_par->q16.measurement;
+}
+
+// Rounds a CV value computed by the autotune and limits it to min ... max
+static uint16_t autotune_cv_value(float const value, uint16_t const min, uint16_t const max) {
+    const float rounded = roundf(value);
+    if (rounded < (float) min) {
+        return min;
+    }
+    return rounded > (float) max ? max : (uint16_t) rounded;
+}
+
+static void autotune_add_cv(uint16_t const cv_index, uint8_t const cv_data) {
+    autotune_result.cv_index[autotune_result.count] = cv_index;
+    autotune_result.cv_data[autotune_result.count] = cv_data;
+    autotune_result.count++;
+}
+
+// Starts the bias ramp towards the operating point, the ramp continues from the current level
+static void autotune_start_point(controller_parameter_t *const ctrl_par, uint8_t const point) {
+    autotune_t *const at = &ctrl_par->autotune;
+    const float fraction = point == 0 ? AUTOTUNE_POINT_0 : AUTOTUNE_POINT_1;
+    at->point = point;
+    at->points[point].setpoint = (float) ctrl_par->speed_table[126] * fraction;
+    // Hysteresis above the noise of the measurement
+    at->hysteresis = 2.0f + at->points[point].setpoint / 100.0f;
+    at->phase = AUTOTUNE_BIAS;
+    at->periods = 0;
+    at->last_switch = 0;
+    LOG(1, "Autotune: operating point %u at back-EMF %f\n", point, at->points[point].setpoint);
+}
+
+// Computes the CVs from the identified operating points and hands them to core0
+static void autotune_finish(controller_parameter_t *const ctrl_par, autotune_status_t const status) {
+    autotune_t *const at = &ctrl_par->autotune;
+    adjust_pwm_level(0);
+    autotune_result.count = 0;
+    if (status == AUTOTUNE_STATUS_DONE) {
+        // Tyreus-Luyben rules, k_i and k_d of the point with the lower gains
+        float k_p[AUTOTUNE_POINTS];
+        float k_i = 0, k_d = 0, bias_min = 0, bias_max = 0;
+        for (uint8_t p = 0; p < AUTOTUNE_POINTS; p++) {
+            const autotune_point_t *const pt = &at->points[p];
+            k_p[p] = pt->k_u / 2.2f;
+            const float k_i_p = k_p[p] / (2.2f * pt->t_u);
+            const float k_d_p = k_p[p] * pt->t_u / 6.3f;
+            k_i = p == 0 || k_i_p < k_i ? k_i_p : k_i;
+            k_d = p == 0 || k_d_p < k_d ? k_d_p : k_d;
+            bias_min = p == 0 || pt->bias < bias_min ? pt->bias : bias_min;
+            bias_max = p == 0 || pt->bias > bias_max ? pt->bias : bias_max;
+            LOG(1, "Autotune: point %u bias %f k_u %f t_u %f s -> k_p %f\n", p, pt->bias, pt->k_u, pt->t_u, k_p[p]);
+        }
+        // Gain schedule: straight line through both points, evaluated at x1 and x2 (maximum setpoint)
+        const float slope = (k_p[1] - k_p[0]) / (at->points[1].setpoint - at->points[0].setpoint);
+        const float k_p_lo = k_p[0] < k_p[1] ? k_p[0] : k_p[1];
+        const float k_p_hi = k_p[0] < k_p[1] ? k_p[1] : k_p[0];
+        float y[3];
+        y[1] = k_p[0] + slope * (ctrl_par->pid.k_p_x_1 - at->points[0].setpoint);
+        y[2] = k_p[0] + slope * ((float) ctrl_par->speed_table[126] - at->points[0].setpoint);
+        for (uint8_t i = 1; i < 3; i++) {
+            y[i] = y[i] < k_p_lo / 2 ? k_p_lo / 2 : y[i] > 2 * k_p_hi ? 2 * k_p_hi : y[i];
+        }
+        // The startup gain at x0 keeps its ratio to x1
+        y[0] = ctrl_par->pid.k_p_y_1 > 0 ? y[1] * ctrl_par->pid.k_p_y_0 / ctrl_par->pid.k_p_y_1 : ctrl_par->pid.k_p_y_0;
+        for (uint8_t i = 0; i < 3; i++) {
+            const uint16_t k_p_cv = autotune_cv_value(y[i] * 100, 1, UINT16_MAX);
+            autotune_add_cv(53 + 2 * i, k_p_cv >> 8);
+            autotune_add_cv(54 + 2 * i, k_p_cv & 0xFF);
+        }
+        autotune_add_cv(49, autotune_cv_value(k_i * 10, 0, 255));
+        autotune_add_cv(50, autotune_cv_value(k_d * 10000, 0, 255));
+        // The integrator covers the difference between the feed forward of the startup level and the bias levels
+        const float feed_fwd = ctrl_par->startup.k_ff * (float) at->breakaway_level;
+        autotune_add_cv(51, autotune_cv_value(ceilf(1.25f * (bias_max - feed_fwd) / 10), 10, 255));
+        autotune_add_cv(52, autotune_cv_value(ceilf(1.25f * (feed_fwd - bias_min) / 10), 10, 255));
+        LOG(1, "Autotune done: k_p %f/%f/%f k_i %f k_d %f\n", y[0], y[1], y[2], k_i, k_d);
+    }
+    else {
+        LOG(1, "Autotune failed (CV_180 = %u)\n", status);
+    }
+    autotune_add_cv(179, status);
+    // The CVs have to be visible to core0 before the state
+    __dmb();
+    autotune_result.state = AUTOTUNE_RESULT_READY;
+    at->phase = AUTOTUNE_DONE;
+}
+
+// Relay feedback autotune, replaces the speed control while active
+void autotune_controller(controller_parameter_t *const ctrl_par) {
+    autotune_t *const at = &ctrl_par->autotune;
+    const uint16_t max_level = cv_fields.motor_max_level;
+    const bool stop = get_speed_step_table_index_of_speed_step(speed_step_target) == 0;
+    const direction_t direction = get_direction_of_speed_step(speed_step_target);
+
+    if (at->phase == AUTOTUNE_DONE) {
+        adjust_pwm_level(0);
+        if (autotune_result.state == AUTOTUNE_RESULT_APPLIED) {
+            // Continue with the new CVs, speed_helper() only updates the setpoint on speed step changes
+            autotune_result.state = AUTOTUNE_RESULT_NONE;
+            const uint32_t setpoint = ctrl_par->setpoint;
+            init_controller(ctrl_par);
+            ctrl_par->setpoint = setpoint;
+        }
+        return;
+    }
+    if (at->phase == AUTOTUNE_WAIT) {
+        adjust_pwm_level(0);
+        if (!stop) {
+            LOG(1, "Autotune started\n");
+            at->direction = direction;
+            at->level = 0;
+            at->breakaway_level = 0;
+            // Same ramp time independent of the control period and PWM frequency
+            at->level_step = (float) max_level * (float) ctrl_par->period_ns / (AUTOTUNE_RAMP_MS * 1e6f);
+            autotune_start_point(ctrl_par, 0);
+        }
+        return;
+    }
+    if (stop || direction != at->direction) {
+        // Aborted, starts again with the next speed step
+        LOG(1, "Autotune aborted\n");
+        adjust_pwm_level(0);
+        at->phase = AUTOTUNE_WAIT;
+        return;
+    }
+
+    const q16_t measurement = measure(ctrl_par->msr_total_iterations,
+                                      ctrl_par->msr_delay_in_us,
+                                      ctrl_par->l_side_arr_cutoff,
+                                      ctrl_par->r_side_arr_cutoff,
+                                      at->direction);
+    adc_fifo_drain();
+    ctrl_par->q16.measurement_corrected = measurement - ctrl_par->q16.adc_offset;
+    ctrl_par->measurement_corrected = Q16_TO_FLOAT(ctrl_par->q16.measurement_corrected);
+    const float y = ctrl_par->measurement_corrected;
+    autotune_point_t *const pt = &at->points[at->point];
+    at->periods++;
+
+    if (at->phase == AUTOTUNE_BIAS) {
+        // Same threshold as the startup controller
+        if (at->breakaway_level == 0 && y >= 7.5f) {
+            at->breakaway_level = (uint16_t) at->level;
+        }
+        if (y >= pt->setpoint) {
+            pt->bias = at->level;
+            at->amplitude = (float) (max_level / AUTOTUNE_RELAY_DIVISOR);
+            if (at->amplitude > pt->bias / 2) {
+                // Keep the motor running during the low half cycles
+                at->amplitude = pt->bias / 2;
+            }
+            at->relay_high = false;
+            at->cycles = 0;
+            at->t_u_sum = 0;
+            at->a_sum = 0;
+            at->periods = 0;
+            at->phase = AUTOTUNE_RELAY;
+        }
+        else {
+            at->level += at->level_step;
+            if (at->level > (float) max_level) {
+                autotune_finish(ctrl_par, AUTOTUNE_STATUS_NOT_REACHED);
+                return;
+            }
+            adjust_pwm_level((uint16_t) at->level);
+            return;
+        }
+    }
+
+    // Relay with hysteresis, a cycle starts at every switch to the high output
+    if (!at->relay_high && y < pt->setpoint - at->hysteresis) {
+        at->relay_high = true;
+        at->last_switch = at->periods;
+        if (at->cycles > 0) {
+            const uint32_t cycle_periods = at->periods - at->cycle_start;
+            if (at->cycles <= AUTOTUNE_SETTLE_CYCLES) {
+                // Move the bias towards equal half cycles
+                const float asymmetry = ((float) at->high_periods * 2 - (float) cycle_periods) / (float) cycle_periods;
+                pt->bias += at->amplitude * asymmetry / 2;
+            }
+            else {
+                at->t_u_sum += (float) cycle_periods;
+                at->a_sum += (at->y_max - at->y_min) / 2;
+            }
+            if (at->cycles == AUTOTUNE_SETTLE_CYCLES + AUTOTUNE_MEASURE_CYCLES) {
+                // Describing function of the relay with hysteresis
+                const float a = at->a_sum / AUTOTUNE_MEASURE_CYCLES;
+                const float a_eff = a > at->hysteresis ? sqrtf(a * a - at->hysteresis * at->hysteresis) : at->hysteresis;
+                pt->k_u = 4 * at->amplitude / (3.14159265f * a_eff);
+                pt->t_u = at->t_u_sum / AUTOTUNE_MEASURE_CYCLES * ctrl_par->pid.t;
+                at->level = pt->bias;
+                if (at->point + 1 < AUTOTUNE_POINTS) {
+                    autotune_start_point(ctrl_par, at->point + 1);
+                }
+                else {
+                    autotune_finish(ctrl_par, AUTOTUNE_STATUS_DONE);
+                }
+                return;
+            }
+        }
+        at->cycles++;
+        at->cycle_start = at->periods;
+        at->high_periods = 0;
+        at->y_max = y;
+        at->y_min = y;
+    }
+    else if (at->relay_high && y > pt->setpoint + at->hysteresis) {
+        at->relay_high = false;
+        at->last_switch = at->periods;
+    }
+    if (at->periods - at->last_switch > (uint32_t) ((uint64_t) AUTOTUNE_TIMEOUT_MS * 1000000 / ctrl_par->period_ns)) {
+        autotune_finish(ctrl_par, AUTOTUNE_STATUS_NO_OSCILLATION);
+        return;
+    }
+    at->y_max = y > at->y_max ? y : at->y_max;
+    at->y_min = y < at->y_min ? y : at->y_min;
+    at->high_periods += at->relay_high;
+    float level = at->relay_high ? pt->bias + at->amplitude : pt->bias - at->amplitude;
+    level = level < 0 ? 0 : level > (float) max_level ? (float) max_level : level;
+    adjust_pwm_level((uint16_t) level);
+}
+
 // General controller function gets called every x milliseconds where x is CV_49 i.e. sampling time (pid->t)
 void controller_general(controller_parameter_t * ctrl_par) {
+    PROFILE_START(PROFILE_CONTROLLER);
+    if (ctrl_par->autotune.phase != AUTOTUNE_OFF) {
+        // The autotune drives the motor until its results are persisted (CV_180)
+        autotune_controller(ctrl_par);
+        PROFILE_END(PROFILE_CONTROLLER);
+        return;
+    }
     // Change in direction -> reset previous derivative, error and integral parts and pwm_base_done
     const bool direction_changed = get_direction_of_speed_step(speed_step_target) !=
                                    get_direction_of_speed_step(speed_step_target_prev);
@@ -238,34 +708,51 @@ void controller_general(controller_parameter_t * ctrl_par) {
         ctrl_par->pid.d_prev = 0.0f;
         ctrl_par->pid.i_prev = 0.0f;
         ctrl_par->pid.e_prev = 0.0f;
+        ctrl_par->q16.d_prev = 0;
+        ctrl_par->q16.i_prev = 0;
+        ctrl_par->q16.e_prev = 0;
         ctrl_par->mode = STARTUP_MODE;
         ctrl_par->startup.level = 0;
         adjust_pwm_level(0);
+        PROFILE_END(PROFILE_CONTROLLER);
         return;
     }
 
-    // Measure BEMF voltage and compute error
-    ctrl_par->measurement = measure(ctrl_par->msr_total_iterations,
-                                    ctrl_par->msr_delay_in_us,
-                                    ctrl_par->l_side_arr_cutoff,
-                                    ctrl_par->r_side_arr_cutoff,
-                                    get_direction_of_speed_step(speed_step_target));
-    ctrl_par->measurement_corrected = ctrl_par->measurement - ctrl_par->adc_offset;
-    ctrl_par->pid.e = (float) ctrl_par->setpoint - ctrl_par->measurement_corrected;
-
-    switch (ctrl_par->mode){
-        case STARTUP_MODE:
-            controller_startup_mode(ctrl_par);
-            break;
-        case PID_MODE:
-            controller_pid_mode(ctrl_par);
-            break;
-    }
+    // Measure BEMF voltage, compute error and set the new PWM level
+    const q16_t measurement = measure(ctrl_par->msr_total_iterations,
+                                      ctrl_par->msr_delay_in_us,
+                                      ctrl_par->l_side_arr_cutoff,
+                                      ctrl_par->r_side_arr_cutoff,
+                                      get_direction_of_speed_step(speed_step_target));
+    #if TELEMETRY
+        // The PID terms are only set in PID mode
+        ctrl_par->telemetry.p = 0;
+        ctrl_par->telemetry.i = 0;
+        ctrl_par->telemetry.d = 0;
+    #endif
+    #if PID_FIXED_POINT
+        controller_update_q16(ctrl_par, measurement);
+    #else
+        controller_update(ctrl_par, measurement);
+    #endif
 
     adc_fifo_drain();
-
-    // Save measurement value
-    ctrl_par->measurement_prev = ctrl_par->measurement;
+    #if TELEMETRY
+        telemetry_sample_t *const sample = &ctrl_par->telemetry;
+        sample->measurement = measurement;
+        #if PID_FIXED_POINT
+            sample->measurement_corrected = ctrl_par->q16.measurement_corrected;
+            sample->feed_fwd = ctrl_par->q16.feed_fwd;
+        #else
+            sample->measurement_corrected = Q16_FROM_FLOAT(ctrl_par->measurement_corrected);
+            sample->feed_fwd = Q16_FROM_FLOAT(ctrl_par->feed_fwd);
+        #endif
+        sample->setpoint = (uint16_t) ctrl_par->setpoint;
+        sample->level = motor_pwm_level;
+        sample->mode = (uint8_t) ctrl_par->mode;
+        telemetry_push(sample);
+    #endif
+    PROFILE_END(PROFILE_CONTROLLER);
 }
 
 
@@ -280,26 +767,36 @@ void init_controller(controller_parameter_t *const ctrl_par) {
     ctrl_par->setpoint = 0;
     ctrl_par->feed_fwd = 0;
 
+    // Control period in whole motor PWM periods
+    ctrl_par->pwm_wrap_divisor = get_controller_pwm_divisor();
+    ctrl_par->period_ns = (uint32_t) ((uint64_t) ctrl_par->pwm_wrap_divisor * get_motor_pwm_period_ns());
+
     // Startup controller variables
     ctrl_par->startup.level = 0;
     ctrl_par->startup.base_pwm_arr_i = 0;
-    ctrl_par->startup.k_ff = (float) CV_ARRAY_FLASH[46]/255;
+    ctrl_par->startup.k_ff = (float) CV_ARRAY_RAM[46]/255;
+    // Same ramp rate as max_level/250 per CV_49 ms, independent of the control period
+    const uint32_t ramp_step_ns = 1000000 * (CV_ARRAY_RAM[48] ? CV_ARRAY_RAM[48] : 1);
+    ctrl_par->startup.level_step = (uint16_t) (((uint64_t) (cv_fields.motor_max_level / 250) * ctrl_par->period_ns + ramp_step_ns / 2) / ramp_step_ns);
+    if (ctrl_par->startup.level_step == 0) {
+        ctrl_par->startup.level_step = 1;
+    }
     for (int i = 0; i < BASE_PWM_ARR_LEN; ++i) {
         ctrl_par->startup.base_pwm_arr[i] = 0;
     }
 
     // Measurement variables initialization
-    ctrl_par->adc_offset = (float) CV_ARRAY_FLASH[171];
-    ctrl_par->msr_total_iterations = CV_ARRAY_FLASH[60];
-    ctrl_par->msr_delay_in_us = CV_ARRAY_FLASH[61];
-    ctrl_par->l_side_arr_cutoff = CV_ARRAY_FLASH[62];
-    ctrl_par->r_side_arr_cutoff = CV_ARRAY_FLASH[63];
+    ctrl_par->adc_offset = (float) CV_ARRAY_RAM[171];
+    ctrl_par->msr_total_iterations = CV_ARRAY_RAM[60];
+    ctrl_par->msr_delay_in_us = CV_ARRAY_RAM[61];
+    ctrl_par->l_side_arr_cutoff = CV_ARRAY_RAM[62];
+    ctrl_par->r_side_arr_cutoff = CV_ARRAY_RAM[63];
 
     // Speed table initialization
     // Calculate speed setpoint table according to V_min, V_max and V_mid CVs
-    const double v_min = (double) CV_ARRAY_FLASH[1];
-    const double v_mid = (double) CV_ARRAY_FLASH[5] * 16;
-    const double v_max = (double) CV_ARRAY_FLASH[4] * 16;
+    const double v_min = (double) CV_ARRAY_RAM[1];
+    const double v_mid = (double) CV_ARRAY_RAM[5] * 16;
+    const double v_max = (double) CV_ARRAY_RAM[4] * 16;
 
     const double delta_x = 63;
     const double m_1 = (v_mid - v_min) / delta_x;
@@ -313,20 +810,24 @@ void init_controller(controller_parameter_t *const ctrl_par) {
     }
 
     // PID Controller initialization
-    ctrl_par->pid.k_i = (float) CV_ARRAY_FLASH[49] / 10;
-    ctrl_par->pid.k_d = (float) CV_ARRAY_FLASH[50] / 10000;
-    ctrl_par->pid.tau = (float) CV_ARRAY_FLASH[47] / 1000;
-    ctrl_par->pid.t = (float) CV_ARRAY_FLASH[48] / 1000;
+    ctrl_par->pid.k_i = (float) CV_ARRAY_RAM[49] / 10;
+    ctrl_par->pid.k_d = (float) CV_ARRAY_RAM[50] / 10000;
+    ctrl_par->pid.tau = (float) CV_ARRAY_RAM[47] / 1000;
+    ctrl_par->pid.t = (float) ctrl_par->period_ns / 1e9f;
     ctrl_par->pid.ci_0 = (ctrl_par->pid.k_i * ctrl_par->pid.t) / 2;
     ctrl_par->pid.cd_0 = -(2 * ctrl_par->pid.k_d) / (2 * ctrl_par->pid.tau + ctrl_par->pid.t);
     ctrl_par->pid.cd_1 = (2 * ctrl_par->pid.tau - ctrl_par->pid.t) / (2 * ctrl_par->pid.tau + ctrl_par->pid.t);
-    ctrl_par->pid.int_lim_max = 10 * (float) CV_ARRAY_FLASH[51];
-    ctrl_par->pid.int_lim_min = -10 * (float) CV_ARRAY_FLASH[52];
-    ctrl_par->pid.max_output = (float) (_125M / (CV_ARRAY_FLASH[8] * 100 + 10000));
+    // cd_0 grows with 1/t without low-pass filter (CV_48 = 0), e.g. -250 for the default k_d at a control period of
+    // 40us (CV_179). Both controllers use the coefficients limited to the range of Q8.24, so they stay equivalent.
+    ctrl_par->pid.ci_0 = fminf(ctrl_par->pid.ci_0, Q24_MAX);
+    ctrl_par->pid.cd_0 = fmaxf(ctrl_par->pid.cd_0, -Q24_MAX);
+    ctrl_par->pid.int_lim_max = 10 * (float) CV_ARRAY_RAM[51];
+    ctrl_par->pid.int_lim_min = -10 * (float) CV_ARRAY_RAM[52];
+    ctrl_par->pid.max_output = (float) cv_fields.motor_max_level;
     ctrl_par->pid.e_prev = 0.0f;
     ctrl_par->pid.i_prev = 0.0f;
     ctrl_par->pid.d_prev = 0.0f;
-    ctrl_par->pid.k_p_x_1_shift = (float) CV_ARRAY_FLASH[59] / 255.0f;
+    ctrl_par->pid.k_p_x_1_shift = (float) CV_ARRAY_RAM[59] / 255.0f;
     ctrl_par->pid.k_p_x_1 = (float) ctrl_par->speed_table[126] * ctrl_par->pid.k_p_x_1_shift;
     ctrl_par->pid.k_p_x_2 = (float) ctrl_par->speed_table[126] * (1.0f - ctrl_par->pid.k_p_x_1_shift);
     ctrl_par->pid.k_p_y_0 = (float) get_16bit_CV(53) / 100.0f;
@@ -335,22 +836,149 @@ void init_controller(controller_parameter_t *const ctrl_par) {
     ctrl_par->pid.k_p_m_1 = (ctrl_par->pid.k_p_y_1 - ctrl_par->pid.k_p_y_0) / ctrl_par->pid.k_p_x_1;
     ctrl_par->pid.k_p_m_2 = (ctrl_par->pid.k_p_y_2 - ctrl_par->pid.k_p_y_1) / ctrl_par->pid.k_p_x_2;
 
+    // Fixed-point controller initialization, coefficients are converted from the float values above
+    ctrl_par->q16.feed_fwd = 0;
+    ctrl_par->q16.k_ff = Q16_FROM_FLOAT(ctrl_par->startup.k_ff);
+    ctrl_par->q16.measurement = 0;
+    ctrl_par->q16.measurement_prev = 0;
+    ctrl_par->q16.measurement_corrected = 0;
+    ctrl_par->q16.adc_offset = Q16_FROM_INT(CV_ARRAY_RAM[171]);
+    ctrl_par->q16.e = 0;
+    ctrl_par->q16.e_prev = 0;
+    ctrl_par->q16.i_prev = 0;
+    ctrl_par->q16.d_prev = 0;
+    ctrl_par->q16.ci_0 = Q24_FROM_FLOAT(ctrl_par->pid.ci_0);
+    ctrl_par->q16.cd_0 = Q24_FROM_FLOAT(ctrl_par->pid.cd_0);
+    ctrl_par->q16.cd_1 = Q24_FROM_FLOAT(ctrl_par->pid.cd_1);
+    ctrl_par->q16.int_lim_max = Q16_FROM_INT(10 * CV_ARRAY_RAM[51]);
+    ctrl_par->q16.int_lim_min = -Q16_FROM_INT(10 * CV_ARRAY_RAM[52]);
+    ctrl_par->q16.max_output = Q16_FROM_INT(cv_fields.motor_max_level);
+    ctrl_par->q16.k_p_x_1 = Q16_FROM_FLOAT(ctrl_par->pid.k_p_x_1);
+    ctrl_par->q16.k_p_x_2 = Q16_FROM_FLOAT(ctrl_par->pid.k_p_x_2);
+    ctrl_par->q16.k_p_y_0 = Q16_FROM_FLOAT(ctrl_par->pid.k_p_y_0);
+    ctrl_par->q16.k_p_y_1 = Q16_FROM_FLOAT(ctrl_par->pid.k_p_y_1);
+    ctrl_par->q16.k_p_y_2 = Q16_FROM_FLOAT(ctrl_par->pid.k_p_y_2);
+    ctrl_par->q16.k_p_setpoint = ctrl_par->setpoint;
+    ctrl_par->q16.k_p = get_kp_q16(ctrl_par);
+
+    // Autotune armed by CV_180, see autotune_controller()
+    ctrl_par->autotune.phase = CV_ARRAY_RAM[179] == AUTOTUNE_STATUS_ARMED ? AUTOTUNE_WAIT : AUTOTUNE_OFF;
+    if (ctrl_par->autotune.phase == AUTOTUNE_WAIT) {
+        LOG(1, "Autotune armed, waiting for a speed step\n");
+    }
+
     LOG(1, "Motor controller initialization done!\n")
 }
 
-bool controller_timer_callback(__unused struct repeating_timer *t) {
-    controller_flag = true;
+// Releases a core1 task, called from interrupts only
+static inline void release_core1_task(core1_task_t *const task) {
+    task->release_us = time_us_32();
+    task->released++;
+    __sev();
+}
+
+bool core1_task_timer_callback(struct repeating_timer *t) {
+    release_core1_task(t->user_data);
     return true;
 }
 
-bool speed_helper_timer_callback(__unused struct repeating_timer *t) {
-    speed_helper_flag = true;
+// Scheduler of core1, used by the motor PWM wrap interrupt handler
+static core1_scheduler_t *pwm_wrap_scheduler;
+
+void __not_in_flash_func(motor_pwm_wrap_handler)() {
+    // Runs every PWM period (25kHz by default), keep it short
+    pwm_clear_irq(pwm_gpio_to_slice_num(MOTOR_FWD_PIN));
+    core1_scheduler_t *const sched = pwm_wrap_scheduler;
+    if (++sched->pwm_wrap_count >= sched->pwm_wrap_divisor) {
+        sched->pwm_wrap_count = 0;
+        release_core1_task(&sched->task[CONTROLLER_TASK]);
+    }
+}
+
+uint32_t get_motor_pwm_period_ns() {
+    // The PWM counter runs at 125MHz / CV_174 (0 = 256) and wraps every motor_max_level counts
+    const uint32_t clkdiv = CV_ARRAY_RAM[173] ? CV_ARRAY_RAM[173] : 256;
+    return clkdiv * cv_fields.motor_max_level * (1000000000 / _125M);
+}
+
+uint16_t get_controller_pwm_divisor() {
+    if (CV_ARRAY_RAM[178]) {
+        return CV_ARRAY_RAM[178];
+    }
+    const uint32_t pwm_period_ns = get_motor_pwm_period_ns();
+    const uint32_t divisor = (1000000 * CV_ARRAY_RAM[48] + pwm_period_ns / 2) / pwm_period_ns;
+    if (divisor == 0) {
+        return 1;
+    }
+    return divisor > UINT16_MAX ? UINT16_MAX : divisor;
+}
+
+void init_core1_scheduler(core1_scheduler_t *const sched, controller_parameter_t *const ctrl_par) {
+    memset(sched, 0, sizeof(core1_scheduler_t));
+    sched->ctrl_par = ctrl_par;
+    sched->task[CONTROLLER_TASK].run = controller_general;
+    sched->task[CONTROLLER_TASK].period_us = ctrl_par->period_ns / 1000;
+    sched->task[SPEED_HELPER_TASK].run = speed_helper;
+    sched->task[SPEED_HELPER_TASK].period_us = 1000 * CV_ARRAY_RAM[174];
+
+    // Speed helper: negative delay -> fixed release rate independent of the callback latency
+    core1_task_t *const speed_helper_task = &sched->task[SPEED_HELPER_TASK];
+    add_repeating_timer_us(-(int64_t) speed_helper_task->period_us, core1_task_timer_callback, speed_helper_task, &speed_helper_task->timer);
+
+    // Controller: released every pwm_wrap_divisor motor PWM periods, synchronous to the back-EMF sampling (see measure())
+    sched->pwm_wrap_divisor = ctrl_par->pwm_wrap_divisor;
+    pwm_wrap_scheduler = sched;
+    const uint slice_num = pwm_gpio_to_slice_num(MOTOR_FWD_PIN);
+    pwm_clear_irq(slice_num);
+    pwm_set_irq_enabled(slice_num, true);
+    irq_set_exclusive_handler(PWM_IRQ_WRAP, motor_pwm_wrap_handler);
+    irq_set_enabled(PWM_IRQ_WRAP, true);
+    LOG(1, "Control period %u ns (%u motor PWM periods)\n", ctrl_par->period_ns, ctrl_par->pwm_wrap_divisor);
+}
+
+bool run_core1_scheduler(core1_scheduler_t *const sched) {
+    // Select the released task with the earliest deadline
+    core1_task_t *task = NULL;
+    uint32_t deadline = 0;
+    for (uint8_t i = 0; i < CORE1_TASKS; i++) {
+        core1_task_t *const t = &sched->task[i];
+        const uint32_t t_deadline = t->release_us + t->period_us;
+        if (t->released != t->served && (task == NULL || (int32_t) (t_deadline - deadline) < 0)) {
+            task = t;
+            deadline = t_deadline;
+        }
+    }
+    if (task == NULL) {
+        return false;
+    }
+    const uint32_t released = task->released;
+    if (released - task->served > 1) {
+        // Released again before the previous release was served
+        task->overruns += released - task->served - 1;
+        set_error(CORE1_TASK_OVERRUN);
+        LOG(2, "core1 task %u skipped %u release(s)\n", (uint) (task - sched->task), released - task->served - 1);
+    }
+    task->served = released;
+
+    const uint32_t start_us = time_us_32();
+    task->run(sched->ctrl_par);
+    const uint32_t end_us = time_us_32();
+    task->runs++;
+    if (end_us - start_us > task->max_runtime_us) {
+        task->max_runtime_us = end_us - start_us;
+    }
+    if ((int32_t) (end_us - deadline) > 0) {
+        task->overruns++;
+        set_error(CORE1_TASK_OVERRUN);
+        LOG(2, "core1 task %u missed its deadline by %u us\n", (uint) (task - sched->task), end_us - deadline);
+    }
     return true;
 }
 
 
 void core1_entry() {
     LOG(1, "core1 Initialization...\n");
+    profile_init();
 
     flash_safe_execute_core_init_done = flash_safe_execute_core_init();
     if (flash_safe_execute_core_init_done != true){
@@ -368,26 +996,18 @@ void core1_entry() {
     controller_parameter_t control_parameter;
     controller_parameter_t *ctrl_par = &control_parameter;
     init_controller(ctrl_par);
-    
-    struct repeating_timer timer_controller, timer_speed_helper;
-    add_repeating_timer_ms(-CV_ARRAY_FLASH[48], controller_timer_callback, NULL, &timer_controller);
-    add_repeating_timer_ms(-CV_ARRAY_FLASH[174], speed_helper_timer_callback, NULL, &timer_speed_helper);
+    init_bemf_adc();
+
+    static core1_scheduler_t scheduler;
+    init_core1_scheduler(&scheduler, ctrl_par);
 
     LOG(1, "core1 initialization done!\n");
 
-    // Endless loop
+    // Endless loop: run released tasks, sleep until the next release when idle
     while (true) {
-        if (controller_flag) {
-            controller_general(ctrl_par);
-            controller_flag = false;
-        }
-        else if (speed_helper_flag) {
-            speed_helper(ctrl_par);
-            speed_helper_flag = false;
-        }
-        else {
+        if (!run_core1_scheduler(&scheduler)) {
             watchdog_update();
+            __wfe();
         }
-        
     }
 }
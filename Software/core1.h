@@ -17,6 +17,66 @@
  */
 #define BASE_PWM_ARR_LEN 16
 
+/**
+ * @def BEMF_ADC_SAMPLE_TIME_US
+ * @brief Duration of one ADC conversion in us (96 cycles of the 48MHz ADC clock)
+ */
+#define BEMF_ADC_SAMPLE_TIME_US 2
+
+/**
+ * @def BEMF_ADC_BUF_LEN
+ * @brief Length of the back-EMF sample buffer: up to 255 samples (CV_61) and up to 255us of discarded samples (CV_62)
+ */
+#define BEMF_ADC_BUF_LEN (255 + 255 / BEMF_ADC_SAMPLE_TIME_US + 1)
+
+/**
+ * @brief Signed Q16.16 fixed-point number, used by the fixed-point controller path (PID_FIXED_POINT).
+ *
+ * @typedef q16_t
+ */
+typedef int32_t q16_t;
+
+/**
+ * @def Q16_ONE
+ * @brief 1.0 in Q16.16
+ */
+#define Q16_ONE (1 << 16)
+/**
+ * @def Q16_CONST
+ * @brief Q16.16 constant from a floating point literal, evaluated at compile time
+ */
+#define Q16_CONST(x) ((q16_t) ((x) * Q16_ONE))
+/**
+ * @def Q16_FROM_INT
+ * @brief Q16.16 from an integer
+ */
+#define Q16_FROM_INT(x) ((q16_t) ((x) * Q16_ONE))
+/**
+ * @def Q16_FROM_FLOAT
+ * @brief Q16.16 from a float variable, rounded to nearest (only used during initialization)
+ */
+#define Q16_FROM_FLOAT(x) ((q16_t) lroundf((x) * (float) Q16_ONE))
+/**
+ * @def Q16_TO_FLOAT
+ * @brief float from Q16.16
+ */
+#define Q16_TO_FLOAT(x) ((float) (x) / (float) Q16_ONE)
+/**
+ * @def Q24_ONE
+ * @brief 1.0 in Q8.24, used for the PID coefficients with magnitudes below 1, which need more fractional bits
+ */
+#define Q24_ONE (1 << 24)
+/**
+ * @def Q24_MAX
+ * @brief Largest magnitude of a Q8.24 coefficient, init_controller() limits the float coefficients to it as well
+ */
+#define Q24_MAX 127.0f
+/**
+ * @def Q24_FROM_FLOAT
+ * @brief Q8.24 from a float variable, limited to +-Q24_MAX and rounded to nearest (only used during initialization)
+ */
+#define Q24_FROM_FLOAT(x) ((int32_t) lroundf(fminf(fmaxf((x), -Q24_MAX), Q24_MAX) * (float) Q24_ONE))
+
 /**
  * @brief Enumeration for controller operating modes.
  *
@@ -42,9 +102,35 @@ typedef struct startup_parameters_t {
     uint16_t level; /**< Latest level */
     uint16_t base_pwm_arr[BASE_PWM_ARR_LEN]; /**< base pwm ring buffer array */
     uint16_t base_pwm_arr_i; /**< base pwm ring buffer array index */
+    uint16_t level_step; /**< Level increment per control period, the ramp takes 250*CV_49 ms independent of the control period */
     float k_ff; /**< Feed forward factor */
 }startup_parameters_t;
 
+/**
+ * @def SELECT_INSERTION_SORT_LEN
+ * @brief Ranges shorter than this are insertion sorted by select_nth_sample() instead of being partitioned
+ */
+#define SELECT_INSERTION_SORT_LEN 16
+
+/**
+ * @brief DMA channels and sample buffer for back-EMF measurements, see measure().
+ *
+ * The trigger channel is paced by the wrap of the motor PWM slice and writes trigger_cs into the ADC control
+ * register, which starts free-running conversions exactly when the motor PWM level 0 takes effect. The sample channel
+ * is paced by the ADC FIFO and transfers the conversion results into buf.
+ *
+ * @typedef bemf_adc_t
+ * @struct bemf_adc_t
+ */
+typedef struct bemf_adc_t {
+    uint16_t buf[BEMF_ADC_BUF_LEN];     /**< Sample buffer */
+    uint32_t trigger_cs;                /**< ADC control register value written at the PWM wrap */
+    uint sample_dma_chan;               /**< DMA channel transferring samples from the ADC FIFO */
+    uint trigger_dma_chan;              /**< DMA channel starting the ADC at the PWM wrap */
+    dma_channel_config sample_config;   /**< Configuration of sample_dma_chan */
+    dma_channel_config trigger_config;  /**< Configuration of trigger_dma_chan */
+} bemf_adc_t;
+
 /**
  * @brief Structure for PID controller parameters and variables.
  *
@@ -82,6 +168,136 @@ typedef struct pid_parameters_t{
     float k_p_m_2;                  /**< slope from (x1, y1) to (x2, y2) */ 
 } pid_parameters_t;
 
+/**
+ * @brief Fixed-point (Q16.16) copies of the controller coefficients and state, used when PID_FIXED_POINT is enabled.
+ *
+ * The coefficients are converted from their float counterparts in pid_parameters_t and controller_parameter_t by
+ * init_controller(). Products are computed with 64-bit intermediates and stored values are saturated to 32 bits.
+ *
+ * @typedef controller_q16_t
+ * @struct controller_q16_t
+ */
+typedef struct controller_q16_t {
+    q16_t feed_fwd;                 /**< Current feed forward value set by startup controller */
+    q16_t k_ff;                     /**< Feed forward factor */
+    q16_t measurement;              /**< Latest measurement value */
+    q16_t measurement_prev;         /**< Previous measurement value */
+    q16_t measurement_corrected;    /**< Corrected measurement value */
+    q16_t adc_offset;               /**< ADC offset value */
+    q16_t e;                        /**< Error */
+    q16_t e_prev;                   /**< Previous Error */
+    q16_t i_prev;                   /**< Previous Integral Value */
+    q16_t d_prev;                   /**< Previous Derivative Value */
+    int32_t ci_0;                   /**< (k_i*t)/2 in Q8.24 */
+    int32_t cd_0;                   /**< (k_d*2)/(2*tau+t) in Q8.24 */
+    int32_t cd_1;                   /**< (2*tau-t)/(2*tau+t) in Q8.24 */
+    q16_t int_lim_max;              /**< max limit for integrator */
+    q16_t int_lim_min;              /**< min limit for integrator */
+    q16_t max_output;               /**< max possible pwm output value */
+    q16_t k_p;                      /**< Proportional gain for k_p_setpoint */
+    uint32_t k_p_setpoint;          /**< Setpoint k_p was interpolated for, k_p is only recalculated on setpoint changes */
+    q16_t k_p_x_1;                  /**< x1 */
+    q16_t k_p_x_2;                  /**< x2 */
+    q16_t k_p_y_0;                  /**< y0 = KP @ x0 */
+    q16_t k_p_y_1;                  /**< y1 = KP @ x1 */
+    q16_t k_p_y_2;                  /**< y2 = KP @ x2 */
+} controller_q16_t;
+
+/**
+ * @def AUTOTUNE_POINTS
+ * @brief Number of operating points identified by the autotune, at AUTOTUNE_POINT_0 and AUTOTUNE_POINT_1
+ */
+#define AUTOTUNE_POINTS 2
+/**
+ * @def AUTOTUNE_POINT_0
+ * @brief First operating point of the autotune as fraction of the maximum setpoint (speed step 126)
+ */
+#define AUTOTUNE_POINT_0 0.25f
+/**
+ * @def AUTOTUNE_POINT_1
+ * @brief Second operating point of the autotune as fraction of the maximum setpoint (speed step 126)
+ */
+#define AUTOTUNE_POINT_1 0.75f
+/**
+ * @def AUTOTUNE_RAMP_MS
+ * @brief Time of the bias ramp from level 0 to the maximum level, slow enough for the motor to follow
+ */
+#define AUTOTUNE_RAMP_MS 10000
+/**
+ * @def AUTOTUNE_RELAY_DIVISOR
+ * @brief Relay amplitude = maximum level / AUTOTUNE_RELAY_DIVISOR, at most half of the bias level
+ */
+#define AUTOTUNE_RELAY_DIVISOR 20
+/**
+ * @def AUTOTUNE_SETTLE_CYCLES
+ * @brief Relay cycles discarded until the oscillation has settled
+ */
+#define AUTOTUNE_SETTLE_CYCLES 3
+/**
+ * @def AUTOTUNE_MEASURE_CYCLES
+ * @brief Relay cycles averaged for the ultimate gain and period
+ */
+#define AUTOTUNE_MEASURE_CYCLES 4
+/**
+ * @def AUTOTUNE_TIMEOUT_MS
+ * @brief Maximum time without a relay switch before the autotune fails
+ */
+#define AUTOTUNE_TIMEOUT_MS 5000
+
+/**
+ * @brief Phases of the autotune, see autotune_controller().
+ *
+ * @enum autotune_phase_t
+ */
+typedef enum {
+    AUTOTUNE_OFF, /**< Normal speed control */
+    AUTOTUNE_WAIT, /**< Armed (CV_180 = 1), waiting for a nonzero speed step */
+    AUTOTUNE_BIAS, /**< Ramping up the level until the back-EMF reaches the operating point */
+    AUTOTUNE_RELAY, /**< Relay feedback around the bias level */
+    AUTOTUNE_DONE, /**< Motor off, waiting for core0 to persist the results */
+} autotune_phase_t;
+
+/**
+ * @brief Result of the relay feedback at one operating point.
+ *
+ * @typedef autotune_point_t
+ * @struct autotune_point_t
+ */
+typedef struct autotune_point_t {
+    float setpoint;                 /**< Back-EMF of the operating point */
+    float bias;                     /**< Level holding the operating point */
+    float k_u;                      /**< Ultimate gain = 4*amplitude/(pi*oscillation amplitude) */
+    float t_u;                      /**< Ultimate period in s */
+} autotune_point_t;
+
+/**
+ * @brief State of the relay feedback autotune, see autotune_controller().
+ *
+ * @typedef autotune_t
+ * @struct autotune_t
+ */
+typedef struct autotune_t {
+    autotune_phase_t phase;         /**< Current phase */
+    direction_t direction;          /**< Direction of the speed step which started the autotune */
+    uint8_t point;                  /**< Index of the current operating point */
+    autotune_point_t points[AUTOTUNE_POINTS]; /**< Operating points */
+    float level;                    /**< Level of the bias ramp */
+    float level_step;               /**< Ramp increment per control period */
+    uint16_t breakaway_level;       /**< Level at which the motor started to move */
+    float amplitude;                /**< Relay amplitude */
+    float hysteresis;               /**< Relay hysteresis in ADC counts */
+    bool relay_high;                /**< Relay output is bias + amplitude */
+    uint32_t periods;               /**< Control periods since the start of the current phase */
+    uint32_t last_switch;           /**< periods at the last relay switch */
+    uint32_t cycle_start;           /**< periods at the start of the current cycle (switch to high) */
+    uint32_t high_periods;          /**< Periods with high relay output in the current cycle */
+    uint8_t cycles;                 /**< Completed relay cycles */
+    float y_max;                    /**< Highest back-EMF in the current cycle */
+    float y_min;                    /**< Lowest back-EMF in the current cycle */
+    float t_u_sum;                  /**< Sum of the measured cycle periods in control periods */
+    float a_sum;                    /**< Sum of the measured oscillation amplitudes */
+} autotune_t;
+
 /**
  * @brief Structure for various controller parameters.
  * 
@@ -101,6 +317,7 @@ typedef struct controller_parameter_t{
     startup_parameters_t startup;   /**< Struct for startup controller specific variables */
     // PID controller parameters
     pid_parameters_t pid;            /**< Struct for PID controller specific variables */
+    controller_q16_t q16;            /**< Fixed-point controller variables (PID_FIXED_POINT) */
     // Measurement variables
     float measurement;              /**< Latest measurement value */ 
     float measurement_prev;         /**< Previous measurement value */ 
@@ -110,29 +327,122 @@ typedef struct controller_parameter_t{
     uint8_t msr_total_iterations;   /**< Amount of samples */ 
     uint8_t l_side_arr_cutoff;      /**< Discarded outlier samples (left side) */ 
     uint8_t r_side_arr_cutoff;      /**< Discarded outlier samples (right side) */ 
+    // Control period
+    uint16_t pwm_wrap_divisor;      /**< Motor PWM periods per control period (CV_179, or CV_49 rounded to PWM periods) */
+    uint32_t period_ns;             /**< Control period in ns */
+    // Telemetry
+    telemetry_sample_t telemetry;   /**< Controller state of the current control period (TELEMETRY) */
+    // Autotune
+    autotune_t autotune;            /**< Relay feedback autotune, replaces the speed control while active (CV_180) */
 } controller_parameter_t;
 
+/**
+ * @def CORE1_TASKS
+ * @brief Number of tasks run by the core1 scheduler
+ */
+#define CORE1_TASKS 2
+
+/**
+ * @brief Enumeration of the tasks run by the core1 scheduler, tasks with lower ids win ties in deadline.
+ *
+ * @enum core1_task_id_t
+ */
+typedef enum core1_task_id_t {
+    CONTROLLER_TASK = 0,        /**< controller_general(), released by the motor PWM wrap interrupt */
+    SPEED_HELPER_TASK = 1       /**< speed_helper(), period CV_175 */
+} core1_task_id_t;
+
+/**
+ * @brief Periodic task of the core1 scheduler.
+ *
+ * The speed helper is released by its repeating timer, whose callback runs on core0 (default alarm pool) and wakes
+ * core1 via __sev(). The controller is released by the wrap interrupt of the motor PWM slice on core1 every
+ * pwm_wrap_divisor PWM periods. The deadline of every release is the next release. released is only written by the
+ * releasing callback and served only by core1, so no locking is needed between both cores.
+ *
+ * @typedef core1_task_t
+ * @struct core1_task_t
+ */
+typedef struct core1_task_t {
+    void (*run)(controller_parameter_t *ctrl_par); /**< Task function */
+    struct repeating_timer timer;   /**< Timer releasing the task (unused for CONTROLLER_TASK) */
+    uint32_t period_us;             /**< Period = relative deadline */
+    volatile uint32_t released;     /**< Number of releases (written by the timer callback) */
+    volatile uint32_t release_us;   /**< Time of the latest release (time_us_32()) */
+    uint32_t served;                /**< Number of releases served by the scheduler */
+    uint32_t runs;                  /**< Number of completed runs */
+    uint32_t overruns;              /**< Releases skipped because the task was still pending + runs finished after their deadline */
+    uint32_t max_runtime_us;        /**< Longest run */
+} core1_task_t;
+
+/**
+ * @brief Deterministic scheduler for the periodic work of core1.
+ *
+ * @typedef core1_scheduler_t
+ * @struct core1_scheduler_t
+ */
+typedef struct core1_scheduler_t {
+    core1_task_t task[CORE1_TASKS]; /**< Tasks, indexed by core1_task_id_t */
+    controller_parameter_t *ctrl_par; /**< Passed to every task */
+    uint16_t pwm_wrap_divisor;      /**< Motor PWM wraps per controller release */
+    uint16_t pwm_wrap_count;        /**< Motor PWM wraps since the last controller release */
+} core1_scheduler_t;
+
+
+/**
+ * @brief Claims and configures the DMA channels used by measure().
+ */
+void init_bemf_adc();
 
 /**
  * @brief Measures Back-EMF voltage (proportional to the rotational speed of the motor) on GPIO 28 and GPIO 29 respectively (depending on direction).
  *
- * This function performs multiple ADC measurements, sorts the results using insertion sort, and calculates the average of the middle values,
- * discarding a specified number of the lowest and highest values.
+ * The motor PWM is switched off and the ADC is started by DMA at the next PWM wrap, when the switch-off takes effect.
+ * The samples are transferred into a buffer by DMA, samples taken during measurement_delay_us are discarded.
+ * The motor PWM level is restored as soon as the last sample is taken. Afterwards the average of the middle values is
+ * calculated, discarding a specified number of the lowest and highest values, see get_trimmed_mean().
  *
  * @param total_iterations The total number of ADC measurements to perform.
- * @param measurement_delay_us The delay in microseconds between the switch-off of the motor PWM and the measurement.
+ * @param measurement_delay_us The delay in microseconds between the switch-off of the motor PWM and the measurement, rounded up to BEMF_ADC_SAMPLE_TIME_US.
  * @param l_side_arr_cutoff The number of lowest ADC values to discard.
  * @param r_side_arr_cutoff The number of highest ADC values to discard.
  * @param direction The direction of the motor.
- * @return The average of the middle ADC values after discarding the specified number of lowest and highest values.
+ * @return The average of the middle ADC values after discarding the specified number of lowest and highest values in Q16.16.
  */
-float measure(uint8_t total_iterations,
+q16_t measure(uint8_t total_iterations,
               uint8_t measurement_delay_us,
               uint8_t l_side_arr_cutoff,
               uint8_t r_side_arr_cutoff,
               direction_t direction);
 
 
+/**
+ * @brief Partially sorts values[lo..hi] so that values[k] is the element which would be at index k when fully sorted (quickselect).
+ *
+ * Afterwards all elements in values[lo..k-1] are less than or equal to values[k] and all elements in values[k+1..hi]
+ * are greater than or equal to values[k]. Takes linear time on average. Short ranges are insertion sorted.
+ *
+ * @param values The array to partially sort.
+ * @param lo Index of the first element of the range.
+ * @param hi Index of the last element of the range.
+ * @param k Index of the element to select, lo <= k <= hi.
+ */
+void select_nth_sample(uint16_t *values, int32_t lo, int32_t hi, int32_t k);
+
+/**
+ * @brief Calculates the average of the samples, discarding a specified number of the lowest and highest samples.
+ *
+ * Instead of sorting all samples, the discarded samples are moved to both ends of the array with two quickselect
+ * passes (see select_nth_sample()). The order of the samples is changed.
+ *
+ * @param values The samples.
+ * @param total_iterations The number of samples.
+ * @param l_side_arr_cutoff The number of lowest samples to discard.
+ * @param r_side_arr_cutoff The number of highest samples to discard.
+ * @return The average of the remaining samples in Q16.16, rounded down.
+ */
+q16_t get_trimmed_mean(uint16_t *values, uint8_t total_iterations, uint8_t l_side_arr_cutoff, uint8_t r_side_arr_cutoff);
+
 /**
  * @brief Get the speed step table index based on the speed step value.
  *
@@ -167,6 +477,18 @@ void adjust_pwm_level(uint16_t level);
  */
 float get_kp(const controller_parameter_t *ctrl_par);
 
+/**
+ * @brief Fixed-point version of get_kp().
+ *
+ * Interpolates directly between the supporting points instead of using the slopes k_p_m_1 and k_p_m_2, as slopes
+ * rounded to Q16.16 are off by several PWM levels when multiplied with large setpoints and errors. The 64-bit division
+ * is only done when the setpoint changes, see controller_pid_mode_q16().
+ *
+ * @param ctrl_par Pointer to the controller parameter structure.
+ * @return The proportional gain in Q16.16.
+ */
+q16_t get_kp_q16(const controller_parameter_t *ctrl_par);
+
 /**
  * @brief Calculate and return the initial PWM level.
  * 
@@ -187,6 +509,13 @@ uint16_t get_initial_level(controller_parameter_t * ctrl_par);
  */
 void controller_startup_mode(controller_parameter_t * ctrl_par);
 
+/**
+ * @brief Fixed-point version of controller_startup_mode().
+ *
+ * @param ctrl_par Pointer to the controller parameter structure.
+ */
+void controller_startup_mode_q16(controller_parameter_t * ctrl_par);
+
 /**
  * @brief Controller function for PID mode.
  * 
@@ -196,16 +525,117 @@ void controller_startup_mode(controller_parameter_t * ctrl_par);
  */
 void controller_pid_mode(controller_parameter_t *const ctrl_par);
 
+/**
+ * @brief Fixed-point version of controller_pid_mode().
+ *
+ * @param ctrl_par Pointer to the controller parameter structure.
+ */
+void controller_pid_mode_q16(controller_parameter_t *const ctrl_par);
+
+/**
+ * @brief Updates the controller with a new measurement using float arithmetic.
+ *
+ * Computes the error and runs the controller function of the current mode, which sets the motor PWM level.
+ *
+ * @param ctrl_par Pointer to the controller parameter structure.
+ * @param measurement Back-EMF measurement in Q16.16, see measure().
+ */
+void controller_update(controller_parameter_t * ctrl_par, q16_t measurement);
+
+/**
+ * @brief Updates the controller with a new measurement using Q16.16 fixed-point arithmetic.
+ *
+ * Same as controller_update(), but uses and updates the fixed-point variables in controller_q16_t only.
+ *
+ * @param ctrl_par Pointer to the controller parameter structure.
+ * @param measurement Back-EMF measurement in Q16.16, see measure().
+ */
+void controller_update_q16(controller_parameter_t * ctrl_par, q16_t measurement);
+
 /**
  * @brief General controller function called every x milliseconds.
  *
+ * Measures the back-EMF voltage and updates the controller via controller_update_q16() when PID_FIXED_POINT is
+ * enabled, otherwise via controller_update().
+ *
  * @param ctrl_par Pointer to the controller parameter structure.
  */
 void controller_general(controller_parameter_t * ctrl_par);
 
+/**
+ * @brief Relay feedback autotune of the PID controller, called by controller_general() instead of the speed control.
+ *
+ * Armed by CV_180 = 1 and started by the first nonzero speed step after power-up, with the locomotive on a rolling
+ * road. At each operating point (AUTOTUNE_POINT_0 and AUTOTUNE_POINT_1 of the maximum setpoint), the level is ramped
+ * up until the back-EMF reaches the operating point. Then the level toggles between bias + amplitude and
+ * bias - amplitude whenever the back-EMF crosses the operating point (relay with hysteresis), the bias is corrected
+ * until both half cycles are equally long. The ultimate gain k_u and period t_u of the resulting oscillation give the
+ * gains by the Tyreus-Luyben rules: k_p = k_u/2.2, k_i = k_p/(2.2*t_u), k_d = k_p*t_u/6.3.
+ *
+ * k_p of both points set the gain schedule at x1 and x2 (CV_56 - CV_59), k_p at x0 (CV_54, CV_55) keeps its ratio
+ * to x1. k_i and k_d (CV_50, CV_51) are the lower values of both points, the integral limits (CV_52, CV_53) cover the
+ * difference between the feed forward of the breakaway level and the bias levels. The CVs and CV_180 = 0 are handed
+ * to core0 and persisted in one commit (see autotune_result_t). On failure only CV_180 is set to the reason, see
+ * autotune_status_t. A stop or a change of direction aborts the autotune, it restarts with the next speed step.
+ *
+ * @param ctrl_par Pointer to the controller parameter structure.
+ */
+void autotune_controller(controller_parameter_t *ctrl_par);
+
 /**
  * @brief Initialize controller variables, measurement parameters, and speed table.
  *
+ * The PID coefficients are calculated for the actual control period (see get_controller_pwm_divisor()).
+ *
  * @param ctrl_par Pointer to the controller parameter structure.
  */
-void init_controller(controller_parameter_t * ctrl_par);
\ No newline at end of file
+void init_controller(controller_parameter_t * ctrl_par);
+
+/**
+ * @brief Timer callback releasing a core1 task (user_data of the timer), wakes core1 via __sev().
+ *
+ * @param t Repeating timer of the task.
+ * @return Always true to keep the timer running.
+ */
+bool core1_task_timer_callback(struct repeating_timer *t);
+
+/**
+ * @brief Motor PWM wrap interrupt handler, releases the controller task every pwm_wrap_divisor PWM periods.
+ */
+void motor_pwm_wrap_handler();
+
+/**
+ * @brief Returns the period of the motor PWM in ns, given by CV_9 and CV_174.
+ */
+uint32_t get_motor_pwm_period_ns();
+
+/**
+ * @brief Returns the number of motor PWM periods per control period.
+ *
+ * CV_179 if not 0, otherwise CV_49 (ms) rounded to whole PWM periods.
+ *
+ * @return Motor PWM periods per control period (at least 1).
+ */
+uint16_t get_controller_pwm_divisor();
+
+/**
+ * @brief Initializes the core1 tasks, starts the speed helper timer (CV_175) and enables the motor PWM wrap interrupt.
+ *
+ * Has to be called on core1, so the PWM wrap interrupt is handled by core1.
+ *
+ * @param sched Pointer to the scheduler.
+ * @param ctrl_par Pointer to the controller parameter structure passed to the tasks.
+ */
+void init_core1_scheduler(core1_scheduler_t *sched, controller_parameter_t *ctrl_par);
+
+/**
+ * @brief Runs the released task with the earliest deadline.
+ *
+ * Earliest deadline first ensures the speed helper is not starved when the controller takes long. Releases which
+ * were skipped because the task was still pending, and runs which finished after their deadline, are counted as
+ * overruns and reported via CORE1_TASK_OVERRUN.
+ *
+ * @param sched Pointer to the scheduler.
+ * @return true if a task was run, false if no task is released, i.e. core1 can sleep until the next release.
+ */
+bool run_core1_scheduler(core1_scheduler_t *sched);
\ No newline at end of file
@@ -0,0 +1,187 @@
+//////////////////////////
+//   RP2040-Decoder     //
+// Gabriel Koppenstein  //
+//  controller_bench.c  //
+//////////////////////////
+
+// Compares the float and the Q16.16 fixed-point motor controller (see PID_FIXED_POINT)
+//
+// Both controllers are initialized from the same CVs and receive the same back-EMF measurements of a simple motor model
+// (first order lag from PWM level to back-EMF plus ADC noise), which is driven by the float controller. The PWM levels
+// set by both controllers are compared in every control tick. Scenario 0 uses the default CVs, scenario 1 the default
+// CVs without derivative filter (CV_48 = 0) at a control period of one PWM period (CV_179 = 1), the other scenarios use
+// random controller CVs (CV_47 - CV_60) and setpoints.
+// Afterwards the recorded measurements are replayed through both controllers again to measure the time per control
+// tick on the host CPU. The host has an FPU, so the times don't reflect the RP2040, where every float operation is a
+// call into the soft-float routines.
+// Exits with EXIT_FAILURE when the PWM levels of both controllers differ by more than one level in any tick, so the
+// bench is run as test by ctest (see CMakeLists.txt).
+//
+// Usage: controller_bench [options], see print_usage()
+
+#include <stdlib.h>
+#include <unistd.h>
+#include "decoder_host.h"
+#include "core1.h"
+
+// Back-EMF in ADC counts at full PWM level and model time constant in control ticks
+#define MODEL_FULL_SCALE 3000.0
+#define MODEL_TAU_TICKS 20.0
+// Control ticks between setpoint changes
+#define SETPOINT_TICKS 500
+
+typedef struct scenario_result_t {
+    uint32_t max_diff;
+    uint32_t diff_ticks;    // Ticks with a difference of more than one PWM level
+    double mean_diff;
+    double float_ns;
+    double q16_ns;
+} scenario_result_t;
+
+static host_rng_t rng;
+
+static void randomize_controller_cvs() {
+    // Controller CVs within the ranges used in practice, see CV.h
+    write_cv_array_ram(178, 0);                         // control period CV_49
+    write_cv_array_ram(46, 128 + host_rng_next(&rng) % 128);     // k_ff
+    write_cv_array_ram(47, 1 + host_rng_next(&rng) % 50);        // tau in ms
+    write_cv_array_ram(48, 1 + host_rng_next(&rng) % 20);        // t in ms
+    write_cv_array_ram(49, host_rng_next(&rng) % 100);           // k_i * 10
+    write_cv_array_ram(50, host_rng_next(&rng) % 200);           // k_d * 10000
+    write_cv_array_ram(51, 1 + host_rng_next(&rng) % 255);       // integral limit / 10
+    write_cv_array_ram(52, 1 + host_rng_next(&rng) % 255);       // integral limit / -10
+    for (uint16_t i = 53; i < 59; i += 2) {
+        const uint16_t k_p = 50 + host_rng_next(&rng) % 3000;    // k_p * 100
+        write_cv_array_ram(i, k_p >> 8);
+        write_cv_array_ram(i + 1, k_p & 0xFF);
+    }
+    write_cv_array_ram(59, 1 + host_rng_next(&rng) % 128);       // x_1 shift
+}
+
+static uint16_t get_motor_level() {
+    return host_pwm_get_level(MOTOR_FWD_PIN) | host_pwm_get_level(MOTOR_REV_PIN);
+}
+
+static scenario_result_t run_scenario(uint32_t const ticks, q16_t *const measurements) {
+    scenario_result_t result = {0};
+    controller_parameter_t ctrl_float, ctrl_q16;
+    init_controller(&ctrl_float);
+    init_controller(&ctrl_q16);
+    const double max_level = cv_fields.motor_max_level;
+    double bemf = 0;
+    uint64_t diff_sum = 0;
+
+    for (uint32_t t = 0; t < ticks; t++) {
+        if (t % SETPOINT_TICKS == 0) {
+            const uint8_t step = 2 + host_rng_next(&rng) % 126;
+            ctrl_float.setpoint = ctrl_float.speed_table[step - 1];
+            ctrl_q16.setpoint = ctrl_q16.speed_table[step - 1];
+        }
+        // ADC offset plus back-EMF plus +-3 counts of noise
+        const double adc = ctrl_float.adc_offset + bemf + (double) (host_rng_next(&rng) % 7) - 3.0;
+        measurements[t] = (q16_t) ((adc < 0 ? 0 : adc) * Q16_ONE);
+
+        controller_update(&ctrl_float, measurements[t]);
+        const uint16_t level_float = get_motor_level();
+        controller_update_q16(&ctrl_q16, measurements[t]);
+        const uint16_t level_q16 = get_motor_level();
+
+        const uint32_t diff = level_float > level_q16 ? level_float - level_q16 : level_q16 - level_float;
+        diff_sum += diff;
+        result.max_diff = diff > result.max_diff ? diff : result.max_diff;
+        result.diff_ticks += diff > 1;
+        bemf += (level_float * MODEL_FULL_SCALE / max_level - bemf) / MODEL_TAU_TICKS;
+    }
+    result.mean_diff = (double) diff_sum / ticks;
+
+    // Replay the recorded measurements through each controller alone for timing
+    const uint16_t setpoint = ctrl_float.setpoint;
+    init_controller(&ctrl_float);
+    ctrl_float.setpoint = setpoint;
+    uint64_t t0 = host_now_ns();
+    for (uint32_t t = 0; t < ticks; t++) {
+        controller_update(&ctrl_float, measurements[t]);
+    }
+    uint64_t t1 = host_now_ns();
+    result.float_ns = (double) (t1 - t0) / ticks;
+    init_controller(&ctrl_q16);
+    ctrl_q16.setpoint = setpoint;
+    t0 = host_now_ns();
+    for (uint32_t t = 0; t < ticks; t++) {
+        controller_update_q16(&ctrl_q16, measurements[t]);
+    }
+    t1 = host_now_ns();
+    result.q16_ns = (double) (t1 - t0) / ticks;
+    return result;
+}
+
+static void print_usage(const char *const name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -s <scenarios>  number of scenarios, the first one uses the default CVs (default 20)\n"
+            "  -t <ticks>      control ticks per scenario (default 20000)\n"
+            "  -r <seed>       random seed (default 1)\n"
+            "  -h              show this help\n",
+            name);
+}
+
+int main(int argc, char **argv) {
+    uint32_t scenarios = 20;
+    uint32_t ticks = 20000;
+    uint32_t seed = 1;
+    int c;
+    while ((c = getopt(argc, argv, "s:t:r:h")) != -1) {
+        switch (c) {
+            case 's': scenarios = strtoul(optarg, NULL, 0); break;
+            case 't': ticks = strtoul(optarg, NULL, 0); break;
+            case 'r': seed = strtoul(optarg, NULL, 0); break;
+            default:
+                print_usage(argv[0]);
+                return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (ticks == 0) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    q16_t *const measurements = malloc(ticks * sizeof(q16_t));
+    if (measurements == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    host_hal_reset();
+    core0_host_init();
+    // Forward direction, the controller output is set on MOTOR_FWD_PIN
+    speed_step_target = 0x80 | 2;
+    speed_step_target_prev = speed_step_target;
+    host_rng_seed(&rng, seed);
+
+    printf("Scenario  Max diff  Ticks diff > 1  Mean diff  Float       Q16.16\n");
+    uint32_t worst_diff = 0;
+    uint64_t total_diff_ticks = 0;
+    double float_ns = 0, q16_ns = 0;
+    for (uint32_t s = 0; s < scenarios; s++) {
+        if (s == 1) {
+            // Derivative without low-pass filter (tau = 0) at the shortest control period of one PWM period (CV_179)
+            write_cv_array_ram(47, 0);
+            write_cv_array_ram(178, 1);
+        }
+        else if (s > 1) {
+            randomize_controller_cvs();
+        }
+        const scenario_result_t r = run_scenario(ticks, measurements);
+        printf("%8u  %8u  %14u  %9.3f  %6.1f ns  %6.1f ns\n", s, r.max_diff, r.diff_ticks, r.mean_diff, r.float_ns, r.q16_ns);
+        worst_diff = r.max_diff > worst_diff ? r.max_diff : worst_diff;
+        total_diff_ticks += r.diff_ticks;
+        float_ns += r.float_ns;
+        q16_ns += r.q16_ns;
+    }
+    printf("Total: max diff %u PWM levels, %llu of %llu ticks differ by more than one level, "
+           "%.1f ns float vs %.1f ns Q16.16 per tick (host CPU)\n",
+           worst_diff, (unsigned long long) total_diff_ticks, (unsigned long long) scenarios * ticks,
+           float_ns / scenarios, q16_ns / scenarios);
+    free(measurements);
+    // Both controllers have to be equivalent, rounding may differ by one level
+    return worst_diff > 1 || total_diff_ticks > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,361 @@
+//////////////////////////
+//   RP2040-Decoder     //
+// Gabriel Koppenstein  //
+//   controller_sim.c   //
+//////////////////////////
+
+// Closed-loop simulation of the motor controller for the host build, see controller_sim.h
+
+#include <math.h>
+#include <stdlib.h>
+#include "controller_sim.h"
+#include "core1.h"
+
+// The command station repeats the speed packet of the locomotive every SIM_PACKET_PERIOD_US
+#define SIM_PACKET_PERIOD_US 20000
+// Default address (CV_1) of the decoder the speed packets are sent to
+#define SIM_DCC_ADDRESS 3
+
+// PWM level last set by adjust_pwm_level(), see core1.c
+extern uint16_t motor_pwm_level;
+
+// Scores of one segment, combined into sim_metrics_t when the segment ends
+typedef struct sim_segment_score_t {
+    uint16_t target;            // Setpoint at the end of the speed ramp
+    int8_t sign;                // 1: accelerating, -1: decelerating
+    bool target_reached;        // Setpoint reached the target
+    double error_sum_sq;
+    uint32_t error_samples;
+    double overshoot;
+    double last_outside_ms;     // Time of the last sample outside of SIM_SETTLING_BAND
+    double bemf_sum;            // Sums of the second half of the segment
+    double bemf_sum_sq;
+    uint32_t bemf_samples;
+} sim_segment_score_t;
+
+sim_profile_t sim_default_profile(void) {
+    sim_profile_t profile = {0};
+    sim_parse_profile(&profile, "40:3,100:3,40:3,0:3,-40:3,0:2");
+    return profile;
+}
+
+bool sim_parse_profile(sim_profile_t *const profile, const char *const spec) {
+    const char *s = spec;
+    profile->segments = 0;
+    while (*s != '\0') {
+        if (profile->segments == SIM_MAX_SEGMENTS) {
+            return false;
+        }
+        char *end;
+        const long step = strtol(s, &end, 10);
+        if (end == s || *end != ':' || step < -126 || step > 126) {
+            return false;
+        }
+        s = end + 1;
+        const double seconds = strtod(s, &end);
+        if (end == s || seconds <= 0 || seconds > 3600) {
+            return false;
+        }
+        profile->segment[profile->segments].speed_step = (int8_t) step;
+        profile->segment[profile->segments].duration_ms = (uint32_t) lround(seconds * 1000);
+        profile->segments++;
+        s = *end == ',' ? end + 1 : end;
+        if (*end != ',' && *end != '\0') {
+            return false;
+        }
+    }
+    return profile->segments > 0;
+}
+
+bool sim_parse_cv_set(sim_cv_set_t *const cvs, const char *const spec) {
+    const char *s = spec;
+    cvs->count = 0;
+    while (true) {
+        while (*s == ' ' || *s == ',' || *s == '\t' || *s == '\n' || *s == '\r' || *s == '#') {
+            // Comments last until the end of the line
+            if (*s == '#') {
+                while (*s != '\0' && *s != '\n') {
+                    s++;
+                }
+                continue;
+            }
+            s++;
+        }
+        if (*s == '\0') {
+            return true;
+        }
+        char *end;
+        const unsigned long cv = strtoul(s, &end, 10);
+        if (end == s || *end != '=' || cv < 1 || cv > CV_ARRAY_SIZE) {
+            return false;
+        }
+        s = end + 1;
+        const unsigned long value = strtoul(s, &end, 0);
+        if (end == s || value > 255 || cvs->count == SIM_MAX_CVS) {
+            return false;
+        }
+        cvs->cv[cvs->count] = (uint16_t) cv;
+        cvs->value[cvs->count] = (uint8_t) value;
+        cvs->count++;
+        s = end;
+    }
+}
+
+void sim_format_cv_set(const sim_cv_set_t *const cvs, char *const buf, size_t const len) {
+    size_t pos = 0;
+    buf[0] = '\0';
+    for (uint8_t i = 0; i < cvs->count && pos < len; i++) {
+        const int n = snprintf(buf + pos, len - pos, "%s%u=%u", i ? " " : "", cvs->cv[i], cvs->value[i]);
+        if (n < 0) {
+            break;
+        }
+        pos += (size_t) n;
+    }
+}
+
+static uint8_t get_speed_byte(int8_t const speed_step, bool const forward) {
+    // Speed step n is transmitted as n + 1, 1 is the emergency stop (see get_direction_of_speed_step())
+    const uint8_t dir = forward ? 0x80 : 0x00;
+    if (speed_step == 0) {
+        return dir;
+    }
+    return dir | (uint8_t) (abs(speed_step) + 1);
+}
+
+static void send_speed_packet(uint8_t const speed_byte) {
+    // 128 speed step control instruction
+    const uint8_t packet[4] = {SIM_DCC_ADDRESS, 0b00111111, speed_byte, SIM_DCC_ADDRESS ^ 0b00111111 ^ speed_byte};
+    core0_host_evaluate_packet(packet, sizeof(packet));
+}
+
+static void finish_segment(const sim_segment_score_t *const score, uint32_t const duration_ms, sim_metrics_t *const metrics,
+                           double *const error_sum_sq, uint32_t *const error_samples, uint32_t *const scored) {
+    if (score->target == 0) {
+        return;
+    }
+    *error_sum_sq += score->error_sum_sq;
+    *error_samples += score->error_samples;
+    if (score->overshoot > metrics->overshoot) {
+        metrics->overshoot = score->overshoot;
+    }
+    metrics->settling_ms += score->target_reached ? score->last_outside_ms : (double) duration_ms;
+    if (score->bemf_samples > 1) {
+        const double mean = score->bemf_sum / score->bemf_samples;
+        const double var = score->bemf_sum_sq / score->bemf_samples - mean * mean;
+        metrics->ripple += 100.0 * sqrt(var > 0 ? var : 0) / score->target;
+    }
+    (*scored)++;
+}
+
+// Resets the simulated hardware and powers up the decoder with the CV set (and CV_180 = 1 when autotune is set)
+static void sim_power_up(const sim_cv_set_t *const cvs, bool const autotune, motor_model_t *const motor,
+                         const motor_model_params_t *const model, uint64_t const seed,
+                         controller_parameter_t *const ctrl_par, core1_scheduler_t *const sched) {
+    host_hal_reset();
+    motor_model_init(motor, model, seed);
+    motor_model_attach(motor);
+    // The first initialization writes the default CVs to the erased flash, the second one runs with them
+    core0_host_init();
+    core0_host_init();
+    if ((cvs != NULL && cvs->count > 0) || autotune) {
+        for (uint8_t i = 0; cvs != NULL && i < cvs->count; i++) {
+            core0_host_write_cv(cvs->cv[i] - 1, cvs->value[i]);
+        }
+        if (autotune) {
+            core0_host_write_cv(179, AUTOTUNE_STATUS_ARMED);
+        }
+        core0_host_flush_flash();
+        core0_host_init();
+    }
+    // speed_helper() keeps its ramp state across runs, an emergency stop resets it
+    speed_step_target = SPEED_STEP_FORWARD_EMERGENCY_STOP;
+    speed_step_target_prev = speed_step_target;
+    init_controller(ctrl_par);
+    speed_helper(ctrl_par);
+    speed_step_target = SPEED_STEP_FORWARD_STOP;
+    speed_step_target_prev = speed_step_target;
+    init_bemf_adc();
+    init_core1_scheduler(sched, ctrl_par);
+}
+
+void sim_run(const sim_cv_set_t *const cvs, const motor_model_params_t *const model, const sim_profile_t *const profile,
+             uint64_t const seed, sim_trace_t const trace, void *const trace_ctx, sim_metrics_t *const metrics) {
+    static motor_model_t motor;
+    static controller_parameter_t ctrl_par;
+    static core1_scheduler_t sched;
+    memset(metrics, 0, sizeof(sim_metrics_t));
+    sim_power_up(cvs, false, &motor, model, seed, &ctrl_par, &sched);
+
+    const uint64_t start_us = host_time_us();
+    uint64_t next_packet_us = start_us;
+    uint64_t segment_end_us = start_us;
+    uint32_t controller_runs = 0;
+    double error_sum_sq = 0;
+    uint32_t error_samples = 0, scored = 0, starts = 0;
+    bool forward = true;
+    uint16_t prev_target = 0;
+    double standstill_setpoint_ms = -1;     // Time of the first nonzero setpoint while the load stands still
+    bool moved = false, driven = false;
+
+    for (uint8_t s = 0; s < profile->segments; s++) {
+        const sim_segment_t *const seg = &profile->segment[s];
+        const uint64_t segment_start_us = segment_end_us;
+        segment_end_us += (uint64_t) seg->duration_ms * 1000;
+        const bool seg_forward = seg->speed_step == 0 ? forward : seg->speed_step > 0;
+        const uint8_t speed_byte = get_speed_byte(seg->speed_step, seg_forward);
+        sim_segment_score_t score = {0};
+        score.target = ctrl_par.speed_table[abs(seg->speed_step)];
+        score.sign = score.target >= prev_target || seg_forward != forward ? 1 : -1;
+        forward = seg_forward;
+        prev_target = score.target;
+        next_packet_us = host_time_us();
+
+        while (host_time_us() < segment_end_us) {
+            if (host_time_us() >= next_packet_us) {
+                send_speed_packet(speed_byte);
+                next_packet_us += SIM_PACKET_PERIOD_US;
+            }
+            if (!run_core1_scheduler(&sched)) {
+                __wfe();
+                continue;
+            }
+            if (sched.task[CONTROLLER_TASK].runs == controller_runs) {
+                continue;
+            }
+            controller_runs = sched.task[CONTROLLER_TASK].runs;
+
+            // State after the control period
+            motor_model_update(&motor);
+            sim_sample_t sample = {
+                .time_ms = (double) (host_time_us() - start_us) / 1000.0,
+                .speed_step = seg->speed_step,
+                .setpoint = (uint16_t) ctrl_par.setpoint,
+                .bemf = motor_model_bemf_counts(&motor),
+                .level = motor_pwm_level,
+                .mode = (uint8_t) ctrl_par.mode,
+                .current = motor.current,
+                .omega_motor = motor.omega_motor,
+                .omega_load = motor.omega_load,
+            };
+            #if PID_FIXED_POINT
+                sample.measurement = Q16_TO_FLOAT(ctrl_par.q16.measurement_corrected);
+            #else
+                sample.measurement = ctrl_par.measurement_corrected;
+            #endif
+            if (trace != NULL) {
+                trace(&sample, trace_ctx);
+            }
+
+            moved |= motor.omega_load != 0.0;
+            driven |= sample.setpoint != 0;
+            // Startup time from standstill
+            if (sample.setpoint != 0 && standstill_setpoint_ms < 0 && motor.omega_load == 0.0) {
+                standstill_setpoint_ms = sample.time_ms;
+            }
+            else if (standstill_setpoint_ms >= 0 && motor.omega_load != 0.0) {
+                metrics->startup_ms += sample.time_ms - standstill_setpoint_ms;
+                starts++;
+                standstill_setpoint_ms = -1;
+            }
+
+            if (score.target == 0) {
+                continue;
+            }
+            const double segment_ms = (double) (host_time_us() - segment_start_us) / 1000.0;
+            if (sample.setpoint == score.target) {
+                score.target_reached = true;
+            }
+            const double error = (sample.bemf - score.target) / score.target;
+            if (fabs(error) > SIM_SETTLING_BAND) {
+                score.last_outside_ms = segment_ms;
+            }
+            if (score.target_reached) {
+                score.error_sum_sq += error * error;
+                score.error_samples++;
+                if (100.0 * score.sign * error > score.overshoot) {
+                    score.overshoot = 100.0 * score.sign * error;
+                }
+            }
+            if (segment_ms >= seg->duration_ms / 2.0) {
+                score.bemf_sum += sample.bemf;
+                score.bemf_sum_sq += sample.bemf * sample.bemf;
+                score.bemf_samples++;
+            }
+        }
+        finish_segment(&score, seg->duration_ms, metrics, &error_sum_sq, &error_samples, &scored);
+    }
+    if (standstill_setpoint_ms >= 0) {
+        // Setpoint given but the load didn't move until the end
+        metrics->startup_ms += (double) (host_time_us() - start_us) / 1000.0 - standstill_setpoint_ms;
+        starts++;
+    }
+
+    metrics->rms_error = error_samples ? 100.0 * sqrt(error_sum_sq / error_samples) : 0;
+    if (scored) {
+        metrics->settling_ms /= scored;
+        metrics->ripple /= scored;
+    }
+    if (starts) {
+        metrics->startup_ms /= starts;
+    }
+    for (uint8_t i = 0; i < CORE1_TASKS; i++) {
+        metrics->overruns += sched.task[i].overruns;
+    }
+    metrics->control_periods = controller_runs;
+    metrics->simulated_s = (double) (host_time_us() - start_us) / 1e6;
+    metrics->cost = metrics->rms_error + metrics->overshoot + 2 * metrics->ripple +
+                    (metrics->settling_ms + metrics->startup_ms) / 100 + 10.0 * metrics->overruns;
+    if (driven && !moved) {
+        metrics->cost = 1000;
+    }
+
+    // Leave the simulated hardware without references to the static state of this run
+    host_pwm_set_hook(NULL, NULL);
+    host_adc_set_source(NULL, NULL);
+}
+
+uint8_t sim_autotune(const sim_cv_set_t *const cvs, const motor_model_params_t *const model, uint64_t const seed,
+                     sim_cv_set_t *const tuned, double *const duration_s) {
+    static motor_model_t motor;
+    static controller_parameter_t ctrl_par;
+    static core1_scheduler_t sched;
+    sim_power_up(cvs, true, &motor, model, seed, &ctrl_par, &sched);
+    autotune_result.state = AUTOTUNE_RESULT_NONE;
+
+    // Drive forward at speed step SIM_AUTOTUNE_SPEED_STEP until the autotune has finished and core0 applied the CVs
+    const uint64_t start_us = host_time_us();
+    uint64_t next_packet_us = start_us;
+    while (ctrl_par.autotune.phase != AUTOTUNE_OFF && host_time_us() - start_us < SIM_AUTOTUNE_TIMEOUT_S * 1000000ull) {
+        if (host_time_us() >= next_packet_us) {
+            send_speed_packet(get_speed_byte(SIM_AUTOTUNE_SPEED_STEP, true));
+            next_packet_us += SIM_PACKET_PERIOD_US;
+        }
+        core0_host_poll();
+        if (!run_core1_scheduler(&sched)) {
+            __wfe();
+        }
+    }
+    core0_host_flush_flash();
+    *duration_s = (double) (host_time_us() - start_us) / 1e6;
+
+    // The given CV set with the CVs persisted by the autotune
+    *tuned = cvs != NULL ? *cvs : (sim_cv_set_t) {0};
+    const uint8_t status = ctrl_par.autotune.phase == AUTOTUNE_OFF ? CV_ARRAY_RAM[179] : AUTOTUNE_STATUS_ARMED;
+    for (uint8_t i = 0; status == AUTOTUNE_STATUS_DONE && i < autotune_result.count; i++) {
+        const uint16_t cv = autotune_result.cv_index[i] + 1;
+        uint8_t j = 0;
+        while (j < tuned->count && tuned->cv[j] != cv) {
+            j++;
+        }
+        if (cv == 180 || (j == tuned->count && tuned->count == SIM_MAX_CVS)) {
+            continue;
+        }
+        tuned->cv[j] = cv;
+        tuned->value[j] = autotune_result.cv_data[i];
+        tuned->count += j == tuned->count;
+    }
+
+    host_pwm_set_hook(NULL, NULL);
+    host_adc_set_source(NULL, NULL);
+    return status;
+}
@@ -0,0 +1,185 @@
+/*!
+ *
+ * \file controller_sim.h
+ * Closed-loop simulation of the motor controller for the host build (see host/CMakeLists.txt)
+ *
+ * Runs the unmodified core1 control loop (scheduler, speed_helper(), controller_general() with measure()) against the
+ * motor model of motor_model.h in simulated time. A run starts from erased flash with the default CVs, applies a CV
+ * set, drives a speed profile and scores the response of the true (noise-free) back-EMF against the setpoint.
+ *
+ */
+
+#pragma once
+#include "motor_model.h"
+
+/**
+ * @def SIM_MAX_SEGMENTS
+ * @brief Maximum number of segments of a speed profile
+ */
+#define SIM_MAX_SEGMENTS 16
+
+/**
+ * @def SIM_MAX_CVS
+ * @brief Maximum number of CVs of a CV set
+ */
+#define SIM_MAX_CVS 32
+
+/**
+ * @def SIM_SETTLING_BAND
+ * @brief Relative error band for the settling time
+ */
+#define SIM_SETTLING_BAND 0.05
+
+/**
+ * @def SIM_AUTOTUNE_SPEED_STEP
+ * @brief Speed step starting the autotune in sim_autotune(), the operating points don't depend on it
+ */
+#define SIM_AUTOTUNE_SPEED_STEP 40
+
+/**
+ * @def SIM_AUTOTUNE_TIMEOUT_S
+ * @brief Simulated time after which sim_autotune() gives up
+ */
+#define SIM_AUTOTUNE_TIMEOUT_S 120
+
+/**
+ * @brief Segment of a speed profile: a speed step held for a duration.
+ *
+ * @typedef sim_segment_t
+ * @struct sim_segment_t
+ */
+typedef struct sim_segment_t {
+    int8_t speed_step;          /*!< Speed step 1 to 126, negative in reverse direction, 0 stops */
+    uint32_t duration_ms;       /*!< Duration of the segment */
+} sim_segment_t;
+
+/**
+ * @brief Speed profile driven by a simulation run.
+ *
+ * @typedef sim_profile_t
+ * @struct sim_profile_t
+ */
+typedef struct sim_profile_t {
+    sim_segment_t segment[SIM_MAX_SEGMENTS];    /*!< Segments in order */
+    uint8_t segments;                           /*!< Number of segments */
+} sim_profile_t;
+
+/**
+ * @brief CV set applied on top of the default CVs.
+ *
+ * @typedef sim_cv_set_t
+ * @struct sim_cv_set_t
+ */
+typedef struct sim_cv_set_t {
+    uint16_t cv[SIM_MAX_CVS];       /*!< CV numbers (CV_1 is 1) */
+    uint8_t value[SIM_MAX_CVS];     /*!< Values */
+    uint8_t count;                  /*!< Number of CVs */
+} sim_cv_set_t;
+
+/**
+ * @brief State of one control period, passed to the trace callback.
+ *
+ * @typedef sim_sample_t
+ * @struct sim_sample_t
+ */
+typedef struct sim_sample_t {
+    double time_ms;             /*!< Simulated time since the start of the profile */
+    int8_t speed_step;          /*!< Speed step of the current segment */
+    uint16_t setpoint;          /*!< Setpoint of the controller in ADC counts */
+    double measurement;         /*!< Back-EMF measured by the controller (offset corrected) in ADC counts */
+    double bemf;                /*!< True back-EMF of the model in ADC counts */
+    uint16_t level;             /*!< Motor PWM level */
+    uint8_t mode;               /*!< controller_mode_t */
+    double current;             /*!< Motor current in A */
+    double omega_motor;         /*!< Motor speed in rad/s */
+    double omega_load;          /*!< Load speed in rad/s */
+} sim_sample_t;
+
+/**
+ * @brief Callback receiving the state after every control period.
+ */
+typedef void (*sim_trace_t)(const sim_sample_t *sample, void *ctx);
+
+/**
+ * @brief Scores of a simulation run.
+ *
+ * Relative values refer to the setpoint of the respective segment. Segments with speed step 0 are not scored.
+ * The cost combines all scores into one number to minimize:
+ * rms_error + overshoot + 2 * ripple (all in %) + (settling_ms + startup_ms) / 100 + 10 per overrun,
+ * a run in which the motor never moves costs 1000.
+ *
+ * @typedef sim_metrics_t
+ * @struct sim_metrics_t
+ */
+typedef struct sim_metrics_t {
+    double rms_error;           /*!< RMS of the relative error in % after the setpoint reached the target */
+    double overshoot;           /*!< Largest overshoot (or undershoot when decelerating) in % */
+    double settling_ms;         /*!< Mean time until the error stays within SIM_SETTLING_BAND, segment length if never */
+    double ripple;              /*!< Mean standard deviation of the back-EMF in the second half of the segments in % */
+    double startup_ms;          /*!< Time from the first nonzero setpoint until the load moves */
+    uint32_t overruns;          /*!< Overruns of the core1 tasks (see core1_task_t) */
+    uint32_t control_periods;   /*!< Number of controller runs */
+    double simulated_s;         /*!< Simulated time in s */
+    double cost;                /*!< Combined cost, see above */
+} sim_metrics_t;
+
+/**
+ * @brief Returns the default profile: speed step 40, 100, 40, stop and 40 in reverse, 3s each.
+ */
+sim_profile_t sim_default_profile(void);
+
+/**
+ * @brief Parses a profile from comma separated speed_step:seconds pairs, e.g. "40:3,100:3,0:2,-40:3".
+ *
+ * @return true on success.
+ */
+bool sim_parse_profile(sim_profile_t *profile, const char *spec);
+
+/**
+ * @brief Parses a CV set from cv=value pairs separated by spaces, commas or lines, e.g. "47=20 50=30".
+ *
+ * '#' starts a comment until the end of the line, so profiles written by controller_tune can be parsed.
+ *
+ * @return true on success.
+ */
+bool sim_parse_cv_set(sim_cv_set_t *cvs, const char *spec);
+
+/**
+ * @brief Formats a CV set as parsed by sim_parse_cv_set().
+ *
+ * @param cvs CV set.
+ * @param buf Destination.
+ * @param len Size of the destination.
+ */
+void sim_format_cv_set(const sim_cv_set_t *cvs, char *buf, size_t len);
+
+/**
+ * @brief Runs the control loop against the motor model through the speed profile and scores the response.
+ *
+ * Resets the simulated hardware, so the state of previous runs doesn't carry over.
+ *
+ * @param cvs CV set applied on top of the default CVs, may be NULL.
+ * @param model Motor model parameters.
+ * @param profile Speed profile.
+ * @param seed Seed of the ADC noise.
+ * @param trace Called after every control period, may be NULL.
+ * @param trace_ctx User pointer passed to trace.
+ * @param metrics Receives the scores.
+ */
+void sim_run(const sim_cv_set_t *cvs, const motor_model_params_t *model, const sim_profile_t *profile, uint64_t seed,
+             sim_trace_t trace, void *trace_ctx, sim_metrics_t *metrics);
+
+/**
+ * @brief Runs the on-decoder autotune (CV_180, see autotune_controller()) against the motor model.
+ *
+ * Powers up with the CV set and CV_180 = 1, drives forward until the autotune has finished and its CVs are persisted.
+ *
+ * @param cvs CV set applied on top of the default CVs, may be NULL.
+ * @param model Motor model parameters.
+ * @param seed Seed of the ADC noise.
+ * @param tuned Receives the CV set with the CVs written by the autotune (unchanged on failure).
+ * @param duration_s Receives the simulated duration of the autotune.
+ * @return CV_180 after the run, see autotune_status_t (AUTOTUNE_STATUS_ARMED when it didn't finish).
+ */
+uint8_t sim_autotune(const sim_cv_set_t *cvs, const motor_model_params_t *model, uint64_t seed, sim_cv_set_t *tuned,
+                     double *duration_s);
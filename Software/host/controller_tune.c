@@ -0,0 +1,405 @@
+//////////////////////////
+//   RP2040-Decoder     //
+// Gabriel Koppenstein  //
+//  controller_tune.c   //
+//////////////////////////
+
+// Searches motor controller CVs with the closed-loop simulation (see controller_sim.h)
+//
+// The search is a simple evolution strategy: the first generation contains the default CVs and random CV sets within
+// the ranges of tune_params, every following generation keeps the best quarter and replaces the rest by mutations of
+// it with a decreasing step size. Every CV set is simulated with the given motor model and -R randomly varied models,
+// its cost is the worst cost over all models, so the result works for the whole fleet the models stand for.
+// The simulator state is global, so the CV sets of a generation are distributed to forked worker processes, one per
+// CPU core by default. The results are deterministic for a given seed, independent of the number of workers.
+// The best CV set is printed and written as profile, which can be programmed with CV_177 transaction mode or passed
+// to motor_sim -c.
+//
+// Usage: controller_tune [options], see print_usage()
+
+#include <math.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "controller_sim.h"
+#include "shared.h"
+
+#define MAX_MODELS 64
+#define MAX_WORKERS 256
+#define MAX_POPULATION 1024
+
+// Tuned CV, 16-bit values are stored high byte first in cv and cv + 1 (see get_16bit_CV())
+typedef struct tune_param_t {
+    const char *name;
+    uint16_t cv;
+    uint16_t min;
+    uint16_t max;
+    bool wide;
+} tune_param_t;
+
+// Ranges used in practice, see CV.h
+static const tune_param_t tune_params[] = {
+    {"k_ff in %/255", 47, 100, 255, false},
+    {"tau in ms", 48, 1, 50, false},
+    {"k_i * 10", 50, 0, 150, false},
+    {"k_d * 10000", 51, 0, 200, false},
+    {"integral limit / 10", 52, 20, 255, false},
+    {"integral limit / -10", 53, 20, 255, false},
+    {"k_p @ x0 * 100", 54, 50, 3000, true},
+    {"k_p @ x1 * 100", 56, 50, 3000, true},
+    {"k_p @ x2 * 100", 58, 50, 3000, true},
+    {"x_1 shift in %/255", 60, 1, 128, false},
+};
+#define TUNE_PARAMS (sizeof(tune_params) / sizeof(tune_params[0]))
+
+typedef struct candidate_t {
+    uint16_t value[TUNE_PARAMS];
+    double cost;                // Worst cost over all models
+    double mean_cost;
+    sim_metrics_t worst;        // Metrics of the model with the worst cost
+} candidate_t;
+
+// Sent from the workers to the main process for every evaluated candidate
+typedef struct result_t {
+    uint32_t index;
+    double cost;
+    double mean_cost;
+    double simulated_s;
+    sim_metrics_t worst;
+} result_t;
+
+typedef struct tune_config_t {
+    motor_model_params_t model[MAX_MODELS];
+    uint32_t models;
+    sim_profile_t profile;
+    uint32_t seed;
+} tune_config_t;
+
+extern uint8_t CV_ARRAY_DEFAULT[CV_ARRAY_SIZE];
+
+static host_rng_t rng;
+
+static void to_cv_set(const candidate_t *const c, sim_cv_set_t *const cvs) {
+    cvs->count = 0;
+    for (uint32_t p = 0; p < TUNE_PARAMS; p++) {
+        if (tune_params[p].wide) {
+            cvs->cv[cvs->count] = tune_params[p].cv;
+            cvs->value[cvs->count++] = c->value[p] >> 8;
+            cvs->cv[cvs->count] = tune_params[p].cv + 1;
+            cvs->value[cvs->count++] = c->value[p] & 0xFF;
+        }
+        else {
+            cvs->cv[cvs->count] = tune_params[p].cv;
+            cvs->value[cvs->count++] = (uint8_t) c->value[p];
+        }
+    }
+}
+
+static void default_candidate(candidate_t *const c) {
+    for (uint32_t p = 0; p < TUNE_PARAMS; p++) {
+        const uint16_t i = tune_params[p].cv - 1;
+        c->value[p] = tune_params[p].wide ? (CV_ARRAY_DEFAULT[i] << 8) | CV_ARRAY_DEFAULT[i + 1] : CV_ARRAY_DEFAULT[i];
+    }
+}
+
+static void random_candidate(candidate_t *const c) {
+    for (uint32_t p = 0; p < TUNE_PARAMS; p++) {
+        c->value[p] = tune_params[p].min + host_rng_next(&rng) % (tune_params[p].max - tune_params[p].min + 1);
+    }
+}
+
+static void mutate_candidate(candidate_t *const c, const candidate_t *const parent, double const step) {
+    *c = *parent;
+    bool changed = false;
+    while (!changed) {
+        for (uint32_t p = 0; p < TUNE_PARAMS; p++) {
+            if (host_rng_next(&rng) & 1) {
+                continue;
+            }
+            // Approximately normal distributed step (sum of four uniform values) relative to the range
+            const double n = (host_rng_uniform(&rng) + host_rng_uniform(&rng) + host_rng_uniform(&rng) + host_rng_uniform(&rng) - 2.0) * 1.7320508075688772;
+            const double range = tune_params[p].max - tune_params[p].min;
+            double v = round(parent->value[p] + n * step * range);
+            v = v < tune_params[p].min ? tune_params[p].min : v > tune_params[p].max ? tune_params[p].max : v;
+            changed |= (uint16_t) v != parent->value[p];
+            c->value[p] = (uint16_t) v;
+        }
+    }
+}
+
+static void evaluate(const candidate_t *const c, const tune_config_t *const cfg, result_t *const r) {
+    sim_cv_set_t cvs;
+    to_cv_set(c, &cvs);
+    r->cost = 0;
+    r->mean_cost = 0;
+    r->simulated_s = 0;
+    for (uint32_t m = 0; m < cfg->models; m++) {
+        sim_metrics_t metrics;
+        sim_run(&cvs, &cfg->model[m], &cfg->profile, cfg->seed + m, NULL, NULL, &metrics);
+        r->mean_cost += metrics.cost / cfg->models;
+        r->simulated_s += metrics.simulated_s;
+        if (m == 0 || metrics.cost > r->cost) {
+            r->cost = metrics.cost;
+            r->worst = metrics;
+        }
+    }
+}
+
+static void store_result(candidate_t *const c, const result_t *const r) {
+    c->cost = r->cost;
+    c->mean_cost = r->mean_cost;
+    c->worst = r->worst;
+}
+
+// Closes the result pipes of the first started workers and reaps them, workers still writing end with SIGPIPE
+static void stop_workers(const int *const fds, const pid_t *const pids, uint32_t const started) {
+    for (uint32_t w = 0; w < started; w++) {
+        close(fds[w]);
+        waitpid(pids[w], NULL, 0);
+    }
+}
+
+// Evaluates the candidates first to first + n - 1 in worker processes, returns the simulated time or -1 on errors
+static double evaluate_all(candidate_t *const c, uint32_t const first, uint32_t const n, const tune_config_t *const cfg,
+                           uint32_t workers) {
+    double simulated_s = 0;
+    if (workers > n) {
+        workers = n;
+    }
+    if (workers <= 1) {
+        for (uint32_t i = first; i < first + n; i++) {
+            result_t r;
+            evaluate(&c[i], cfg, &r);
+            store_result(&c[i], &r);
+            simulated_s += r.simulated_s;
+        }
+        return simulated_s;
+    }
+
+    int fds[MAX_WORKERS];
+    pid_t pids[MAX_WORKERS];
+    fflush(stdout);
+    for (uint32_t w = 0; w < workers; w++) {
+        int p[2];
+        if (pipe(p) != 0) {
+            perror("pipe");
+            stop_workers(fds, pids, w);
+            return -1;
+        }
+        pids[w] = fork();
+        if (pids[w] < 0) {
+            perror("fork");
+            close(p[0]);
+            close(p[1]);
+            stop_workers(fds, pids, w);
+            return -1;
+        }
+        if (pids[w] == 0) {
+            // Worker: evaluates every workers-th candidate and writes the results into its pipe. The inherited read
+            // ends of the other workers are closed, so only the parent keeps them open.
+            close(p[0]);
+            for (uint32_t o = 0; o < w; o++) {
+                close(fds[o]);
+            }
+            for (uint32_t i = first + w; i < first + n; i += workers) {
+                result_t r;
+                evaluate(&c[i], cfg, &r);
+                r.index = i;
+                if (write(p[1], &r, sizeof(r)) != sizeof(r)) {
+                    _exit(EXIT_FAILURE);
+                }
+            }
+            close(p[1]);
+            _exit(EXIT_SUCCESS);
+        }
+        close(p[1]);
+        fds[w] = p[0];
+    }
+
+    // Results fit into the pipe, so reading the workers one after another doesn't block them for long
+    bool ok = true;
+    uint32_t received = 0;
+    for (uint32_t w = 0; w < workers; w++) {
+        result_t r;
+        size_t got = 0;
+        ssize_t len;
+        while ((len = read(fds[w], (uint8_t *) &r + got, sizeof(r) - got)) > 0) {
+            got += (size_t) len;
+            if (got == sizeof(r)) {
+                if (r.index >= first && r.index < first + n) {
+                    store_result(&c[r.index], &r);
+                    simulated_s += r.simulated_s;
+                    received++;
+                }
+                got = 0;
+            }
+        }
+        close(fds[w]);
+        int status;
+        if (waitpid(pids[w], &status, 0) != pids[w] || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+            ok = false;
+        }
+    }
+    if (!ok || received != n) {
+        fprintf(stderr, "Worker process failed\n");
+        return -1;
+    }
+    return simulated_s;
+}
+
+static int compare_cost(const void *const a, const void *const b) {
+    const double ca = ((const candidate_t *) a)->cost;
+    const double cb = ((const candidate_t *) b)->cost;
+    return ca < cb ? -1 : ca > cb ? 1 : 0;
+}
+
+static void write_profile(FILE *const f, const candidate_t *const best, const candidate_t *const def,
+                          const tune_config_t *const cfg, double const spread, const char *const profile_spec) {
+    fprintf(f, "# Motor controller CVs found by controller_tune\n");
+    fprintf(f, "# Worst cost %.2f, mean cost %.2f (default CVs: worst %.2f, mean %.2f)\n", best->cost, best->mean_cost,
+            def->cost, def->mean_cost);
+    fprintf(f, "# %u motor model(s), variation spread %.2f, speed profile %s, seed %u\n", cfg->models, spread,
+            profile_spec, cfg->seed);
+    fprintf(f, "# Transaction mode (CV_177) stores all CVs in one flash commit when CV_177 is written again\n");
+    fprintf(f, "177=1\n");
+    for (uint32_t p = 0; p < TUNE_PARAMS; p++) {
+        if (tune_params[p].wide) {
+            fprintf(f, "%u=%u\n%u=%u  # %s = %u\n", tune_params[p].cv, best->value[p] >> 8, tune_params[p].cv + 1,
+                    best->value[p] & 0xFF, tune_params[p].name, best->value[p]);
+        }
+        else {
+            fprintf(f, "%u=%u  # %s\n", tune_params[p].cv, best->value[p], tune_params[p].name);
+        }
+    }
+    fprintf(f, "177=0\n");
+}
+
+static void print_usage(const char *const name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -n <size>       CV sets per generation (default 24)\n"
+            "  -g <count>      number of generations (default 8)\n"
+            "  -m <params>     motor model parameters, e.g. \"r_ohm=12 backlash_rad=0.5\" (see motor_model_params_t)\n"
+            "  -R <models>     number of randomly varied motor models in addition to the given one (default 3)\n"
+            "  -v <spread>     relative spread of the varied models (default 0.3)\n"
+            "  -p <profile>    speed profile as speed_step:seconds pairs (default \"40:3,100:3,40:3,0:3,-40:3,0:2\")\n"
+            "  -r <seed>       random seed (default 1)\n"
+            "  -j <workers>    number of worker processes (default: number of CPU cores)\n"
+            "  -o <file>       write the best CV set as profile\n"
+            "  -h              show this help\n",
+            name);
+}
+
+int main(int argc, char **argv) {
+    static tune_config_t cfg;
+    static candidate_t population[MAX_POPULATION];
+    motor_model_params_t model = motor_model_default_params();
+    const char *profile_spec = "40:3,100:3,40:3,0:3,-40:3,0:2";
+    const char *output_path = NULL;
+    uint32_t size = 24;
+    uint32_t generations = 8;
+    uint32_t models = 3;
+    double spread = 0.3;
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t workers = cores > 0 ? (uint32_t) cores : 1;
+    cfg.seed = 1;
+    int c;
+    while ((c = getopt(argc, argv, "n:g:m:R:v:p:r:j:o:h")) != -1) {
+        switch (c) {
+            case 'n': size = strtoul(optarg, NULL, 0); break;
+            case 'g': generations = strtoul(optarg, NULL, 0); break;
+            case 'm':
+                if (!motor_model_parse_params(&model, optarg)) {
+                    fprintf(stderr, "Invalid motor model parameters: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'R': models = strtoul(optarg, NULL, 0); break;
+            case 'v': spread = strtod(optarg, NULL); break;
+            case 'p': profile_spec = optarg; break;
+            case 'r': cfg.seed = strtoul(optarg, NULL, 0); break;
+            case 'j': workers = strtoul(optarg, NULL, 0); break;
+            case 'o': output_path = optarg; break;
+            default:
+                print_usage(argv[0]);
+                return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (size < 4 || size > MAX_POPULATION || generations == 0 || models + 1 > MAX_MODELS || spread < 0 || spread >= 1 ||
+        workers == 0 || workers > MAX_WORKERS) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (!sim_parse_profile(&cfg.profile, profile_spec)) {
+        fprintf(stderr, "Invalid speed profile: %s\n", profile_spec);
+        return EXIT_FAILURE;
+    }
+    cfg.models = models + 1;
+    cfg.model[0] = model;
+    for (uint32_t m = 1; m < cfg.models; m++) {
+        cfg.model[m] = model;
+        motor_model_randomize(&cfg.model[m], cfg.seed + m, spread);
+    }
+    host_rng_seed(&rng, cfg.seed);
+
+    // First generation: default CVs and random CV sets
+    default_candidate(&population[0]);
+    for (uint32_t i = 1; i < size; i++) {
+        random_candidate(&population[i]);
+    }
+    const uint32_t elite = size / 4;
+    double simulated_s = 0;
+    candidate_t def = {0};
+    const uint64_t t0 = host_now_ns();
+    printf("Generation  Best cost  Mean cost  Evaluated  Time\n");
+    for (uint32_t g = 0; g < generations; g++) {
+        const uint64_t tg = host_now_ns();
+        // The elite of the previous generation is kept, only new CV sets are simulated
+        const uint32_t first = g == 0 ? 0 : elite;
+        if (g > 0) {
+            const double step = 0.25 * pow(0.7, g - 1);
+            for (uint32_t i = elite; i < size; i++) {
+                mutate_candidate(&population[i], &population[host_rng_next(&rng) % elite], step);
+            }
+        }
+        const double s = evaluate_all(population, first, size - first, &cfg, workers);
+        if (s < 0) {
+            return EXIT_FAILURE;
+        }
+        simulated_s += s;
+        if (g == 0) {
+            def = population[0];
+        }
+        qsort(population, size, sizeof(candidate_t), compare_cost);
+        printf("%10u  %9.2f  %9.2f  %9u  %.2f s\n", g, population[0].cost, population[0].mean_cost, size - first,
+               (double) (host_now_ns() - tg) / 1e9);
+    }
+    const double real_s = (double) (host_now_ns() - t0) / 1e9;
+
+    const candidate_t *const best = &population[0];
+    printf("\nCV   Parameter              Default    Best\n");
+    for (uint32_t p = 0; p < TUNE_PARAMS; p++) {
+        printf("%-3u  %-20s  %7u  %7u\n", tune_params[p].cv, tune_params[p].name, def.value[p], best->value[p]);
+    }
+    printf("\n          RMS err  Overshoot  Settling  Ripple  Startup   Overruns  Cost (worst model)\n");
+    const candidate_t *const rows[] = {&def, best};
+    for (uint32_t i = 0; i < 2; i++) {
+        const sim_metrics_t *const r = &rows[i]->worst;
+        printf("%-8s  %6.2f%%  %8.2f%%  %5.0f ms  %5.2f%%  %4.0f ms  %8u  %7.2f\n", i ? "Best" : "Default", r->rms_error,
+               r->overshoot, r->settling_ms, r->ripple, r->startup_ms, r->overruns, rows[i]->cost);
+    }
+    printf("Simulated %.0f s in %.2f s with %u worker(s) (%.0fx real time)\n\n", simulated_s, real_s, workers,
+           simulated_s / real_s);
+
+    write_profile(stdout, best, &def, &cfg, spread, profile_spec);
+    if (output_path != NULL) {
+        FILE *const f = fopen(output_path, "w");
+        if (f == NULL) {
+            fprintf(stderr, "Cannot open %s\n", output_path);
+            return EXIT_FAILURE;
+        }
+        write_profile(f, best, &def, &cfg, spread, profile_spec);
+        fclose(f);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,177 @@
+//////////////////////////
+//   RP2040-Decoder     //
+// Gabriel Koppenstein  //
+//    core0_host.c      //
+//////////////////////////
+
+// Compiles core0.c for the host build. core0.c is included instead of compiled separately, because most of its
+// functions are static. main() is renamed as the host program provides its own.
+#define main core0_main
+#include "core0.c"
+#undef main
+
+#include "decoder_host.h"
+
+_Static_assert(HOST_PACKET_MAX_BYTES == RING_BUFFER_BYTES, "HOST_PACKET_MAX_BYTES does not match RING_BUFFER_BYTES");
+
+void core0_host_init(void) {
+    // Complete flash jobs and release state machine and DMA channel of a previous initialization
+    static bool initialized;
+    if (initialized) {
+        flush_flash_writer();
+        dma_channel_unclaim(dcc_rx_dma_chan);
+        pio_sm_unclaim(DCC_PIO, dcc_rx_sm);
+    }
+    initialized = true;
+    memset(&flash_writer, 0, sizeof(flash_writer));
+    spsc_queue_init(&flash_job_queue, flash_job_buf, sizeof(flash_job_t), FLASH_JOB_QUEUE_LEN);
+    load_cv_journal();
+    init_motor_pwm(MOTOR_FWD_PIN);
+    init_motor_pwm(MOTOR_REV_PIN);
+    init_outputs();
+    init_adc();
+    init_digital_input();
+    flash_safe_execute_core_init_done = true;
+    cv_setup_check();
+    update_dcc_address();
+    spsc_queue_init(&dcc_packet_queue, dcc_packet_buf, sizeof(dcc_packet_t), RING_BUFFER_PACKETS);
+    memset(&dcc_framer, 0, sizeof(dcc_framer));
+    memset(&dcc_half_bit_stats, 0, sizeof(dcc_half_bit_stats));
+    init_dcc_rx();
+}
+
+void core0_host_write_cv(uint16_t const cv_index, uint8_t const cv_data) {
+    write_cv_handler(cv_index, cv_data);
+}
+
+bool core0_host_push_half_bit(uint32_t const duration_us) {
+    return host_dma_push(dcc_rx_dma_chan, duration_us);
+}
+
+bool core0_host_poll(void) {
+    // Same as the body of the main loop in core0.c
+    decode_dcc_half_bits();
+    const dcc_packet_t *packet = spsc_queue_read_slot(&dcc_packet_queue);
+    if (packet != NULL) {
+        evaluate_packet(packet);
+        spsc_queue_release(&dcc_packet_queue);
+        return true;
+    }
+    check_cv_transaction();
+    apply_autotune_result();
+    if (is_dcc_idle_gap()) {
+        run_flash_writer();
+    }
+    watchdog_update();
+    return false;
+}
+
+void core0_host_decode(void) {
+    decode_dcc_half_bits();
+}
+
+bool core0_host_evaluate_next(uint8_t *const bytes, size_t *const length) {
+    const dcc_packet_t *packet = spsc_queue_read_slot(&dcc_packet_queue);
+    if (packet == NULL) {
+        return false;
+    }
+    if (bytes != NULL) {
+        for (size_t i = 0; i < packet->length; i++) {
+            bytes[i] = packet->data[packet->length - 1 - i];
+        }
+    }
+    if (length != NULL) {
+        *length = packet->length;
+    }
+    evaluate_packet(packet);
+    spsc_queue_release(&dcc_packet_queue);
+    return true;
+}
+
+void core0_host_process_dcc_bit(bool const bit) {
+    process_dcc_bit(bit);
+}
+
+void core0_host_evaluate_packet(const uint8_t *const bytes, size_t const length) {
+    // Packets are stored in reverse order, see push_dcc_packet()
+    dcc_packet_t packet = {.length = length};
+    for (size_t i = 0; i < length && i < RING_BUFFER_BYTES; i++) {
+        packet.data[length - 1 - i] = bytes[i];
+    }
+    evaluate_packet(&packet);
+}
+
+spsc_queue_t *core0_host_packet_queue(void) {
+    return &dcc_packet_queue;
+}
+
+uint32_t core0_host_framer_rejected(void) {
+    return dcc_framer.rejected;
+}
+
+uint32_t core0_host_framer_filtered(void) {
+    return dcc_framer.filtered;
+}
+
+bool core0_host_address_accepted(const uint8_t *const bytes, size_t const length) {
+    // Same checks as done by process_dcc_bit() while receiving the packet
+    for (size_t i = 1; i <= length && i <= 2; i++) {
+        if (!accept_dcc_address_bytes(bytes, i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void core0_host_flush_flash(void) {
+    flush_flash_writer();
+}
+
+uint32_t core0_host_flash_jobs_pending(void) {
+    return flash_writer.submitted - flash_writer.completed;
+}
+
+uint32_t core0_host_flash_jobs_failed(void) {
+    return flash_writer.failed;
+}
+
+int core0_host_cv_journal_sector(void) {
+    return cv_journal.valid ? cv_journal.sector : -1;
+}
+
+uint32_t core0_host_cv_journal_records(void) {
+    return cv_journal.next_record;
+}
+
+uint32_t core0_host_cv_journal_capacity(void) {
+    return CV_JOURNAL_RECORDS;
+}
+
+uint32_t core0_host_cv_journal_invalid_records(void) {
+    return cv_journal.invalid_records;
+}
+
+uint32_t core0_host_cv_journal_record_offset(uint32_t const record) {
+    return FLASH_TARGET_OFFSET + cv_journal.sector * FLASH_SECTOR_SIZE + CV_JOURNAL_RECORDS_OFFSET +
+           record * sizeof(cv_journal_record_t);
+}
+
+uint32_t core0_host_cv_legacy_offset(void) {
+    return CV_LEGACY_OFFSET;
+}
+
+uint32_t core0_host_half_bit_overruns(void) {
+    return dcc_half_bit_stats.overruns;
+}
+
+uint32_t core0_host_half_bit_glitches(void) {
+    return dcc_half_bit_stats.glitches;
+}
+
+uint32_t core0_host_invalid_bits(void) {
+    return dcc_half_bit_stats.invalid_bits;
+}
+
+uint32_t core0_host_half_bit_threshold(void) {
+    return dcc_half_bit_decoder.threshold_us;
+}
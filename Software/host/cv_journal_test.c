@@ -0,0 +1,192 @@
+//////////////////////////
+//   RP2040-Decoder     //
+// Gabriel Koppenstein  //
+//  cv_journal_test.c   //
+//////////////////////////
+
+// Tests the CV journal in the simulated flash of the host build (see cv_journal_t)
+//
+// Every case writes CVs through the write_cv_handler() of core0, completes the flash jobs and reboots the decoder by
+// initializing core0 again, which reloads CV_ARRAY_RAM from flash. The reloaded CVs have to match the ones before the
+// reboot. The cases cover
+// - the factory state (erased flash), which is initialized with the default CVs,
+// - single CV writes filling several sectors, so the journal is compacted into the next sector, checked against the
+//   number of flash erases and used records,
+// - bursts of CV writes, which have to be combined into a single flash job without accessing the flash,
+// - torn and invalid records, which have to be skipped without losing the records behind them,
+// - the migration of the plain CV array of firmware without journal, which is located in journal sector 3 and has
+//   to survive until the journal wraps around into that sector.
+// Exits with EXIT_FAILURE when any check fails, run by ctest (see CMakeLists.txt).
+//
+// Usage: cv_journal_test
+
+#include <stdlib.h>
+#include "decoder_host.h"
+#include "shared.h"
+
+// CVs written by the test, none of them is handled specially by write_cv_handler() (CV_41 - CV_48)
+#define TEST_CV_FIRST 40
+#define TEST_CV_COUNT 8
+
+extern uint8_t CV_ARRAY_DEFAULT[CV_ARRAY_SIZE];
+
+static uint32_t failures;
+
+static void check(bool const ok, const char *const what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+static bool reboot() {
+    // Persist pending CV writes, then reload CV_ARRAY_RAM from flash and compare
+    static uint8_t before[CV_ARRAY_SIZE];
+    core0_host_flush_flash();
+    memcpy(before, CV_ARRAY_RAM, CV_ARRAY_SIZE);
+    memset(CV_ARRAY_RAM, 0, CV_ARRAY_SIZE);
+    core0_host_init();
+    core0_host_flush_flash();
+    return memcmp(before, CV_ARRAY_RAM, CV_ARRAY_SIZE) == 0;
+}
+
+static void write_test_cv(uint32_t const n) {
+    // Every write changes the value, so it is persisted
+    const uint16_t cv_index = TEST_CV_FIRST + n % TEST_CV_COUNT;
+    core0_host_write_cv(cv_index, CV_ARRAY_RAM[cv_index] + 1);
+}
+
+static void test_factory_state() {
+    printf("Factory state\n");
+    host_hal_reset();
+    core0_host_init();
+    core0_host_flush_flash();
+    check(core0_host_cv_journal_sector() == 0, "defaults are written into journal sector 0");
+    check(host_flash_erase_count() == 1, "initializing the journal erases one sector");
+    check(CV_ARRAY_RAM[64] == CV_ARRAY_DEFAULT[64], "default CVs are loaded");
+    check(reboot(), "CVs are reloaded after reboot");
+    check(core0_host_cv_journal_invalid_records() == 0, "no invalid records");
+}
+
+static void test_compaction() {
+    printf("Compaction\n");
+    // Every write is flushed on its own and takes one record, a write not fitting into the active sector compacts
+    // the journal into the next sector, which contains the write in its snapshot
+    const uint32_t capacity = core0_host_cv_journal_capacity();
+    const uint32_t writes = 2 * capacity + 10;
+    const uint32_t erases = host_flash_erase_count();
+    uint32_t records = core0_host_cv_journal_records();
+    uint32_t compactions = 0;
+    int sector = core0_host_cv_journal_sector();
+    for (uint32_t n = 0; n < writes; n++) {
+        write_test_cv(n);
+        core0_host_flush_flash();
+        if (records < capacity) {
+            records++;
+        }
+        else {
+            records = 0;
+            compactions++;
+            sector = (sector + 1) % CV_STORE_SECTORS;
+        }
+    }
+    check(compactions == 2, "the writes fill more than two sectors");
+    check(host_flash_erase_count() - erases == compactions, "every compaction erases one sector");
+    check(core0_host_cv_journal_records() == records, "used records match the writes since the last compaction");
+    check(core0_host_cv_journal_sector() == sector, "the journal moves on by one sector per compaction");
+    check(core0_host_flash_jobs_failed() == 0, "no flash job failed");
+    check(reboot(), "CVs are reloaded after reboot");
+    check(core0_host_cv_journal_records() == records, "reloaded journal continues after the last record");
+}
+
+static void test_burst() {
+    printf("Burst of CV writes\n");
+    // All writes are staged and committed by a single job, the flash isn't touched before the job is executed
+    const uint32_t records = core0_host_cv_journal_records();
+    const uint32_t erases = host_flash_erase_count();
+    const uint32_t programs = host_flash_program_count();
+    for (uint32_t n = 0; n < TEST_CV_COUNT * 4; n++) {
+        write_test_cv(n);
+    }
+    check(core0_host_flash_jobs_pending() == 1, "the writes are combined into one flash job");
+    check(host_flash_program_count() == programs && host_flash_erase_count() == erases,
+          "the flash isn't accessed while writing CVs");
+    core0_host_flush_flash();
+    check(core0_host_cv_journal_records() == records + TEST_CV_COUNT, "one record per written CV");
+    check(reboot(), "CVs are reloaded after reboot");
+}
+
+static void program_raw_record(uint32_t const offset, uint16_t const cv_index, uint8_t const cv_data,
+                               uint8_t const check_byte) {
+    // Layout of cv_journal_record_t, programming only clears bits like the flash does
+    const uint8_t raw[4] = {cv_index & 0xFF, cv_index >> 8, cv_data, check_byte};
+    for (uint32_t i = 0; i < sizeof(raw); i++) {
+        host_flash[offset + i] &= raw[i];
+    }
+}
+
+static void test_invalid_records() {
+    printf("Torn and invalid records\n");
+    // Make sure the records fit into the active sector, resetting to the default CVs (CV_8 = 8) compacts the journal
+    if (core0_host_cv_journal_records() + 4 > core0_host_cv_journal_capacity()) {
+        core0_host_write_cv(7, 8);
+        core0_host_flush_flash();
+    }
+    const uint16_t cv_index = TEST_CV_FIRST;
+    const uint8_t value = CV_ARRAY_RAM[cv_index];
+    const uint32_t first = core0_host_cv_journal_records();
+    // Power lost while programming: only the CV index of the record is programmed
+    program_raw_record(core0_host_cv_journal_record_offset(first), cv_index, 0xFF, 0xFF);
+    // Record of a CV outside of the CV array with a matching check byte
+    program_raw_record(core0_host_cv_journal_record_offset(first + 1), CV_ARRAY_SIZE, 0x12,
+                       (CV_ARRAY_SIZE & 0xFF) ^ (CV_ARRAY_SIZE >> 8) ^ 0x12 ^ 0x5A);
+    check(reboot(), "invalid records don't change CVs");
+    check(CV_ARRAY_RAM[cv_index] == value, "torn record is skipped");
+    check(core0_host_cv_journal_invalid_records() == 2, "both invalid records are counted");
+    check(core0_host_cv_journal_records() == first + 2, "invalid records stay used");
+    // Records behind the invalid ones are replayed
+    core0_host_write_cv(cv_index, value + 1);
+    check(reboot(), "CVs written after invalid records are reloaded after reboot");
+    check(CV_ARRAY_RAM[cv_index] == (uint8_t) (value + 1), "record behind invalid records is replayed");
+    check(core0_host_cv_journal_records() == first + 3, "new record is appended behind the invalid records");
+}
+
+static void test_migration() {
+    printf("Migration of CVs stored without journal\n");
+    static uint8_t legacy[CV_ARRAY_SIZE];
+    memcpy(legacy, CV_ARRAY_DEFAULT, CV_ARRAY_SIZE);
+    for (uint32_t i = 0; i < TEST_CV_COUNT; i++) {
+        legacy[TEST_CV_FIRST + i] = 0xA0 + i;
+    }
+    legacy[171] = 0x42;
+    host_hal_reset();
+    memcpy(&host_flash[core0_host_cv_legacy_offset()], legacy, CV_ARRAY_SIZE);
+    core0_host_init();
+    core0_host_flush_flash();
+    check(memcmp(CV_ARRAY_RAM, legacy, CV_ARRAY_SIZE) == 0, "CVs are loaded from the legacy location");
+    check(core0_host_cv_journal_sector() == 0, "CVs are migrated into journal sector 0");
+    check(reboot(), "migrated CVs are reloaded after reboot");
+    // The legacy array is overwritten once the journal wraps around into the last sector
+    const uint32_t capacity = core0_host_cv_journal_capacity();
+    uint32_t n = 0;
+    while (core0_host_cv_journal_sector() != CV_STORE_SECTORS - 1 && n < CV_STORE_SECTORS * (capacity + 1)) {
+        write_test_cv(n++);
+        core0_host_flush_flash();
+    }
+    check(core0_host_cv_journal_sector() == CV_STORE_SECTORS - 1, "journal wraps around into the legacy sector");
+    check(core0_host_cv_journal_sector() >= 0 &&
+          FLASH_TARGET_OFFSET + (uint32_t) core0_host_cv_journal_sector() * FLASH_SECTOR_SIZE ==
+              core0_host_cv_legacy_offset(), "legacy location is journal sector 3");
+    check(reboot(), "CVs are reloaded from the journal in the legacy sector");
+    check(CV_ARRAY_RAM[171] == 0x42, "migrated CV survives the wrap around");
+}
+
+int main() {
+    test_factory_state();
+    test_compaction();
+    test_burst();
+    test_invalid_records();
+    test_migration();
+    printf("%u checks failed\n", failures);
+    return failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
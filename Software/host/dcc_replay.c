@@ -0,0 +1,408 @@
+//////////////////////////
+//   RP2040-Decoder     //
+// Gabriel Koppenstein  //
+//     dcc_replay.c     //
+//////////////////////////
+
+// Replays DCC half-bit duration traces through the core0 decoding pipeline and reports decoding statistics
+//
+// The trace is either synthesized from random packets, optionally distorted by jitter, glitches, dropouts and timing
+// skew of the command station, or read from a file. Trace files contain one half-bit duration in us per line
+// (lines starting with '#' are ignored), alternating between high and low half-bits starting with a high half-bit.
+// This is the same format the dcc_rx PIO program produces.
+//
+// The half-bits are passed to core0 in chunks, like the DMA channel would write them into the half-bit ring buffer,
+// then decoded (framer -> packet queue) and evaluated (evaluate_packet()).
+// For synthesized traces the decoded packets are compared to the transmitted packets. A clean synthesized trace (no
+// jitter, glitches, dropouts or skew) has to be decoded completely, dcc_replay fails on any dropped or false positive
+// packet. With a baseline decoder mode, the trace is replayed a second time in that mode and dcc_replay fails when
+// the first mode dropped more packets.
+//
+// Usage: dcc_replay [options], see print_usage()
+
+#include <stdlib.h>
+#include <unistd.h>
+#include "decoder_host.h"
+#include "shared.h"
+
+// Nominal half-bit durations used for synthesized traces (NMRA S-9.1)
+#define ONE_HALF_BIT_US 58
+#define ZERO_HALF_BIT_US 100
+// Duration of a signal dropout in us
+#define DROPOUT_US 5000
+
+typedef struct packet_t {
+    uint8_t data[HOST_PACKET_MAX_BYTES];
+    size_t length;
+    size_t trace_end;   // Index of the first half-bit after the packet within the trace
+    bool foreign;       // Packet is discarded by the address fast path of the framer and thus not expected
+} packet_t;
+
+typedef struct trace_t {
+    uint32_t *half_bits;
+    size_t length;
+    size_t capacity;
+} trace_t;
+
+typedef struct options_t {
+    uint32_t packets;
+    uint32_t preamble_bits;
+    double jitter_us;
+    double glitch_prob;
+    uint32_t glitch_us;
+    double dropout_prob;
+    double skew_percent;
+    uint32_t chunk;
+    uint32_t seed;
+    int decoder_mode;
+    int baseline_mode;
+    const char *trace_in;
+    const char *trace_out;
+} options_t;
+
+typedef struct replay_result_t {
+    uint64_t decode_ns;
+    uint64_t evaluate_ns;
+    uint64_t signal_us;
+    uint32_t decoded;
+    uint32_t matched;
+    uint32_t false_positives;
+    uint32_t dropped;
+} replay_result_t;
+
+static host_rng_t rng;
+
+static void trace_append(trace_t *const trace, uint32_t const duration_us) {
+    if (trace->length == trace->capacity) {
+        trace->capacity = trace->capacity ? trace->capacity * 2 : 4096;
+        trace->half_bits = realloc(trace->half_bits, trace->capacity * sizeof(uint32_t));
+        if (trace->half_bits == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    trace->half_bits[trace->length++] = duration_us;
+}
+
+static void random_packet(packet_t *const packet, uint8_t const own_address) {
+    // Mix of idle packets, short and long address packets for this and other decoders
+    // with 128 speed step and function group instructions
+    const uint32_t r = host_rng_next(&rng) % 100;
+    size_t n = 0;
+    if (r < 10) {
+        packet->data[n++] = 0xFF;
+        packet->data[n++] = 0x00;
+    }
+    else {
+        if (r < 30) {
+            packet->data[n++] = 0xC0 | (host_rng_next(&rng) % 0x27);
+            packet->data[n++] = host_rng_next(&rng) & 0xFF;
+        }
+        else {
+            packet->data[n++] = r < 55 ? own_address : 1 + host_rng_next(&rng) % 127;
+        }
+        if (host_rng_next(&rng) & 1) {
+            packet->data[n++] = 0x3F;
+            packet->data[n++] = host_rng_next(&rng) & 0xFF;
+        }
+        else {
+            packet->data[n++] = 0x80 | (host_rng_next(&rng) & 0x3F);
+        }
+    }
+    uint8_t checksum = 0;
+    for (size_t i = 0; i < n; i++) {
+        checksum ^= packet->data[i];
+    }
+    packet->data[n++] = checksum;
+    packet->length = n;
+}
+
+static uint32_t distort(uint32_t const duration_us, const options_t *const opt) {
+    // Command station skew and jitter
+    double d = duration_us * (1.0 + opt->skew_percent / 100.0);
+    if (opt->jitter_us > 0) {
+        d += (2.0 * host_rng_uniform(&rng) - 1.0) * opt->jitter_us;
+    }
+    return d < 1.0 ? 1 : (uint32_t) (d + 0.5);
+}
+
+static void append_half_bit(trace_t *const trace, uint32_t const duration_us, const options_t *const opt) {
+    const uint32_t d = distort(duration_us, opt);
+    if (opt->glitch_prob > 0 && host_rng_uniform(&rng) < opt->glitch_prob && d > opt->glitch_us + 2) {
+        // Short spike of opposite polarity splits the half-bit in three parts
+        const uint32_t before = 1 + host_rng_next(&rng) % (d - opt->glitch_us - 1);
+        trace_append(trace, before);
+        trace_append(trace, opt->glitch_us);
+        trace_append(trace, d - opt->glitch_us - before);
+    }
+    else {
+        trace_append(trace, d);
+    }
+}
+
+static void append_bit(trace_t *const trace, bool const bit, const options_t *const opt) {
+    const uint32_t duration_us = bit ? ONE_HALF_BIT_US : ZERO_HALF_BIT_US;
+    append_half_bit(trace, duration_us, opt);
+    append_half_bit(trace, duration_us, opt);
+}
+
+static void synthesize(trace_t *const trace, packet_t *const sent, const options_t *const opt, uint8_t const own_address) {
+    for (uint32_t p = 0; p < opt->packets; p++) {
+        random_packet(&sent[p], own_address);
+        sent[p].foreign = !core0_host_address_accepted(sent[p].data, sent[p].length);
+        // Dropout: signal is lost somewhere within the packet, the rest of the packet is missing
+        const bool dropout = opt->dropout_prob > 0 && host_rng_uniform(&rng) < opt->dropout_prob;
+        const size_t packet_bits = opt->preamble_bits + 9 * sent[p].length + 1;
+        const size_t dropout_bit = dropout ? host_rng_next(&rng) % packet_bits : SIZE_MAX;
+        size_t bit_idx = 0;
+        for (uint32_t i = 0; i < opt->preamble_bits && bit_idx != dropout_bit; i++, bit_idx++) {
+            append_bit(trace, 1, opt);
+        }
+        for (size_t b = 0; b < sent[p].length && bit_idx < dropout_bit; b++) {
+            // Start bit followed by data bits, MSB first
+            append_bit(trace, 0, opt);
+            bit_idx++;
+            for (int8_t i = 7; i >= 0 && bit_idx < dropout_bit; i--, bit_idx++) {
+                append_bit(trace, (sent[p].data[b] >> i) & 1, opt);
+            }
+        }
+        if (bit_idx < dropout_bit) {
+            // Packet end bit
+            append_bit(trace, 1, opt);
+        }
+        else {
+            trace_append(trace, DROPOUT_US / 2);
+            trace_append(trace, DROPOUT_US / 2);
+        }
+        sent[p].trace_end = trace->length;
+    }
+}
+
+static uint32_t count_expected(const packet_t *const sent, size_t const begin, size_t const end) {
+    // Number of packets in [begin, end) which should have reached the packet queue
+    uint32_t count = 0;
+    for (size_t i = begin; i < end; i++) {
+        count += !sent[i].foreign;
+    }
+    return count;
+}
+
+static bool read_trace(trace_t *const trace, const char *const path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return false;
+    }
+    char line[64];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        trace_append(trace, (uint32_t) strtoul(line, NULL, 10));
+    }
+    fclose(f);
+    return true;
+}
+
+static bool write_trace(const trace_t *const trace, const char *const path) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        perror(path);
+        return false;
+    }
+    fprintf(f, "# DCC half-bit durations in us, alternating high/low starting with high\n");
+    for (size_t i = 0; i < trace->length; i++) {
+        fprintf(f, "%u\n", trace->half_bits[i]);
+    }
+    fclose(f);
+    return true;
+}
+
+static void set_decoder_mode(uint8_t const mode) {
+    // Decoder mode is only read during initialization, which also clears the decoder state and statistics
+    core0_host_write_cv(175, mode);
+    core0_host_init();
+}
+
+static void replay(const trace_t *const trace, const packet_t *const sent, const options_t *const opt,
+                   replay_result_t *const r) {
+    memset(r, 0, sizeof(replay_result_t));
+    size_t next_sent = 0;
+    packet_t packet;
+    for (size_t i = 0; i < trace->length; i += opt->chunk) {
+        const size_t end = i + opt->chunk < trace->length ? i + opt->chunk : trace->length;
+        for (size_t j = i; j < end; j++) {
+            core0_host_push_half_bit(trace->half_bits[j]);
+            r->signal_us += trace->half_bits[j];
+        }
+        // Decoding stops when the packet queue is full, continue after evaluating until the chunk is decoded
+        bool evaluated_any;
+        do {
+            uint64_t t0 = host_now_ns();
+            core0_host_decode();
+            uint64_t t1 = host_now_ns();
+            r->decode_ns += t1 - t0;
+            evaluated_any = false;
+            while (true) {
+                t0 = host_now_ns();
+                const bool evaluated = core0_host_evaluate_next(packet.data, &packet.length);
+                t1 = host_now_ns();
+                if (!evaluated) break;
+                evaluated_any = true;
+                r->evaluate_ns += t1 - t0;
+                r->decoded++;
+                if (sent == NULL) continue;
+                // Match against the packets transmitted completely so far, skipped packets were dropped
+                size_t k = next_sent;
+                while (k < opt->packets && sent[k].trace_end <= end &&
+                       (sent[k].length != packet.length || memcmp(sent[k].data, packet.data, packet.length) != 0)) {
+                    k++;
+                }
+                if (k < opt->packets && sent[k].trace_end <= end) {
+                    r->matched++;
+                    r->dropped += count_expected(sent, next_sent, k);
+                    next_sent = k + 1;
+                }
+                else {
+                    r->false_positives++;
+                }
+            }
+        } while (evaluated_any);
+    }
+    if (sent != NULL) {
+        r->dropped += count_expected(sent, next_sent, opt->packets);
+    }
+}
+
+static void print_usage(const char *const name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -n <packets>   number of synthesized packets (default 10000)\n"
+            "  -p <bits>      preamble bits of synthesized packets (default 14)\n"
+            "  -j <us>        maximum jitter per half-bit in us, uniformly distributed (default 0)\n"
+            "  -g <prob>      probability of a glitch per half-bit (default 0)\n"
+            "  -w <us>        glitch width in us (default 2)\n"
+            "  -d <prob>      probability of a signal dropout per packet (default 0)\n"
+            "  -s <percent>   command station timing skew in percent (default 0)\n"
+            "  -c <half-bits> half-bits passed to core0 per decoder call (default 256)\n"
+            "  -r <seed>      random seed (default 1)\n"
+            "  -m <mode>      DCC decoder mode written to CV_176 (default: CV default)\n"
+            "  -b <mode>      replay again in baseline decoder mode, fail when more packets are dropped than in it\n"
+            "  -i <file>      replay recorded trace instead of synthesizing packets\n"
+            "  -o <file>      write the replayed trace to file\n",
+            name);
+}
+
+int main(int argc, char **argv) {
+    options_t opt = {
+        .packets = 10000,
+        .preamble_bits = 14,
+        .glitch_us = 2,
+        .chunk = 256,
+        .seed = 1,
+        .decoder_mode = -1,
+        .baseline_mode = -1,
+    };
+    int c;
+    while ((c = getopt(argc, argv, "n:p:j:g:w:d:s:c:r:m:b:i:o:h")) != -1) {
+        switch (c) {
+            case 'n': opt.packets = strtoul(optarg, NULL, 0); break;
+            case 'p': opt.preamble_bits = strtoul(optarg, NULL, 0); break;
+            case 'j': opt.jitter_us = strtod(optarg, NULL); break;
+            case 'g': opt.glitch_prob = strtod(optarg, NULL); break;
+            case 'w': opt.glitch_us = strtoul(optarg, NULL, 0); break;
+            case 'd': opt.dropout_prob = strtod(optarg, NULL); break;
+            case 's': opt.skew_percent = strtod(optarg, NULL); break;
+            case 'c': opt.chunk = strtoul(optarg, NULL, 0); break;
+            case 'r': opt.seed = strtoul(optarg, NULL, 0); break;
+            case 'm': opt.decoder_mode = strtol(optarg, NULL, 0); break;
+            case 'b': opt.baseline_mode = strtol(optarg, NULL, 0); break;
+            case 'i': opt.trace_in = optarg; break;
+            case 'o': opt.trace_out = optarg; break;
+            default:
+                print_usage(argv[0]);
+                return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (opt.chunk == 0 || opt.chunk > 2048) {
+        fprintf(stderr, "Chunk size must be within 1 and 2048 half-bits (DCC_HALF_BIT_BUF_LEN)\n");
+        return EXIT_FAILURE;
+    }
+    if (opt.baseline_mode >= 0 && opt.trace_in != NULL) {
+        fprintf(stderr, "Baseline comparison requires a synthesized trace\n");
+        return EXIT_FAILURE;
+    }
+    host_rng_seed(&rng, opt.seed);
+
+    host_hal_reset();
+    core0_host_init();
+    if (opt.decoder_mode >= 0) {
+        set_decoder_mode(opt.decoder_mode);
+    }
+    const uint8_t own_address = CV_ARRAY_RAM[0];
+
+    // Generate or read the trace
+    trace_t trace = {0};
+    packet_t *sent = NULL;
+    if (opt.trace_in != NULL) {
+        if (!read_trace(&trace, opt.trace_in)) return EXIT_FAILURE;
+    }
+    else {
+        sent = calloc(opt.packets, sizeof(packet_t));
+        if (sent == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            return EXIT_FAILURE;
+        }
+        synthesize(&trace, sent, &opt, own_address);
+    }
+    if (opt.trace_out != NULL && !write_trace(&trace, opt.trace_out)) {
+        return EXIT_FAILURE;
+    }
+
+    // Replay
+    replay_result_t r;
+    replay(&trace, sent, &opt, &r);
+
+    // Report
+    const uint64_t bits = trace.length / 2;
+    const double signal_s = r.signal_us / 1e6;
+    const double cpu_s = (r.decode_ns + r.evaluate_ns) / 1e9;
+    const spsc_queue_t *queue = core0_host_packet_queue();
+    printf("Trace:        %zu half-bits, %llu bits, %.3f s of signal\n", trace.length, (unsigned long long) bits, signal_s);
+    const uint32_t expected = sent != NULL ? count_expected(sent, 0, opt.packets) : 0;
+    if (sent != NULL) {
+        printf("Packets:      %u sent, %u for this decoder, %u decoded, %u matched\n", opt.packets, expected, r.decoded,
+               r.matched);
+        printf("Dropped:      %u (%.4f %%)\n", r.dropped, expected ? 100.0 * r.dropped / expected : 0.0);
+        printf("False pos.:   %u (%.4f %% of decoded)\n", r.false_positives,
+               r.decoded ? 100.0 * r.false_positives / r.decoded : 0.0);
+    }
+    else {
+        printf("Packets:      %u decoded\n", r.decoded);
+    }
+    printf("Rejected:     %u by framer, %u by address, %u queue overflows, %u ring buffer overruns\n",
+           core0_host_framer_rejected(), core0_host_framer_filtered(), queue->overflows, core0_host_half_bit_overruns());
+    printf("Decoder:      mode %u, %u glitches merged, %u invalid bits, threshold %u us\n", CV_ARRAY_RAM[175],
+           core0_host_half_bit_glitches(), core0_host_invalid_bits(), core0_host_half_bit_threshold());
+    printf("Signal rate:  %.1f packets/s\n", signal_s > 0 ? r.decoded / signal_s : 0.0);
+    printf("Throughput:   %.0f packets/s (host CPU)\n", cpu_s > 0 ? r.decoded / cpu_s : 0.0);
+    printf("Decode:       %.2f ns/bit\n", bits ? (double) r.decode_ns / bits : 0.0);
+    printf("Evaluate:     %.2f ns/bit, %.1f ns/packet\n", bits ? (double) r.evaluate_ns / bits : 0.0,
+           r.decoded ? (double) r.evaluate_ns / r.decoded : 0.0);
+
+    const bool clean = sent != NULL && opt.jitter_us == 0 && opt.glitch_prob == 0 && opt.dropout_prob == 0 &&
+                       opt.skew_percent == 0;
+    bool failed = clean && (r.dropped > 0 || r.false_positives > 0);
+    if (opt.baseline_mode >= 0) {
+        replay_result_t baseline;
+        set_decoder_mode(opt.baseline_mode);
+        replay(&trace, sent, &opt, &baseline);
+        printf("Baseline:     mode %u, %u dropped (%.4f %%)\n", CV_ARRAY_RAM[175], baseline.dropped,
+               expected ? 100.0 * baseline.dropped / expected : 0.0);
+        failed |= r.dropped > baseline.dropped;
+    }
+
+    free(sent);
+    free(trace.half_bits);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,306 @@
+/*!
+ *
+ * \file decoder_host.h
+ * Host build of the decoder firmware (see host/CMakeLists.txt)
+ *
+ * The firmware sources are compiled unmodified against the SDK subset in host/sdk/host_sdk.h.
+ * This header provides control over the simulated hardware (hal_host.c) and entry points into core0, whose
+ * functions are static and only reachable via core0_host.c. core1 functions can be used directly via core1.h.
+ *
+ */
+
+#pragma once
+#include "host_sdk.h"
+#include "spsc_queue.h"
+
+/**
+ * @def HOST_MAX_REPEATING_TIMERS
+ * @brief Maximum number of repeating timers which can be active at once
+ */
+#define HOST_MAX_REPEATING_TIMERS 8
+/**
+ * @def HOST_NUM_DMA_CHANNELS
+ * @brief Number of simulated DMA channels (same as RP2040)
+ */
+#define HOST_NUM_DMA_CHANNELS 12
+/**
+ * @def HOST_ADC_SAMPLE_TIME_US
+ * @brief Simulated time passing per ADC conversion in us
+ */
+#define HOST_ADC_SAMPLE_TIME_US 2
+/**
+ * @def HOST_PACKET_MAX_BYTES
+ * @brief Maximum length of a DCC packet, same as RING_BUFFER_BYTES (see core0.h)
+ */
+#define HOST_PACKET_MAX_BYTES 6
+
+/**
+ * @brief Callback providing ADC samples to adc_fifo_get_blocking().
+ *
+ * @param input Selected ADC input (see adc_select_input()).
+ * @param ctx User pointer passed to host_adc_set_source().
+ * @return 12-bit ADC sample.
+ */
+typedef uint16_t (*host_adc_source_t)(uint input, void *ctx);
+
+/**
+ * @brief Callback run by pwm_set_gpio_level() before the level of a GPIO changes.
+ *
+ * Allows plant models (see motor_model.h) to integrate up to the current simulated time with the previous levels.
+ *
+ * @param gpio GPIO whose level is set.
+ * @param level New level.
+ * @param ctx User pointer passed to host_pwm_set_hook().
+ */
+typedef void (*host_pwm_hook_t)(uint gpio, uint16_t level, void *ctx);
+
+/**
+ * @brief Resets the simulated hardware: time, flash (erased), PWM, GPIO, ADC, DMA and timers.
+ */
+void host_hal_reset(void);
+
+/**
+ * @brief Returns the simulated time since boot in us.
+ */
+uint64_t host_time_us(void);
+
+/**
+ * @brief Advances the simulated time and runs the callbacks of all repeating timers which became due.
+ *
+ * busy_wait_us(), busy_wait_ms() and ADC conversions advance the time as well.
+ *
+ * @param us Time to advance in us.
+ */
+void host_advance_time_us(uint64_t us);
+
+/**
+ * @brief Sets the value returned by get_core_num().
+ */
+void host_set_core_num(uint core);
+
+/**
+ * @brief Returns the level last set via pwm_set_gpio_level().
+ */
+uint16_t host_pwm_get_level(uint gpio);
+
+/**
+ * @brief Returns the wrap value last set via pwm_set_wrap().
+ */
+uint16_t host_pwm_get_wrap(uint slice);
+
+/**
+ * @brief Sets the callback run before PWM level changes, NULL removes it.
+ */
+void host_pwm_set_hook(host_pwm_hook_t hook, void *ctx);
+
+/**
+ * @brief Returns the output state of all GPIOs set via gpio_put()/gpio_put_masked(), bit n is GPIO n.
+ */
+uint32_t host_gpio_get_all(void);
+
+/**
+ * @brief Sets the source of ADC samples, NULL returns 0 for every sample.
+ */
+void host_adc_set_source(host_adc_source_t source, void *ctx);
+
+/**
+ * @brief Returns the number of erased flash sectors since the last host_hal_reset().
+ */
+uint32_t host_flash_erase_count(void);
+
+/**
+ * @brief Returns the number of programmed flash pages since the last host_hal_reset().
+ */
+uint32_t host_flash_program_count(void);
+
+/**
+ * @brief Simulates a DMA transfer of one 32-bit word into the write address of a channel.
+ *
+ * Honours write increment and address wrapping (channel_config_set_ring()) and decrements the transfer count.
+ * Nothing is written when the transfer count is exhausted.
+ *
+ * @param channel DMA channel.
+ * @param word Transferred data.
+ * @return true when the word was transferred.
+ */
+bool host_dma_push(uint channel, uint32_t word);
+
+/**
+ * @brief State of the pseudo random generator of the host tools (xorshift64*), deterministic across platforms.
+ */
+typedef struct host_rng_t {
+    uint64_t state; /*!< Generator state, never 0 */
+} host_rng_t;
+
+/**
+ * @brief Seeds a pseudo random generator, equal seeds produce equal sequences.
+ */
+void host_rng_seed(host_rng_t *rng, uint64_t seed);
+
+/**
+ * @brief Returns the next 64-bit value of a pseudo random generator.
+ */
+uint64_t host_rng_next64(host_rng_t *rng);
+
+/**
+ * @brief Returns the next 32-bit value of a pseudo random generator (upper half of host_rng_next64()).
+ */
+uint32_t host_rng_next(host_rng_t *rng);
+
+/**
+ * @brief Returns the next value of a pseudo random generator uniformly distributed in [0, 1).
+ */
+double host_rng_uniform(host_rng_t *rng);
+
+/**
+ * @brief Returns the monotonic wall-clock time of the host in ns, for timing the host tools themselves.
+ */
+uint64_t host_now_ns(void);
+
+/**
+ * @brief Initializes core0 like main() does, without launching core1 and without entering the main loop.
+ *
+ * Checks the CVs in flash (writes default CVs to erased flash), initializes motor PWM, outputs, ADC and the
+ * DCC half-bit receiver. Can be called again, e.g. after modifying CVs which are only read during initialization.
+ * Pending flash jobs are completed before, so the CVs are loaded from flash in their current state.
+ */
+void core0_host_init(void);
+
+/**
+ * @brief Writes a CV the same way a write in programming mode does (including special cases, see write_cv_handler()).
+ *
+ * @param cv_index CV index, CV_1 has index 0.
+ * @param cv_data Value to write.
+ */
+void core0_host_write_cv(uint16_t cv_index, uint8_t cv_data);
+
+/**
+ * @brief Passes a measured half-bit duration to core0 as the dcc_rx state machine and its DMA channel would.
+ *
+ * @param duration_us Half-bit duration in us, high and low half-bits alternate starting with a high half-bit.
+ * @return true when the duration was transferred.
+ */
+bool core0_host_push_half_bit(uint32_t duration_us);
+
+/**
+ * @brief Runs one iteration of the core0 main loop: decodes pending half-bits and evaluates at most one packet.
+ *
+ * @return true when a packet was evaluated.
+ */
+bool core0_host_poll(void);
+
+/**
+ * @brief Decodes all pending half-bit durations, detected packets are put into the packet queue.
+ */
+void core0_host_decode(void);
+
+/**
+ * @brief Evaluates the oldest packet of the packet queue and removes it from the queue.
+ *
+ * @param bytes When not NULL, receives the packet bytes in transmission order (at least HOST_PACKET_MAX_BYTES bytes).
+ * @param length When not NULL, receives the number of bytes of the packet.
+ * @return true when a packet was evaluated, false when the queue was empty.
+ */
+bool core0_host_evaluate_next(uint8_t *bytes, size_t *length);
+
+/**
+ * @brief Feeds a single decoded bit into the DCC packet framer.
+ */
+void core0_host_process_dcc_bit(bool bit);
+
+/**
+ * @brief Evaluates a DCC packet directly, bypassing framer and packet queue.
+ *
+ * @param bytes Packet bytes in transmission order (address byte first, error detection byte last).
+ * @param length Number of bytes, at most HOST_PACKET_MAX_BYTES.
+ */
+void core0_host_evaluate_packet(const uint8_t *bytes, size_t length);
+
+/**
+ * @brief Returns the queue passing packets from the framer to the packet evaluation.
+ */
+spsc_queue_t *core0_host_packet_queue(void);
+
+/**
+ * @brief Returns the number of packets discarded by the framer (checksum errors, too short).
+ */
+uint32_t core0_host_framer_rejected(void);
+
+/**
+ * @brief Returns the number of packets discarded by the address fast path of the framer (packets for other decoders).
+ */
+uint32_t core0_host_framer_filtered(void);
+
+/**
+ * @brief Checks whether a packet passes the address fast path of the framer with the current CVs.
+ *
+ * @param bytes Packet bytes in transmission order.
+ * @param length Number of bytes.
+ * @return true if the packet is queued for evaluation when received, false if it is discarded as foreign packet.
+ */
+bool core0_host_address_accepted(const uint8_t *bytes, size_t length);
+
+/**
+ * @brief Completes all queued flash jobs (CV writes), which are otherwise only executed by core0_host_poll().
+ */
+void core0_host_flush_flash(void);
+
+/**
+ * @brief Returns the number of submitted flash jobs which are not completed yet.
+ */
+uint32_t core0_host_flash_jobs_pending(void);
+
+/**
+ * @brief Returns the number of flash jobs which failed due to flash errors.
+ */
+uint32_t core0_host_flash_jobs_failed(void);
+
+/**
+ * @brief Returns the active sector of the CV journal, -1 when there is none (see cv_journal_t).
+ */
+int core0_host_cv_journal_sector(void);
+
+/**
+ * @brief Returns the number of used records of the active journal sector, including invalid ones.
+ */
+uint32_t core0_host_cv_journal_records(void);
+
+/**
+ * @brief Returns the number of records fitting into a journal sector (CV_JOURNAL_RECORDS).
+ */
+uint32_t core0_host_cv_journal_capacity(void);
+
+/**
+ * @brief Returns the number of records with a wrong check byte found while loading the journal.
+ */
+uint32_t core0_host_cv_journal_invalid_records(void);
+
+/**
+ * @brief Returns the flash offset of a record of the active journal sector, e.g. to simulate a torn write.
+ */
+uint32_t core0_host_cv_journal_record_offset(uint32_t record);
+
+/**
+ * @brief Returns the flash offset of the plain CV array written by firmware without journal (CV_LEGACY_OFFSET).
+ */
+uint32_t core0_host_cv_legacy_offset(void);
+
+/**
+ * @brief Returns the number of half-bit ring buffer overruns (see dcc_half_bit_stats_t).
+ */
+uint32_t core0_host_half_bit_overruns(void);
+
+/**
+ * @brief Returns the number of glitches merged by the half-bit decoder (strict mode, see dcc_half_bit_stats_t).
+ */
+uint32_t core0_host_half_bit_glitches(void);
+
+/**
+ * @brief Returns the number of invalid bits detected by the half-bit decoder (strict mode, see dcc_half_bit_stats_t).
+ */
+uint32_t core0_host_invalid_bits(void);
+
+/**
+ * @brief Returns the current "1"/"0" half-bit threshold in us.
+ */
+uint32_t core0_host_half_bit_threshold(void);
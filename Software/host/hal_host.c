@@ -0,0 +1,724 @@
+//////////////////////////
+//   RP2040-Decoder     //
+// Gabriel Koppenstein  //
+//     hal_host.c       //
+//////////////////////////
+
+// Simulated hardware for the host build, implements the SDK subset declared in host_sdk.h
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <time.h>
+#include "decoder_host.h"
+
+#define HOST_NUM_GPIOS 30
+#define HOST_NUM_PWM_SLICES 8
+
+uint8_t host_flash[PICO_FLASH_SIZE_BYTES];
+pio_hw_t host_pio0;
+adc_hw_t host_adc_hw;
+
+typedef struct host_timer_t {
+    repeating_timer_callback_t callback;
+    struct repeating_timer *rt;
+    uint64_t next_us;
+} host_timer_t;
+
+typedef struct host_dma_channel_t {
+    dma_channel_hw_t hw;
+    bool claimed;
+    bool write_increment;
+    uint ring_bits;          // 0 -> no wrapping
+    uint size;               // bytes per transfer
+    uint dreq;               // pacing data request, see channel_config_set_dreq()
+    bool read_increment;
+    uintptr_t read_addr;
+    uintptr_t write_base;    // write address of the last configuration
+    uint32_t write_offset;   // byte offset relative to write_base
+} host_dma_channel_t;
+
+static struct {
+    uint64_t time_us;
+    uint core_num;
+    uint16_t pwm_level[HOST_NUM_GPIOS];
+    uint16_t pwm_wrap[HOST_NUM_PWM_SLICES];
+    uint8_t pwm_clkdiv[HOST_NUM_PWM_SLICES];
+    uint32_t pwm_irq_mask;
+    uint64_t pwm_next_wrap_ns[HOST_NUM_PWM_SLICES];
+    bool pwm_irq_enabled;
+    irq_handler_t pwm_irq_handler;
+    uint32_t gpio_out;
+    host_pwm_hook_t pwm_hook;
+    void *pwm_hook_ctx;
+    host_adc_source_t adc_source;
+    void *adc_ctx;
+    uint32_t flash_erase_count;
+    uint32_t flash_program_count;
+    host_timer_t timers[HOST_MAX_REPEATING_TIMERS];
+    bool timers_running;
+    uint64_t next_event_ns;  // earliest timer or PWM wrap interrupt, valid while next_event_valid
+    bool next_event_valid;   // cleared whenever timers or PWM wrap interrupts change
+    host_dma_channel_t dma[HOST_NUM_DMA_CHANNELS];
+    uint pio_sm_claimed;
+} hal;
+
+
+// Period of a PWM slice in ns at 125MHz system clock
+static uint64_t host_pwm_period_ns(uint const slice) {
+    const uint64_t clkdiv = hal.pwm_clkdiv[slice] ? hal.pwm_clkdiv[slice] : 256;
+    return ((uint64_t) hal.pwm_wrap[slice] + 1) * clkdiv * 8;
+}
+
+// Finds the earliest timer or PWM wrap interrupt, UINT64_MAX if there is none. A timer wins ties.
+static uint64_t host_next_event_ns(host_timer_t **const timer, int *const wrap_slice) {
+    uint64_t next_ns = UINT64_MAX;
+    *timer = NULL;
+    *wrap_slice = -1;
+    for (uint i = 0; i < HOST_MAX_REPEATING_TIMERS; i++) {
+        host_timer_t *t = &hal.timers[i];
+        if (t->callback != NULL && t->next_us * 1000 < next_ns) {
+            *timer = t;
+            next_ns = t->next_us * 1000;
+        }
+    }
+    if (hal.pwm_irq_enabled && hal.pwm_irq_handler != NULL) {
+        for (uint i = 0; i < HOST_NUM_PWM_SLICES; i++) {
+            if ((hal.pwm_irq_mask & (1u << i)) && hal.pwm_next_wrap_ns[i] < next_ns) {
+                *wrap_slice = (int) i;
+                next_ns = hal.pwm_next_wrap_ns[i];
+            }
+        }
+    }
+    return next_ns;
+}
+
+
+//////////////////////
+// Host control API //
+//////////////////////
+
+void host_hal_reset(void) {
+    memset(&hal, 0, sizeof(hal));
+    memset(host_flash, 0xFF, sizeof(host_flash));
+    memset(&host_pio0, 0, sizeof(host_pio0));
+    memset((void *) &host_adc_hw, 0, sizeof(host_adc_hw));
+}
+
+uint64_t host_time_us(void) {
+    return hal.time_us;
+}
+
+void host_advance_time_us(uint64_t const us) {
+    const uint64_t end_us = hal.time_us + us;
+    // Timer callbacks may wait themselves, don't fire timers recursively. Most advances (ADC conversions) end before
+    // the next event, which is cached until timers or interrupts change.
+    if (hal.timers_running || (hal.next_event_valid && hal.next_event_ns > end_us * 1000)) {
+        hal.time_us = end_us;
+        return;
+    }
+    hal.timers_running = true;
+    while (true) {
+        // Fire the earliest due timer or PWM wrap interrupt until none is due before end_us
+        host_timer_t *next;
+        int wrap_slice;
+        const uint64_t next_ns = host_next_event_ns(&next, &wrap_slice);
+        if (next_ns > end_us * 1000) {
+            hal.next_event_ns = next_ns;
+            hal.next_event_valid = true;
+            break;
+        }
+        if (next_ns / 1000 > hal.time_us) {
+            hal.time_us = next_ns / 1000;
+        }
+        if (wrap_slice >= 0) {
+            hal.pwm_next_wrap_ns[wrap_slice] += host_pwm_period_ns(wrap_slice);
+            hal.next_event_valid = false;
+            hal.pwm_irq_handler();
+            continue;
+        }
+        hal.next_event_valid = false;
+        const int64_t delay_us = next->rt->delay_us;
+        next->next_us += (uint64_t) (delay_us < 0 ? -delay_us : delay_us);
+        if (!next->callback(next->rt)) {
+            next->callback = NULL;
+        }
+    }
+    hal.timers_running = false;
+    hal.time_us = end_us;
+}
+
+void host_set_core_num(uint const core) {
+    hal.core_num = core;
+}
+
+uint16_t host_pwm_get_level(uint const gpio) {
+    return gpio < HOST_NUM_GPIOS ? hal.pwm_level[gpio] : 0;
+}
+
+uint16_t host_pwm_get_wrap(uint const slice) {
+    return slice < HOST_NUM_PWM_SLICES ? hal.pwm_wrap[slice] : 0;
+}
+
+void host_pwm_set_hook(host_pwm_hook_t const hook, void *const ctx) {
+    hal.pwm_hook = hook;
+    hal.pwm_hook_ctx = ctx;
+}
+
+uint32_t host_gpio_get_all(void) {
+    return hal.gpio_out;
+}
+
+void host_adc_set_source(host_adc_source_t const source, void *const ctx) {
+    hal.adc_source = source;
+    hal.adc_ctx = ctx;
+}
+
+uint32_t host_flash_erase_count(void) {
+    return hal.flash_erase_count;
+}
+
+uint32_t host_flash_program_count(void) {
+    return hal.flash_program_count;
+}
+
+bool host_dma_push(uint const channel, uint32_t const word) {
+    host_dma_channel_t *ch = &hal.dma[channel];
+    if (ch->hw.transfer_count == 0 || ch->write_base == 0) {
+        return false;
+    }
+    // Little endian, the lowest bytes of word are transferred for 8-bit and 16-bit transfers
+    memcpy((void *) (ch->write_base + ch->write_offset), &word, ch->size);
+    if (ch->write_increment) {
+        ch->write_offset += ch->size;
+        if (ch->ring_bits != 0) {
+            ch->write_offset &= (1u << ch->ring_bits) - 1;
+        }
+    }
+    ch->hw.write_addr = (uint32_t) (ch->write_base + ch->write_offset);
+    ch->hw.transfer_count--;
+    return true;
+}
+
+void host_rng_seed(host_rng_t *const rng, uint64_t const seed) {
+    // xorshift gets stuck at 0
+    rng->state = 0x9E3779B97F4A7C15ull ^ seed;
+    if (rng->state == 0) {
+        rng->state = 0x9E3779B97F4A7C15ull;
+    }
+}
+
+uint64_t host_rng_next64(host_rng_t *const rng) {
+    rng->state ^= rng->state >> 12;
+    rng->state ^= rng->state << 25;
+    rng->state ^= rng->state >> 27;
+    return rng->state * 0x2545F4914F6CDD1DULL;
+}
+
+uint32_t host_rng_next(host_rng_t *const rng) {
+    return (uint32_t) (host_rng_next64(rng) >> 32);
+}
+
+double host_rng_uniform(host_rng_t *const rng) {
+    // 53 bits, the mantissa of a double
+    return (double) (host_rng_next64(rng) >> 11) / 9007199254740992.0;
+}
+
+uint64_t host_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+
+//////////////////
+// time, stdlib //
+//////////////////
+
+absolute_time_t get_absolute_time(void) {
+    return hal.time_us;
+}
+
+int64_t absolute_time_diff_us(absolute_time_t const from, absolute_time_t const to) {
+    return (int64_t) (to - from);
+}
+
+uint32_t to_ms_since_boot(absolute_time_t const t) {
+    return (uint32_t) (t / 1000);
+}
+
+uint32_t time_us_32(void) {
+    return (uint32_t) hal.time_us;
+}
+
+uint64_t time_us_64(void) {
+    return hal.time_us;
+}
+
+uint get_core_num(void) {
+    return hal.core_num;
+}
+
+void busy_wait_us(uint64_t const us) {
+    host_advance_time_us(us);
+}
+
+void busy_wait_ms(uint32_t const ms) {
+    host_advance_time_us((uint64_t) ms * 1000);
+}
+
+void sleep_us(uint64_t const us) {
+    host_advance_time_us(us);
+}
+
+void sleep_ms(uint32_t const ms) {
+    host_advance_time_us((uint64_t) ms * 1000);
+}
+
+void panic(const char *const fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+    abort();
+}
+
+bool stdio_init_all(void) {
+    return true;
+}
+
+int getchar_timeout_us(__unused uint32_t timeout_us) {
+    return PICO_ERROR_TIMEOUT;
+}
+
+int putchar_raw(int const c) {
+    return putchar(c);
+}
+
+
+//////////
+// gpio //
+//////////
+
+void gpio_init(__unused uint gpio) {}
+void gpio_init_mask(__unused uint32_t mask) {}
+void gpio_set_dir(__unused uint gpio, __unused bool out) {}
+void gpio_set_dir_out_masked(__unused uint32_t mask) {}
+void gpio_pull_up(__unused uint gpio) {}
+void gpio_set_function(__unused uint gpio, __unused enum gpio_function fn) {}
+void gpio_set_irq_callback(__unused gpio_irq_callback_t cb) {}
+void gpio_set_irq_enabled(__unused uint gpio, __unused uint32_t events, __unused bool enabled) {}
+void irq_set_enabled(uint const num, bool const enabled) {
+    if (num == PWM_IRQ_WRAP) hal.pwm_irq_enabled = enabled;
+    hal.next_event_valid = false;
+}
+
+void irq_set_exclusive_handler(uint const num, irq_handler_t const handler) {
+    if (num == PWM_IRQ_WRAP) hal.pwm_irq_handler = handler;
+    hal.next_event_valid = false;
+}
+
+void gpio_put(uint const gpio, bool const value) {
+    if (value) hal.gpio_out |= 1u << gpio;
+    else hal.gpio_out &= ~(1u << gpio);
+}
+
+void gpio_put_masked(uint32_t const mask, uint32_t const value) {
+    hal.gpio_out = (hal.gpio_out & ~mask) | (value & mask);
+}
+
+
+/////////
+// pwm //
+/////////
+
+uint pwm_get_dreq(uint const slice) {
+    return DREQ_PWM_WRAP0 + slice;
+}
+
+uint pwm_gpio_to_slice_num(uint const gpio) {
+    return (gpio >> 1u) & 7u;
+}
+
+uint pwm_gpio_to_channel(uint const gpio) {
+    return gpio & 1u;
+}
+
+void pwm_set_gpio_level(uint const gpio, uint16_t const level) {
+    if (hal.pwm_hook != NULL) {
+        hal.pwm_hook(gpio, level, hal.pwm_hook_ctx);
+    }
+    if (gpio < HOST_NUM_GPIOS) hal.pwm_level[gpio] = level;
+}
+
+void pwm_set_wrap(uint const slice, uint16_t const wrap) {
+    if (slice < HOST_NUM_PWM_SLICES) hal.pwm_wrap[slice] = wrap;
+}
+
+void pwm_set_clkdiv_int_frac(uint const slice, uint8_t const integer, __unused uint8_t fract) {
+    if (slice < HOST_NUM_PWM_SLICES) hal.pwm_clkdiv[slice] = integer;
+}
+
+void pwm_set_irq_enabled(uint const slice, bool const enabled) {
+    if (slice >= HOST_NUM_PWM_SLICES) return;
+    if (enabled) {
+        // The counters are assumed to run since boot, the first interrupt is at the next wrap
+        const uint64_t period_ns = host_pwm_period_ns(slice);
+        hal.pwm_next_wrap_ns[slice] = (hal.time_us * 1000 / period_ns + 1) * period_ns;
+        hal.pwm_irq_mask |= 1u << slice;
+    }
+    else {
+        hal.pwm_irq_mask &= ~(1u << slice);
+    }
+    hal.next_event_valid = false;
+}
+
+void pwm_clear_irq(__unused uint slice) {}
+void pwm_set_enabled(__unused uint slice, __unused bool enabled) {}
+
+
+/////////
+// adc //
+/////////
+
+void adc_init(void) {}
+void adc_gpio_init(__unused uint gpio) {}
+void adc_fifo_setup(__unused bool en, __unused bool dreq_en, __unused uint16_t dreq_thresh, __unused bool err_in_fifo, __unused bool byte_shift) {}
+void adc_fifo_drain(void) {}
+
+void adc_run(bool const run) {
+    host_adc_hw.cs = run ? (host_adc_hw.cs | ADC_CS_START_MANY_BITS) : (host_adc_hw.cs & ~ADC_CS_START_MANY_BITS);
+}
+
+void adc_select_input(uint const input) {
+    host_adc_hw.cs = (host_adc_hw.cs & ~ADC_CS_AINSEL_BITS) | ((input << ADC_CS_AINSEL_LSB) & ADC_CS_AINSEL_BITS);
+}
+
+uint16_t adc_fifo_get_blocking(void) {
+    host_advance_time_us(HOST_ADC_SAMPLE_TIME_US);
+    if (hal.adc_source == NULL) {
+        return 0;
+    }
+    return hal.adc_source((host_adc_hw.cs & ADC_CS_AINSEL_BITS) >> ADC_CS_AINSEL_LSB, hal.adc_ctx) & 0x0FFF;
+}
+
+
+///////////
+// flash //
+///////////
+
+void flash_range_erase(uint32_t const offset, size_t const count) {
+    if (offset % FLASH_SECTOR_SIZE != 0 || count % FLASH_SECTOR_SIZE != 0 || offset + count > PICO_FLASH_SIZE_BYTES) {
+        panic("flash_range_erase: invalid range 0x%x/%zu", offset, count);
+    }
+    memset(&host_flash[offset], 0xFF, count);
+    hal.flash_erase_count += count / FLASH_SECTOR_SIZE;
+}
+
+void flash_range_program(uint32_t const offset, const uint8_t *const data, size_t const count) {
+    if (offset % FLASH_PAGE_SIZE != 0 || count % FLASH_PAGE_SIZE != 0 || offset + count > PICO_FLASH_SIZE_BYTES) {
+        panic("flash_range_program: invalid range 0x%x/%zu", offset, count);
+    }
+    // Programming can only clear bits, same as NOR flash
+    for (size_t i = 0; i < count; i++) {
+        host_flash[offset + i] &= data[i];
+    }
+    hal.flash_program_count += count / FLASH_PAGE_SIZE;
+}
+
+void flash_do_cmd(const uint8_t *const txbuf, uint8_t *const rxbuf, size_t const count) {
+    memset(rxbuf, 0, count);
+    // JEDEC ID of a winbond flash with PICO_FLASH_SIZE_BYTES capacity
+    if (count >= 4 && txbuf[0] == 0x9F) {
+        uint8_t capacity_bits = 0;
+        while ((1u << capacity_bits) < PICO_FLASH_SIZE_BYTES) capacity_bits++;
+        rxbuf[1] = 0xEF;
+        rxbuf[2] = 0x40;
+        rxbuf[3] = capacity_bits;
+    }
+}
+
+int flash_safe_execute(void (*const func)(void *), void *const param, __unused uint32_t timeout_ms) {
+    func(param);
+    return PICO_OK;
+}
+
+bool flash_safe_execute_core_init(void) {
+    return true;
+}
+
+
+///////////////////////////////////////
+// watchdog, exception and multicore //
+///////////////////////////////////////
+
+void watchdog_update(void) {}
+void watchdog_enable(__unused uint32_t delay_ms, __unused bool pause_on_debug) {}
+void multicore_launch_core1(__unused void (*entry)(void)) {}
+
+bool watchdog_caused_reboot(void) {
+    return false;
+}
+
+void watchdog_reboot(__unused uint32_t pc, __unused uint32_t sp, __unused uint32_t delay_ms) {
+    panic("watchdog_reboot called");
+}
+
+exception_handler_t exception_set_exclusive_handler(__unused int num, __unused exception_handler_t handler) {
+    return NULL;
+}
+
+
+///////////
+// timer //
+///////////
+
+bool add_repeating_timer_us(int64_t const delay_us, repeating_timer_callback_t const callback, void *const user_data,
+                            struct repeating_timer *const out) {
+    for (uint i = 0; i < HOST_MAX_REPEATING_TIMERS; i++) {
+        host_timer_t *t = &hal.timers[i];
+        if (t->callback == NULL) {
+            out->delay_us = delay_us;
+            out->user_data = user_data;
+            t->callback = callback;
+            t->rt = out;
+            t->next_us = hal.time_us + (uint64_t) (delay_us < 0 ? -delay_us : delay_us);
+            hal.next_event_valid = false;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool add_repeating_timer_ms(int32_t const delay_ms, repeating_timer_callback_t const callback, void *const user_data,
+                            struct repeating_timer *const out) {
+    return add_repeating_timer_us((int64_t) delay_ms * 1000, callback, user_data, out);
+}
+
+bool cancel_repeating_timer(struct repeating_timer *const timer) {
+    for (uint i = 0; i < HOST_MAX_REPEATING_TIMERS; i++) {
+        if (hal.timers[i].callback != NULL && hal.timers[i].rt == timer) {
+            hal.timers[i].callback = NULL;
+            hal.next_event_valid = false;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/////////
+// pio //
+/////////
+
+uint pio_add_program(__unused PIO pio, __unused const pio_program_t *program) {
+    return 0;
+}
+
+int pio_claim_unused_sm(__unused PIO pio, bool const required) {
+    for (uint sm = 0; sm < 4; sm++) {
+        if (!(hal.pio_sm_claimed & (1u << sm))) {
+            hal.pio_sm_claimed |= 1u << sm;
+            return (int) sm;
+        }
+    }
+    if (required) panic("No PIO state machine available");
+    return -1;
+}
+
+void pio_sm_unclaim(__unused PIO pio, uint const sm) {
+    hal.pio_sm_claimed &= ~(1u << sm);
+}
+
+pio_sm_config pio_get_default_sm_config(void) {
+    return (pio_sm_config) {0};
+}
+
+void sm_config_set_wrap(__unused pio_sm_config *c, __unused uint wrap_target, __unused uint wrap) {}
+void sm_config_set_in_pins(__unused pio_sm_config *c, __unused uint in_base) {}
+void sm_config_set_jmp_pin(__unused pio_sm_config *c, __unused uint pin) {}
+void sm_config_set_in_shift(__unused pio_sm_config *c, __unused bool shift_right, __unused bool autopush, __unused uint push_threshold) {}
+void sm_config_set_fifo_join(__unused pio_sm_config *c, __unused enum pio_fifo_join join) {}
+void sm_config_set_clkdiv(__unused pio_sm_config *c, __unused float div) {}
+void pio_sm_set_consecutive_pindirs(__unused PIO pio, __unused uint sm, __unused uint pin_base, __unused uint pin_count, __unused bool is_out) {}
+void pio_sm_init(__unused PIO pio, __unused uint sm, __unused uint initial_pc, __unused const pio_sm_config *config) {}
+void pio_sm_set_enabled(__unused PIO pio, __unused uint sm, __unused bool enabled) {}
+
+uint pio_get_dreq(__unused PIO pio, uint const sm, bool const is_tx) {
+    return sm + (is_tx ? 0 : 4);
+}
+
+uint pio_get_index(__unused PIO pio) {
+    return 0;
+}
+
+
+////////////
+// clocks //
+////////////
+
+uint32_t clock_get_hz(__unused enum clock_index clk_index) {
+    return 125000000;
+}
+
+
+/////////////
+// systick //
+/////////////
+
+systick_hw_t *host_systick_hw(void) {
+    // Counts clk_sys cycles (125 per simulated us) down from rvr
+    static systick_hw_t systick;
+    if (systick.csr & M0PLUS_SYST_CSR_ENABLE_BITS) {
+        systick.cvr = systick.rvr - (uint32_t) ((hal.time_us * 125) % ((uint64_t) systick.rvr + 1));
+    }
+    return &systick;
+}
+
+
+//////////
+// sync //
+//////////
+
+void __sev(void) {}
+
+void __wfe(void) {
+    // Sleep until the next timer callback or PWM wrap interrupt, the only event sources of the host build
+    host_timer_t *timer;
+    int wrap_slice;
+    const uint64_t next_ns = hal.next_event_valid ? hal.next_event_ns : host_next_event_ns(&timer, &wrap_slice);
+    if (next_ns != UINT64_MAX) {
+        // Round up to the simulated time resolution of 1us
+        const uint64_t next_us = (next_ns + 999) / 1000;
+        host_advance_time_us(next_us > hal.time_us ? next_us - hal.time_us : 0);
+    }
+}
+
+
+/////////
+// dma //
+/////////
+
+dma_channel_hw_t *dma_channel_hw_addr(uint const channel) {
+    return &hal.dma[channel].hw;
+}
+
+int dma_claim_unused_channel(bool const required) {
+    for (uint i = 0; i < HOST_NUM_DMA_CHANNELS; i++) {
+        if (!hal.dma[i].claimed) {
+            hal.dma[i].claimed = true;
+            return (int) i;
+        }
+    }
+    if (required) panic("No DMA channel available");
+    return -1;
+}
+
+void dma_channel_unclaim(uint const channel) {
+    hal.dma[channel].claimed = false;
+}
+
+// Bits of dma_channel_config.ctrl used by the host build
+#define HOST_DMA_CTRL_WRITE_INCR (1u << 0)
+#define HOST_DMA_CTRL_RING_WRITE (1u << 1)
+#define HOST_DMA_CTRL_RING_SIZE_LSB 2u
+#define HOST_DMA_CTRL_RING_SIZE_MASK (0xFu << HOST_DMA_CTRL_RING_SIZE_LSB)
+#define HOST_DMA_CTRL_READ_INCR (1u << 6)
+#define HOST_DMA_CTRL_SIZE_LSB 7u
+#define HOST_DMA_CTRL_SIZE_MASK (0x3u << HOST_DMA_CTRL_SIZE_LSB)
+#define HOST_DMA_CTRL_DREQ_LSB 9u
+#define HOST_DMA_CTRL_DREQ_MASK (0x3Fu << HOST_DMA_CTRL_DREQ_LSB)
+#define HOST_DREQ_FORCE 0x3Fu
+
+dma_channel_config dma_channel_get_default_config(__unused uint channel) {
+    // Same defaults as the Pico SDK: 32-bit transfers, read increment, unpaced
+    return (dma_channel_config) {HOST_DMA_CTRL_READ_INCR | (DMA_SIZE_32 << HOST_DMA_CTRL_SIZE_LSB) | (HOST_DREQ_FORCE << HOST_DMA_CTRL_DREQ_LSB)};
+}
+
+void channel_config_set_transfer_data_size(dma_channel_config *const c, enum dma_channel_transfer_size const size) {
+    c->ctrl = (c->ctrl & ~HOST_DMA_CTRL_SIZE_MASK) | ((uint32_t) size << HOST_DMA_CTRL_SIZE_LSB);
+}
+
+void channel_config_set_read_increment(dma_channel_config *const c, bool const incr) {
+    c->ctrl = incr ? (c->ctrl | HOST_DMA_CTRL_READ_INCR) : (c->ctrl & ~HOST_DMA_CTRL_READ_INCR);
+}
+
+void channel_config_set_dreq(dma_channel_config *const c, uint const dreq) {
+    c->ctrl = (c->ctrl & ~HOST_DMA_CTRL_DREQ_MASK) | ((dreq << HOST_DMA_CTRL_DREQ_LSB) & HOST_DMA_CTRL_DREQ_MASK);
+}
+
+void channel_config_set_chain_to(__unused dma_channel_config *c, __unused uint chain_to) {}
+
+void channel_config_set_write_increment(dma_channel_config *const c, bool const incr) {
+    c->ctrl = incr ? (c->ctrl | HOST_DMA_CTRL_WRITE_INCR) : (c->ctrl & ~HOST_DMA_CTRL_WRITE_INCR);
+}
+
+void channel_config_set_ring(dma_channel_config *const c, bool const write, uint const size_bits) {
+    c->ctrl &= ~(HOST_DMA_CTRL_RING_WRITE | HOST_DMA_CTRL_RING_SIZE_MASK);
+    c->ctrl |= (write ? HOST_DMA_CTRL_RING_WRITE : 0) | ((size_bits << HOST_DMA_CTRL_RING_SIZE_LSB) & HOST_DMA_CTRL_RING_SIZE_MASK);
+}
+
+static uint32_t host_dma_read(host_dma_channel_t *const ch) {
+    uint32_t word = 0;
+    memcpy(&word, (const void *) ch->read_addr, ch->size);
+    if (ch->read_increment) {
+        ch->read_addr += ch->size;
+    }
+    return word;
+}
+
+static void host_dma_run(uint const channel) {
+    // Executes the transfers which are possible right now. Unpaced channels and channels paced by a PWM wrap complete
+    // at once (the simulated PWM slices wrap immediately). Channels paced by the ADC transfer samples while the ADC
+    // is running. Data requests of PIO state machines are simulated by host_dma_push().
+    host_dma_channel_t *ch = &hal.dma[channel];
+    while (ch->hw.transfer_count != 0 && ch->write_base != 0) {
+        uint32_t word;
+        if (ch->dreq == HOST_DREQ_FORCE || (ch->dreq >= DREQ_PWM_WRAP0 && ch->dreq < DREQ_PWM_WRAP0 + HOST_NUM_PWM_SLICES)) {
+            word = host_dma_read(ch);
+        }
+        else if (ch->dreq == DREQ_ADC && (host_adc_hw.cs & ADC_CS_START_MANY_BITS)) {
+            word = adc_fifo_get_blocking();
+        }
+        else {
+            return;
+        }
+        host_dma_push(channel, word);
+    }
+}
+
+void dma_channel_configure(uint const channel, const dma_channel_config *const config, volatile void *const write_addr,
+                           const volatile void *const read_addr, uint const transfer_count, bool const trigger) {
+    host_dma_channel_t *ch = &hal.dma[channel];
+    ch->size = 1u << ((config->ctrl & HOST_DMA_CTRL_SIZE_MASK) >> HOST_DMA_CTRL_SIZE_LSB);
+    ch->dreq = (config->ctrl & HOST_DMA_CTRL_DREQ_MASK) >> HOST_DMA_CTRL_DREQ_LSB;
+    ch->read_increment = config->ctrl & HOST_DMA_CTRL_READ_INCR;
+    ch->read_addr = (uintptr_t) read_addr;
+    ch->write_increment = config->ctrl & HOST_DMA_CTRL_WRITE_INCR;
+    ch->ring_bits = (config->ctrl & HOST_DMA_CTRL_RING_WRITE) ? (config->ctrl & HOST_DMA_CTRL_RING_SIZE_MASK) >> HOST_DMA_CTRL_RING_SIZE_LSB : 0;
+    ch->write_base = (uintptr_t) write_addr;
+    ch->write_offset = 0;
+    ch->hw.write_addr = (uint32_t) ch->write_base;
+    ch->hw.transfer_count = transfer_count;
+    if (trigger) {
+        host_dma_run(channel);
+    }
+}
+
+void dma_channel_set_trans_count(uint const channel, uint32_t const trans_count, bool const trigger) {
+    hal.dma[channel].hw.transfer_count = trans_count;
+    if (trigger) {
+        host_dma_run(channel);
+    }
+}
+
+bool dma_channel_is_busy(uint const channel) {
+    host_dma_run(channel);
+    return hal.dma[channel].hw.transfer_count != 0;
+}
+
+void dma_channel_wait_for_finish_blocking(uint const channel) {
+    if (dma_channel_is_busy(channel)) {
+        panic("DMA channel %u waits for a data request which never occurs", channel);
+    }
+}
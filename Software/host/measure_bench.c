@@ -0,0 +1,132 @@
+//////////////////////////
+//   RP2040-Decoder     //
+// Gabriel Koppenstein  //
+//   measure_bench.c    //
+//////////////////////////
+
+// Benchmarks the post-processing of back-EMF samples done by measure() in every control tick
+//
+// Compares get_trimmed_mean() (quickselect) against the previously used full insertion sort on random sample buffers
+// of 16, 64 and 255 samples (the range of CV_61), checks that both produce the same result and reports the time per
+// control tick on the host CPU. The samples are a noisy back-EMF level with occasional outliers, like a motor with
+// commutation spikes. As the times are measured on the host, only the ratio between both implementations carries
+// over to the RP2040. Exits with a failure if any result differs.
+//
+// Usage: measure_bench [options], see print_usage()
+
+#include <stdlib.h>
+#include <unistd.h>
+#include "decoder_host.h"
+#include "core1.h"
+
+static host_rng_t rng;
+
+static q16_t insertion_sort_mean(uint16_t *const adc_val, uint8_t const total_iterations,
+                                 uint8_t const l_side_arr_cutoff, uint8_t const r_side_arr_cutoff) {
+    // Reference: post-processing of measure() before get_trimmed_mean()
+    uint32_t sum = 0;
+    for (int32_t i = 1; i < total_iterations; ++i) {
+        const uint16_t key = adc_val[i];
+        int32_t j = i - 1;
+        while (j >= 0 && adc_val[j] > key) {
+            adc_val[j + 1] = adc_val[j];
+            j--;
+        }
+        adc_val[j + 1] = key;
+    }
+    for (int32_t i = l_side_arr_cutoff; i < total_iterations - r_side_arr_cutoff; ++i) {
+        sum += adc_val[i];
+    }
+    return (q16_t) (((uint64_t) sum << 16) / (total_iterations - (l_side_arr_cutoff + r_side_arr_cutoff)));
+}
+
+static void fill_samples(uint16_t *const samples, uint32_t const n) {
+    // Level between 200 and 3000 with +-32 noise, 5% outliers anywhere in the 12-bit range
+    const uint32_t level = 200 + host_rng_next(&rng) % 2800;
+    for (uint32_t i = 0; i < n; i++) {
+        samples[i] = (host_rng_next(&rng) % 100 < 5) ? host_rng_next(&rng) & 0x0FFF : level - 32 + host_rng_next(&rng) % 65;
+    }
+}
+
+static void print_usage(const char *const name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -t <ticks>     number of simulated control ticks per sample count (default 20000)\n"
+            "  -c <percent>   samples discarded on each side in %% of the sample count (default 15)\n"
+            "  -r <seed>      random seed (default 1)\n"
+            "  -h             show this help\n",
+            name);
+}
+
+int main(int argc, char **argv) {
+    uint32_t ticks = 20000;
+    uint32_t cutoff_percent = 15;
+    uint32_t seed = 1;
+    int c;
+    while ((c = getopt(argc, argv, "t:c:r:h")) != -1) {
+        switch (c) {
+            case 't': ticks = strtoul(optarg, NULL, 0); break;
+            case 'c': cutoff_percent = strtoul(optarg, NULL, 0); break;
+            case 'r': seed = strtoul(optarg, NULL, 0); break;
+            default:
+                print_usage(argv[0]);
+                return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (ticks == 0 || cutoff_percent >= 50) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const uint8_t sample_counts[] = {16, 64, 255};
+    uint16_t *const samples = malloc((size_t) ticks * 255 * sizeof(uint16_t));
+    uint16_t *const reference = malloc((size_t) ticks * 255 * sizeof(uint16_t));
+    if (samples == NULL || reference == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    uint32_t total_mismatches = 0;
+    printf("Samples  Cutoff  Insertion sort  Quickselect  Speedup  Mismatches\n");
+    for (size_t s = 0; s < sizeof(sample_counts); s++) {
+        const uint8_t n = sample_counts[s];
+        const uint8_t cutoff = (n * cutoff_percent) / 100;
+        host_rng_seed(&rng, seed);
+        for (uint32_t t = 0; t < ticks; t++) {
+            fill_samples(&samples[t * n], n);
+        }
+        memcpy(reference, samples, (size_t) ticks * n * sizeof(uint16_t));
+
+        // Every tick works on its own buffer, like measure() on a freshly filled DMA buffer
+        q16_t *const results = malloc((size_t) ticks * 2 * sizeof(q16_t));
+        if (results == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            free(samples);
+            free(reference);
+            return EXIT_FAILURE;
+        }
+        uint64_t t0 = host_now_ns();
+        for (uint32_t t = 0; t < ticks; t++) {
+            results[t] = insertion_sort_mean(&reference[t * n], n, cutoff, cutoff);
+        }
+        uint64_t t1 = host_now_ns();
+        const double sort_ns = (double) (t1 - t0) / ticks;
+        t0 = host_now_ns();
+        for (uint32_t t = 0; t < ticks; t++) {
+            results[ticks + t] = get_trimmed_mean(&samples[t * n], n, cutoff, cutoff);
+        }
+        t1 = host_now_ns();
+        const double select_ns = (double) (t1 - t0) / ticks;
+
+        uint32_t mismatches = 0;
+        for (uint32_t t = 0; t < ticks; t++) {
+            mismatches += results[t] != results[ticks + t];
+        }
+        free(results);
+        total_mismatches += mismatches;
+        printf("%7u  %6u  %11.1f ns  %8.1f ns  %6.1fx  %10u\n", n, cutoff, sort_ns, select_ns, sort_ns / select_ns, mismatches);
+    }
+    free(samples);
+    free(reference);
+    return total_mismatches > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,255 @@
+//////////////////////////
+//   RP2040-Decoder     //
+// Gabriel Koppenstein  //
+//    motor_model.c     //
+//////////////////////////
+
+// Plant model of a locomotive drive for the host build, see motor_model.h
+
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include "motor_model.h"
+
+typedef struct motor_model_param_name_t {
+    const char *name;
+    size_t offset;
+} motor_model_param_name_t;
+
+static const motor_model_param_name_t param_names[] = {
+    {"supply_v", offsetof(motor_model_params_t, supply_v)},
+    {"r_ohm", offsetof(motor_model_params_t, r_ohm)},
+    {"k_e", offsetof(motor_model_params_t, k_e)},
+    {"j_motor", offsetof(motor_model_params_t, j_motor)},
+    {"j_load", offsetof(motor_model_params_t, j_load)},
+    {"friction_motor", offsetof(motor_model_params_t, friction_motor)},
+    {"viscous_motor", offsetof(motor_model_params_t, viscous_motor)},
+    {"friction_load", offsetof(motor_model_params_t, friction_load)},
+    {"stiction_load", offsetof(motor_model_params_t, stiction_load)},
+    {"viscous_load", offsetof(motor_model_params_t, viscous_load)},
+    {"backlash_rad", offsetof(motor_model_params_t, backlash_rad)},
+    {"adc_counts_per_v", offsetof(motor_model_params_t, adc_counts_per_v)},
+    {"adc_offset", offsetof(motor_model_params_t, adc_offset)},
+    {"adc_noise", offsetof(motor_model_params_t, adc_noise)},
+};
+
+motor_model_params_t motor_model_default_params(void) {
+    // No-load speed about 1600 rad/s, stall torque 9mNm, mechanical time constant about 0.2s
+    return (motor_model_params_t) {
+        .supply_v = 15.0,
+        .r_ohm = 15.0,
+        .k_e = 0.009,
+        .j_motor = 8e-7,
+        .j_load = 3e-7,
+        .friction_motor = 0.2e-3,
+        .viscous_motor = 2e-7,
+        .friction_load = 0.4e-3,
+        .stiction_load = 0.8e-3,
+        .viscous_load = 1e-7,
+        .backlash_rad = 0.3,
+        .adc_counts_per_v = 170.0,
+        .adc_offset = 10.0,
+        .adc_noise = 3.0,
+    };
+}
+
+bool motor_model_parse_params(motor_model_params_t *const par, const char *const spec) {
+    char *const copy = strdup(spec);
+    bool ok = copy != NULL;
+    char *save = NULL;
+    for (char *token = strtok_r(copy, " ,\t\n", &save); ok && token != NULL; token = strtok_r(NULL, " ,\t\n", &save)) {
+        char *const eq = strchr(token, '=');
+        ok = false;
+        if (eq == NULL) {
+            break;
+        }
+        *eq = '\0';
+        char *end;
+        const double value = strtod(eq + 1, &end);
+        if (end == eq + 1 || *end != '\0' || value < 0) {
+            break;
+        }
+        for (size_t i = 0; i < sizeof(param_names) / sizeof(param_names[0]); i++) {
+            if (strcmp(token, param_names[i].name) == 0) {
+                *(double *) ((uint8_t *) par + param_names[i].offset) = value;
+                ok = true;
+                break;
+            }
+        }
+    }
+    free(copy);
+    return ok;
+}
+
+void motor_model_randomize(motor_model_params_t *const par, uint64_t const seed, double const spread) {
+    double *const varied[] = {&par->r_ohm, &par->k_e, &par->j_load, &par->friction_motor, &par->friction_load,
+                              &par->stiction_load, &par->viscous_load, &par->backlash_rad};
+    host_rng_t rng;
+    host_rng_seed(&rng, seed * 0xBF58476D1CE4E5B9ull);
+    for (size_t i = 0; i < sizeof(varied) / sizeof(varied[0]); i++) {
+        // Uniform in -spread ... spread
+        *varied[i] *= 1.0 + spread * (2.0 * host_rng_uniform(&rng) - 1.0);
+    }
+}
+
+void motor_model_init(motor_model_t *const m, const motor_model_params_t *const par, uint64_t const seed) {
+    memset(m, 0, sizeof(motor_model_t));
+    m->par = *par;
+    if (m->par.stiction_load < m->par.friction_load) {
+        m->par.stiction_load = m->par.friction_load;
+    }
+    m->time_us = host_time_us();
+    // Motor in the middle of the backlash, the first movement has to close the gap
+    m->engaged = m->par.backlash_rad > 0 ? 0 : 1;
+    host_rng_seed(&m->rng, seed);
+}
+
+static double rng_gaussian(motor_model_t *const m) {
+    // The sum of four uniform 16-bit values approximates a standard normal distribution (Irwin-Hall, limited to
+    // +-3.46) without the transcendental functions of Box-Muller, which would dominate the run time with one ADC
+    // sample every 2us.
+    const uint64_t r = host_rng_next64(&m->rng);
+    const uint32_t sum = (uint32_t) (r & 0xFFFF) + (uint32_t) ((r >> 16) & 0xFFFF) + (uint32_t) ((r >> 32) & 0xFFFF) +
+                         (uint32_t) (r >> 48);
+    return ((double) sum / 65536.0 - 2.0) * 1.7320508075688772;
+}
+
+// Velocity after dt of an inertia driven by torque against Coulomb and viscous friction
+static double integrate_inertia(double const omega, double const torque, double const j, double const coulomb,
+                                double const stiction, double const viscous, double const dt) {
+    if (omega == 0.0) {
+        if (fabs(torque) <= stiction) {
+            return 0.0;
+        }
+        const double dir = torque > 0 ? 1.0 : -1.0;
+        return dt * (torque - dir * coulomb) / j;
+    }
+    const double dir = omega > 0 ? 1.0 : -1.0;
+    const double next = omega + dt * (torque - dir * coulomb - viscous * omega) / j;
+    // Friction stops the inertia, it doesn't reverse it
+    return next * dir < 0 ? 0.0 : next;
+}
+
+// Torque needed to keep the load moving at omega without accelerating
+static double load_friction(const motor_model_params_t *const par, double const omega) {
+    if (omega == 0.0) {
+        return 0.0;
+    }
+    return (omega > 0 ? par->friction_load : -par->friction_load) + par->viscous_load * omega;
+}
+
+static double motor_current(const motor_model_t *const m) {
+    // Coast mode while the output is off, no regenerative current through the driver
+    if (m->duty == 0.0) {
+        return 0.0;
+    }
+    const double current = (m->duty * m->par.supply_v - m->par.k_e * m->omega_motor) / m->par.r_ohm;
+    return current * m->duty < 0 ? 0.0 : current;
+}
+
+static void motor_model_step(motor_model_t *const m, double const dt) {
+    const motor_model_params_t *const par = &m->par;
+    const double torque = par->k_e * motor_current(m);
+
+    // Starting against the contact side (direction reversal) opens the gap first
+    if (m->engaged != 0 && m->omega_motor == 0.0 && par->backlash_rad > 0 && torque * m->engaged < 0 &&
+        fabs(torque) > par->friction_motor) {
+        m->engaged = 0;
+    }
+    if (m->engaged != 0) {
+        // Motor and load move together
+        const double j = par->j_motor + par->j_load;
+        const double omega = integrate_inertia(m->omega_motor, torque, j, par->friction_motor + par->friction_load,
+                                               par->friction_motor + par->stiction_load,
+                                               par->viscous_motor + par->viscous_load, dt);
+        m->omega_motor = omega;
+        m->omega_load = omega;
+        // The contact opens when the motor alone would accelerate slower (engaged > 0) or faster (engaged < 0) than
+        // the load alone, the gear can only push
+        const double motor_alone = torque - (omega > 0 ? par->friction_motor : omega < 0 ? -par->friction_motor : 0.0) -
+                                   par->viscous_motor * omega;
+        const double load_alone = -load_friction(par, omega);
+        if (par->backlash_rad > 0 && omega != 0.0 &&
+            ((m->engaged > 0 && motor_alone / par->j_motor < load_alone / par->j_load) ||
+             (m->engaged < 0 && motor_alone / par->j_motor > load_alone / par->j_load))) {
+            m->engaged = 0;
+        }
+        return;
+    }
+
+    // Backlash gap open, motor and load move independently until the gap closes
+    m->omega_motor = integrate_inertia(m->omega_motor, torque, par->j_motor, par->friction_motor, par->friction_motor,
+                                       par->viscous_motor, dt);
+    m->omega_load = integrate_inertia(m->omega_load, 0.0, par->j_load, par->friction_load, par->stiction_load,
+                                      par->viscous_load, dt);
+    m->gap += (m->omega_motor - m->omega_load) * dt;
+    if (fabs(m->gap) >= par->backlash_rad / 2) {
+        // Inelastic collision of motor and load
+        m->engaged = m->gap > 0 ? 1 : -1;
+        m->gap = m->engaged * par->backlash_rad / 2;
+        const double omega = (par->j_motor * m->omega_motor + par->j_load * m->omega_load) / (par->j_motor + par->j_load);
+        m->omega_motor = omega;
+        m->omega_load = omega;
+    }
+}
+
+// Sets the duty cycle used until the next change of the levels
+static void latch_duty(motor_model_t *const m, uint16_t const fwd_level, uint16_t const rev_level) {
+    const double periods = (double) host_pwm_get_wrap(pwm_gpio_to_slice_num(MOTOR_FWD_PIN)) + 1.0;
+    m->duty = ((double) fwd_level - (double) rev_level) / periods;
+    if (m->duty > 1.0) {
+        m->duty = 1.0;
+    }
+    else if (m->duty < -1.0) {
+        m->duty = -1.0;
+    }
+    m->current = motor_current(m);
+}
+
+void motor_model_update(motor_model_t *const m) {
+    // The duty cycle is constant since the last update, the PWM hook runs before every change of the levels
+    const uint64_t now_us = host_time_us();
+    while (m->time_us < now_us) {
+        const uint64_t step_us = now_us - m->time_us < MOTOR_MODEL_MAX_STEP_US ? now_us - m->time_us : MOTOR_MODEL_MAX_STEP_US;
+        motor_model_step(m, (double) step_us * 1e-6);
+        m->time_us += step_us;
+    }
+    m->current = motor_current(m);
+}
+
+double motor_model_bemf_counts(const motor_model_t *const m) {
+    return fabs(m->par.k_e * m->omega_motor) * m->par.adc_counts_per_v;
+}
+
+static void motor_model_pwm_hook(uint const gpio, uint16_t const level, void *const ctx) {
+    // Integrate with the previous levels up to now, the new level applies from now on
+    motor_model_t *const m = ctx;
+    motor_model_update(m);
+    latch_duty(m, gpio == MOTOR_FWD_PIN ? level : host_pwm_get_level(MOTOR_FWD_PIN),
+               gpio == MOTOR_REV_PIN ? level : host_pwm_get_level(MOTOR_REV_PIN));
+}
+
+static uint16_t motor_model_adc_source(uint const input, void *const ctx) {
+    motor_model_t *const m = ctx;
+    // The ADC samples every 2us, the back-EMF of the coasting motor doesn't change noticeably within one integration step
+    if (host_time_us() - m->time_us >= MOTOR_MODEL_MAX_STEP_US) {
+        motor_model_update(m);
+    }
+    // Each direction has its own ADC channel, the back-EMF of the other direction reads as 0V
+    const double emf = m->par.k_e * m->omega_motor;
+    double counts = m->par.adc_offset + m->par.adc_noise * rng_gaussian(m);
+    if ((input == FWD_V_EMF_ADC_CHANNEL && emf > 0) || (input == REV_V_EMF_ADC_CHANNEL && emf < 0)) {
+        counts += fabs(emf) * m->par.adc_counts_per_v;
+    }
+    if (counts < 0) {
+        return 0;
+    }
+    return counts > 4095 ? 4095 : (uint16_t) lround(counts);
+}
+
+void motor_model_attach(motor_model_t *const m) {
+    m->time_us = host_time_us();
+    latch_duty(m, host_pwm_get_level(MOTOR_FWD_PIN), host_pwm_get_level(MOTOR_REV_PIN));
+    host_pwm_set_hook(motor_model_pwm_hook, m);
+    host_adc_set_source(motor_model_adc_source, m);
+}
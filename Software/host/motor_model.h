@@ -0,0 +1,119 @@
+/*!
+ *
+ * \file motor_model.h
+ * Plant model of a locomotive drive for the host build (see host/CMakeLists.txt)
+ *
+ * A permanent magnet DC motor drives the load (gears, wheels and the train, reflected to the motor shaft) through a
+ * gear train with backlash. The motor voltage is the average of the PWM output set by the firmware, the motor current
+ * follows from the supply voltage, the armature resistance and the back-EMF (the inductance is neglected, the
+ * electrical time constant is much shorter than a PWM period). While the motor output is off, the driver is in coast
+ * mode and no current flows. Motor and load have Coulomb and viscous friction, the load additionally stiction. While
+ * the backlash gap is open, motor and load move independently, closing the gap is an inelastic collision.
+ *
+ * The ADC channels of both directions return the back-EMF voltage in ADC counts plus offset and approximately normal
+ * distributed noise. The model integrates lazily up to the current simulated time whenever the firmware changes a PWM
+ * level (see host_pwm_set_hook()) or reads the ADC, so it follows measure() and adjust_pwm_level() without slowing
+ * down the simulation.
+ *
+ */
+
+#pragma once
+#include "decoder_host.h"
+
+/**
+ * @def MOTOR_MODEL_MAX_STEP_US
+ * @brief Maximum integration step in us
+ */
+#define MOTOR_MODEL_MAX_STEP_US 100
+
+/**
+ * @brief Parameters of the motor model, all values in SI units and reflected to the motor shaft.
+ *
+ * @typedef motor_model_params_t
+ * @struct motor_model_params_t
+ */
+typedef struct motor_model_params_t {
+    double supply_v;            /*!< Supply voltage of the motor driver (rectified track voltage) in V */
+    double r_ohm;               /*!< Armature resistance in Ohm */
+    double k_e;                 /*!< Back-EMF constant in V/(rad/s), equal to the torque constant in Nm/A */
+    double j_motor;             /*!< Inertia of rotor and flywheel in kg*m^2 */
+    double j_load;              /*!< Inertia of gears, wheels and train in kg*m^2 */
+    double friction_motor;      /*!< Coulomb friction of the motor in Nm */
+    double viscous_motor;       /*!< Viscous friction of the motor in Nm/(rad/s) */
+    double friction_load;       /*!< Coulomb friction of the load in Nm (rolling resistance, gradient) */
+    double stiction_load;       /*!< Breakaway torque of the load in Nm, at least friction_load */
+    double viscous_load;        /*!< Viscous friction of the load in Nm/(rad/s) */
+    double backlash_rad;        /*!< Gear backlash in rad */
+    double adc_counts_per_v;    /*!< ADC counts per V of back-EMF (voltage divider and ADC reference) */
+    double adc_offset;          /*!< ADC offset in counts */
+    double adc_noise;           /*!< Standard deviation of the ADC noise in counts */
+} motor_model_params_t;
+
+/**
+ * @brief State of the motor model.
+ *
+ * @typedef motor_model_t
+ * @struct motor_model_t
+ */
+typedef struct motor_model_t {
+    motor_model_params_t par;   /*!< Parameters */
+    uint64_t time_us;           /*!< Simulated time the state refers to */
+    double omega_motor;         /*!< Angular velocity of the motor in rad/s */
+    double omega_load;          /*!< Angular velocity of the load in rad/s */
+    double gap;                 /*!< Position of the motor within the backlash, -backlash/2 ... backlash/2 */
+    int8_t engaged;             /*!< 1: motor drives the load, -1: load drives the motor (braking), 0: gap open */
+    double duty;                /*!< Signed duty cycle of the motor output, positive in forward direction */
+    double current;             /*!< Motor current of the last step in A */
+    host_rng_t rng;             /*!< Noise generator */
+} motor_model_t;
+
+/**
+ * @brief Returns the default parameters, an H0 motor with flywheel on a 15V supply.
+ */
+motor_model_params_t motor_model_default_params(void);
+
+/**
+ * @brief Sets parameters from a string of key=value pairs separated by spaces or commas, e.g. "r=12 k_e=0.006".
+ *
+ * Keys are the names of the fields of motor_model_params_t.
+ *
+ * @param par Parameters to modify.
+ * @param spec Parameter string.
+ * @return true on success, false on unknown keys or invalid values.
+ */
+bool motor_model_parse_params(motor_model_params_t *par, const char *spec);
+
+/**
+ * @brief Varies load, friction, backlash and the electrical motor parameters randomly, e.g. to check the robustness of
+ * controller settings against different locomotives.
+ *
+ * @param par Parameters to modify.
+ * @param seed Seed of the variation, the same seed gives the same parameters.
+ * @param spread Maximum relative change, e.g. 0.3 for +-30%.
+ */
+void motor_model_randomize(motor_model_params_t *par, uint64_t seed, double spread);
+
+/**
+ * @brief Initializes the model at standstill.
+ *
+ * @param m Model.
+ * @param par Parameters.
+ * @param seed Seed of the ADC noise.
+ */
+void motor_model_init(motor_model_t *m, const motor_model_params_t *par, uint64_t seed);
+
+/**
+ * @brief Connects the model to the simulated hardware as PWM hook and ADC source, has to be repeated after
+ * host_hal_reset().
+ */
+void motor_model_attach(motor_model_t *m);
+
+/**
+ * @brief Integrates the model up to the current simulated time with the current PWM levels of the motor outputs.
+ */
+void motor_model_update(motor_model_t *m);
+
+/**
+ * @brief Returns the noise-free back-EMF in ADC counts without offset, the controlled variable of the firmware.
+ */
+double motor_model_bemf_counts(const motor_model_t *m);
@@ -0,0 +1,151 @@
+//////////////////////////
+//   RP2040-Decoder     //
+// Gabriel Koppenstein  //
+//     motor_sim.c      //
+//////////////////////////
+
+// Runs the motor controller closed-loop against the motor model (see controller_sim.h and motor_model.h)
+//
+// Every CV set given with -c is simulated with the default motor model and with -R randomly varied models through the
+// same speed profile. The scores of every run and the mean and worst cost of every CV set are printed, the best CV
+// set (lowest worst-case cost) last. With -a every CV set is first tuned by the on-decoder autotune (CV_180) on the
+// given motor model and the tuned CVs are simulated instead. A trace of the first run can be written as CSV file for plotting, with the same
+// columns as the telemetry captured from a real decoder (see scripts/capture_telemetry.py) plus the model state.
+//
+// Usage: motor_sim [options], see print_usage()
+
+#include <stdlib.h>
+#include <unistd.h>
+#include "controller_sim.h"
+
+#define MAX_CV_SETS 16
+
+static void write_trace(const sim_sample_t *const s, void *const ctx) {
+    fprintf(ctx, "%.3f,%d,%u,%u,%.2f,%.2f,%u,%.4f,%.2f,%.2f\n", s->time_ms, s->speed_step, s->mode, s->setpoint,
+            s->measurement, s->bemf, s->level, s->current, s->omega_motor, s->omega_load);
+}
+
+static void print_usage(const char *const name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -c <cvs>        CV set applied on top of the default CVs, e.g. \"47=20 50=30\" (repeatable, default: none)\n"
+            "  -m <params>     motor model parameters, e.g. \"r_ohm=12 backlash_rad=0.5\" (see motor_model_params_t)\n"
+            "  -R <models>     number of randomly varied motor models in addition to the given one (default 0)\n"
+            "  -v <spread>     relative spread of the varied models (default 0.3)\n"
+            "  -p <profile>    speed profile as speed_step:seconds pairs (default \"40:3,100:3,40:3,0:3,-40:3,0:2\")\n"
+            "  -r <seed>       random seed of the ADC noise and the model variations (default 1)\n"
+            "  -t <file>       write a CSV trace of the first run\n"
+            "  -a              run the on-decoder autotune (CV_180 = 1) on every CV set first and simulate the tuned CVs\n"
+            "  -h              show this help\n",
+            name);
+}
+
+int main(int argc, char **argv) {
+    sim_cv_set_t cv_sets[MAX_CV_SETS];
+    uint32_t num_cv_sets = 0;
+    motor_model_params_t model = motor_model_default_params();
+    sim_profile_t profile = sim_default_profile();
+    uint32_t models = 0;
+    double spread = 0.3;
+    uint32_t seed = 1;
+    const char *trace_path = NULL;
+    bool autotune = false;
+    int c;
+    while ((c = getopt(argc, argv, "c:m:R:v:p:r:t:ah")) != -1) {
+        switch (c) {
+            case 'c':
+                if (num_cv_sets == MAX_CV_SETS || !sim_parse_cv_set(&cv_sets[num_cv_sets], optarg)) {
+                    fprintf(stderr, "Invalid CV set or more than %u CV sets: %s\n", MAX_CV_SETS, optarg);
+                    return EXIT_FAILURE;
+                }
+                num_cv_sets++;
+                break;
+            case 'm':
+                if (!motor_model_parse_params(&model, optarg)) {
+                    fprintf(stderr, "Invalid motor model parameters: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'R': models = strtoul(optarg, NULL, 0); break;
+            case 'v': spread = strtod(optarg, NULL); break;
+            case 'p':
+                if (!sim_parse_profile(&profile, optarg)) {
+                    fprintf(stderr, "Invalid speed profile: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'r': seed = strtoul(optarg, NULL, 0); break;
+            case 't': trace_path = optarg; break;
+            case 'a': autotune = true; break;
+            default:
+                print_usage(argv[0]);
+                return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (spread < 0 || spread >= 1) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (num_cv_sets == 0) {
+        cv_sets[0].count = 0;
+        num_cv_sets = 1;
+    }
+    for (uint32_t s = 0; autotune && s < num_cv_sets; s++) {
+        sim_cv_set_t tuned;
+        double duration_s;
+        const uint8_t status = sim_autotune(&cv_sets[s], &model, seed, &tuned, &duration_s);
+        char cvs[256];
+        sim_format_cv_set(&tuned, cvs, sizeof(cvs));
+        printf("Autotune of set %u: CV_180 = %u after %.1f s, %s\n", s, status, duration_s, tuned.count ? cvs : "default CVs");
+        cv_sets[s] = tuned;
+    }
+    FILE *trace = NULL;
+    if (trace_path != NULL) {
+        trace = fopen(trace_path, "w");
+        if (trace == NULL) {
+            fprintf(stderr, "Cannot open %s\n", trace_path);
+            return EXIT_FAILURE;
+        }
+        fprintf(trace, "time_ms,speed_step,mode,setpoint,measurement_corrected,bemf,level,current,omega_motor,omega_load\n");
+    }
+
+    printf("Set  Model  RMS err  Overshoot  Settling  Ripple  Startup   Overruns  Cost\n");
+    double simulated_s = 0;
+    uint32_t best = 0;
+    double best_worst = 0;
+    const uint64_t t0 = host_now_ns();
+    for (uint32_t s = 0; s < num_cv_sets; s++) {
+        double sum = 0, worst = 0;
+        for (uint32_t m = 0; m <= models; m++) {
+            motor_model_params_t par = model;
+            if (m > 0) {
+                motor_model_randomize(&par, seed + m, spread);
+            }
+            sim_metrics_t r;
+            sim_run(&cv_sets[s], &par, &profile, seed + m, trace != NULL ? write_trace : NULL, trace, &r);
+            if (trace != NULL) {
+                fclose(trace);
+                trace = NULL;
+            }
+            printf("%3u  %5u  %6.2f%%  %8.2f%%  %5.0f ms  %5.2f%%  %4.0f ms  %8u  %7.2f\n", s, m, r.rms_error, r.overshoot,
+                   r.settling_ms, r.ripple, r.startup_ms, r.overruns, r.cost);
+            simulated_s += r.simulated_s;
+            sum += r.cost;
+            worst = r.cost > worst ? r.cost : worst;
+        }
+        char cvs[256];
+        sim_format_cv_set(&cv_sets[s], cvs, sizeof(cvs));
+        printf("Set %u (%s): mean cost %.2f, worst cost %.2f\n", s, cv_sets[s].count ? cvs : "default CVs",
+               sum / (models + 1), worst);
+        if (s == 0 || worst < best_worst) {
+            best = s;
+            best_worst = worst;
+        }
+    }
+    const double real_s = (double) (host_now_ns() - t0) / 1e9;
+    char cvs[256];
+    sim_format_cv_set(&cv_sets[best], cvs, sizeof(cvs));
+    printf("Best: set %u (%s), worst cost %.2f\n", best, cv_sets[best].count ? cvs : "default CVs", best_worst);
+    printf("Simulated %.1f s in %.2f s (%.0fx real time)\n", simulated_s, real_s, simulated_s / real_s);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,16 @@
+// Host build stand-in for the header generated from dcc_rx.pio by pioasm, see host_sdk.h
+// The state machine is not simulated, half-bit durations are fed to core0 via decoder_host.h instead.
+#pragma once
+#include "hardware/pio.h"
+
+static const uint16_t dcc_rx_program_instructions[] = {0};
+
+static const struct pio_program dcc_rx_program = {
+    .instructions = dcc_rx_program_instructions,
+    .length = 1,
+    .origin = -1,
+};
+
+static inline void dcc_rx_program_init(PIO pio, uint sm, uint offset, uint pin) {
+    (void) pio; (void) sm; (void) offset; (void) pin;
+}
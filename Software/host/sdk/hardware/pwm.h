@@ -0,0 +1,3 @@
+// Host build stand-in for the Pico SDK header <hardware/pwm.h>, see host_sdk.h
+#pragma once
+#include "host_sdk.h"
@@ -0,0 +1,3 @@
+// Host build stand-in for the Pico SDK header <hardware/structs/systick.h>, see host_sdk.h
+#pragma once
+#include "host_sdk.h"
@@ -0,0 +1,190 @@
+/*!
+ *
+ * \file host_sdk.h
+ * Subset of the Pico SDK API used by the firmware, implemented for the host build by hal_host.c
+ *
+ * Only the declarations needed to compile core0.c, core1.c, shared.c and spsc_queue.c are provided.
+ * The hardware is simulated just far enough for the decoding and control logic to run: PWM levels, ADC samples,
+ * flash contents and the system time are plain variables which can be inspected and modified via decoder_host.h.
+ *
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+// Board header selected via CMake (see host/CMakeLists.txt)
+#include HOST_BOARD_HEADER
+
+typedef unsigned int uint;
+typedef uint64_t absolute_time_t;
+#define __unused __attribute__((unused))
+#define __not_in_flash_func(f) f
+#define PICO_OK 0
+#define PICO_ERROR_TIMEOUT -1
+
+/* flash */
+#define FLASH_SECTOR_SIZE 4096u
+#define FLASH_PAGE_SIZE 256u
+extern uint8_t host_flash[PICO_FLASH_SIZE_BYTES];
+#define XIP_BASE ((uintptr_t) host_flash)
+
+enum { GPIO_IN = 0, GPIO_OUT = 1 };
+enum gpio_function { GPIO_FUNC_PWM = 4, GPIO_FUNC_SIO = 5, GPIO_FUNC_PIO0 = 6 };
+enum { GPIO_IRQ_EDGE_FALL = 4, GPIO_IRQ_EDGE_RISE = 8 };
+enum { PWM_IRQ_WRAP = 4, IO_IRQ_BANK0 = 13, DMA_IRQ_0 = 11, DMA_IRQ_1 = 12 };
+enum { HARDFAULT_EXCEPTION = 3 };
+
+/* time / stdlib */
+absolute_time_t get_absolute_time(void);
+int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to);
+uint32_t to_ms_since_boot(absolute_time_t t);
+uint32_t time_us_32(void);
+uint64_t time_us_64(void);
+uint get_core_num(void);
+void busy_wait_us(uint64_t us);
+void busy_wait_ms(uint32_t ms);
+void sleep_us(uint64_t us);
+void sleep_ms(uint32_t ms);
+void panic(const char *fmt, ...);
+bool stdio_init_all(void);
+int getchar_timeout_us(uint32_t timeout_us);
+int putchar_raw(int c);
+#define NUM_CORES 2u
+#define tight_loop_contents() ((void) 0)
+
+/* gpio */
+void gpio_init(uint gpio);
+void gpio_init_mask(uint32_t mask);
+void gpio_set_dir(uint gpio, bool out);
+void gpio_set_dir_out_masked(uint32_t mask);
+void gpio_pull_up(uint gpio);
+void gpio_put(uint gpio, bool value);
+void gpio_put_masked(uint32_t mask, uint32_t value);
+void gpio_set_function(uint gpio, enum gpio_function fn);
+typedef void (*gpio_irq_callback_t)(uint gpio, uint32_t events);
+void gpio_set_irq_callback(gpio_irq_callback_t cb);
+void gpio_set_irq_enabled(uint gpio, uint32_t events, bool enabled);
+void irq_set_enabled(uint num, bool enabled);
+typedef void (*irq_handler_t)(void);
+void irq_set_exclusive_handler(uint num, irq_handler_t handler);
+
+/* pwm */
+uint pwm_gpio_to_slice_num(uint gpio);
+uint pwm_gpio_to_channel(uint gpio);
+void pwm_set_gpio_level(uint gpio, uint16_t level);
+void pwm_set_wrap(uint slice, uint16_t wrap);
+void pwm_set_clkdiv_int_frac(uint slice, uint8_t integer, uint8_t fract);
+void pwm_set_enabled(uint slice, bool enabled);
+uint pwm_get_dreq(uint slice);
+void pwm_set_irq_enabled(uint slice, bool enabled);
+void pwm_clear_irq(uint slice);
+
+/* adc */
+typedef struct { volatile uint32_t cs, result, fcs, fifo, div, intr, inte, intf, ints; } adc_hw_t;
+extern adc_hw_t host_adc_hw;
+#define adc_hw (&host_adc_hw)
+#define ADC_CS_EN_BITS 0x00000001u
+#define ADC_CS_START_ONCE_BITS 0x00000004u
+#define ADC_CS_START_MANY_BITS 0x00000008u
+#define ADC_CS_AINSEL_LSB 12u
+#define ADC_CS_AINSEL_BITS 0x00007000u
+void adc_init(void);
+void adc_gpio_init(uint gpio);
+void adc_fifo_setup(bool en, bool dreq_en, uint16_t dreq_thresh, bool err_in_fifo, bool byte_shift);
+void adc_select_input(uint input);
+void adc_run(bool run);
+uint16_t adc_fifo_get_blocking(void);
+void adc_fifo_drain(void);
+
+/* flash */
+void flash_range_erase(uint32_t offset, size_t count);
+void flash_range_program(uint32_t offset, const uint8_t *data, size_t count);
+void flash_do_cmd(const uint8_t *txbuf, uint8_t *rxbuf, size_t count);
+int flash_safe_execute(void (*func)(void *), void *param, uint32_t timeout_ms);
+bool flash_safe_execute_core_init(void);
+
+/* watchdog / exception / multicore */
+void watchdog_update(void);
+void watchdog_enable(uint32_t delay_ms, bool pause_on_debug);
+bool watchdog_caused_reboot(void);
+void watchdog_reboot(uint32_t pc, uint32_t sp, uint32_t delay_ms);
+typedef void (*exception_handler_t)(void);
+exception_handler_t exception_set_exclusive_handler(int num, exception_handler_t handler);
+void multicore_launch_core1(void (*entry)(void));
+
+/* timer */
+struct repeating_timer { int64_t delay_us; void *user_data; };
+typedef bool (*repeating_timer_callback_t)(struct repeating_timer *rt);
+bool add_repeating_timer_ms(int32_t delay_ms, repeating_timer_callback_t callback, void *user_data, struct repeating_timer *out);
+bool add_repeating_timer_us(int64_t delay_us, repeating_timer_callback_t callback, void *user_data, struct repeating_timer *out);
+bool cancel_repeating_timer(struct repeating_timer *timer);
+
+/* pio */
+typedef struct pio_hw { uint32_t rxf[4]; } pio_hw_t;
+typedef pio_hw_t *PIO;
+extern pio_hw_t host_pio0;
+#define pio0 (&host_pio0)
+typedef struct { uint32_t clkdiv, execctrl, shiftctrl, pinctrl; } pio_sm_config;
+typedef struct pio_program { const uint16_t *instructions; uint8_t length; int8_t origin; } pio_program_t;
+enum pio_fifo_join { PIO_FIFO_JOIN_NONE = 0, PIO_FIFO_JOIN_TX = 1, PIO_FIFO_JOIN_RX = 2 };
+uint pio_add_program(PIO pio, const pio_program_t *program);
+int pio_claim_unused_sm(PIO pio, bool required);
+void pio_sm_unclaim(PIO pio, uint sm);
+pio_sm_config pio_get_default_sm_config(void);
+void sm_config_set_wrap(pio_sm_config *c, uint wrap_target, uint wrap);
+void sm_config_set_in_pins(pio_sm_config *c, uint in_base);
+void sm_config_set_jmp_pin(pio_sm_config *c, uint pin);
+void sm_config_set_in_shift(pio_sm_config *c, bool shift_right, bool autopush, uint push_threshold);
+void sm_config_set_fifo_join(pio_sm_config *c, enum pio_fifo_join join);
+void sm_config_set_clkdiv(pio_sm_config *c, float div);
+void pio_sm_set_consecutive_pindirs(PIO pio, uint sm, uint pin_base, uint pin_count, bool is_out);
+void pio_sm_init(PIO pio, uint sm, uint initial_pc, const pio_sm_config *config);
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled);
+uint pio_get_dreq(PIO pio, uint sm, bool is_tx);
+uint pio_get_index(PIO pio);
+
+/* clocks */
+enum clock_index { clk_sys = 5 };
+uint32_t clock_get_hz(enum clock_index clk_index);
+
+/* systick */
+typedef struct { volatile uint32_t csr, rvr, cvr, calib; } systick_hw_t;
+#define M0PLUS_SYST_CSR_ENABLE_BITS 0x00000001u
+#define M0PLUS_SYST_CSR_CLKSOURCE_BITS 0x00000004u
+// The counter value is derived from the simulated time on every access
+systick_hw_t *host_systick_hw(void);
+#define systick_hw (host_systick_hw())
+
+/* sync */
+#define __dmb() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define __compiler_memory_barrier() __atomic_signal_fence(__ATOMIC_SEQ_CST)
+void __sev(void);
+void __wfe(void);
+// Interrupts of the host build are called synchronously from the simulated time, disabling them is a no-op
+static inline uint32_t save_and_disable_interrupts(void) { return 0; }
+static inline void restore_interrupts(uint32_t status) { (void) status; }
+
+/* dma */
+enum dma_channel_transfer_size { DMA_SIZE_8 = 0, DMA_SIZE_16 = 1, DMA_SIZE_32 = 2 };
+enum { DREQ_PWM_WRAP0 = 24, DREQ_ADC = 36 };
+typedef struct { uint32_t ctrl; } dma_channel_config;
+typedef struct { volatile uint32_t read_addr, write_addr, transfer_count, ctrl_trig; } dma_channel_hw_t;
+dma_channel_hw_t *dma_channel_hw_addr(uint channel);
+int dma_claim_unused_channel(bool required);
+void dma_channel_unclaim(uint channel);
+dma_channel_config dma_channel_get_default_config(uint channel);
+void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size);
+void channel_config_set_read_increment(dma_channel_config *c, bool incr);
+void channel_config_set_write_increment(dma_channel_config *c, bool incr);
+void channel_config_set_ring(dma_channel_config *c, bool write, uint size_bits);
+void channel_config_set_dreq(dma_channel_config *c, uint dreq);
+void channel_config_set_chain_to(dma_channel_config *c, uint chain_to);
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr, const volatile void *read_addr, uint transfer_count, bool trigger);
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger);
+bool dma_channel_is_busy(uint channel);
+void dma_channel_wait_for_finish_blocking(uint channel);
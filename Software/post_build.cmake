@@ -54,12 +54,20 @@ if(PICO_FLASH_SIZE_BYTES)
 else()
     message(FATAL_ERROR "Failed to find PICO_FLASH_SIZE_BYTES in the header file.")
 endif()
+# Extract the number of sectors reserved for the CVs (CV journal) the same way
+string(REGEX MATCHALL "#define CV_STORE_SECTORS [0-9]+" MACRO_MATCH "${HEADER_CONTENT}")
+string(REGEX MATCHALL "[0-9]+" CV_STORE_SECTORS "${MACRO_MATCH}")
+if(CV_STORE_SECTORS)
+    message(STATUS "CV_STORE_SECTORS: ${CV_STORE_SECTORS}")
+else()
+    message(FATAL_ERROR "Failed to find CV_STORE_SECTORS in the header file.")
+endif()
 # Sector size is always 4096 bytes
 set(FLASH_SECTOR_SIZE 4096)
 message(STATUS "FLASH_SECTOR_SIZE: ${FLASH_SECTOR_SIZE} bytes")
-# Subtract flash sector size from flash size
-math(EXPR FLASH_TARGET_OFFSET "${PICO_FLASH_SIZE_BYTES} - ${FLASH_SECTOR_SIZE}")
+# Subtract the sectors used for storing the CVs from flash size
+math(EXPR FLASH_TARGET_OFFSET "${PICO_FLASH_SIZE_BYTES} - ${CV_STORE_SECTORS} * ${FLASH_SECTOR_SIZE}")
 message(STATUS "FLASH_TARGET_OFFSET: ${FLASH_TARGET_OFFSET} bytes")
 if(PROGRAM_SIZE_DEC GREATER FLASH_TARGET_OFFSET)
-    message(FATAL_ERROR "Program size exceeds allowed flash size. Flash sector containing the CVs would be overwritten! Please reduce the size of the program.")
+    message(FATAL_ERROR "Program size exceeds allowed flash size. Flash sectors containing the CVs would be overwritten! Please reduce the size of the program.")
 endif()
@@ -5,6 +5,7 @@
 //////////////////////////
 
 #include "shared.h"
+#include "spsc_queue.h"
 
 // TODO: Implement getter and setter functions for speed steps, checking validity of speed step values.
 speed_step_t speed_step_target = SPEED_STEP_REVERSE_STOP;
@@ -12,23 +13,65 @@ speed_step_t speed_step_target_prev = SPEED_STEP_REVERSE_STOP;
 bool cv_setup_check_done = false;
 bool flash_safe_execute_core_init_done = false;
 error_t error_state = 0;
+autotune_result_t autotune_result = {0};
+uint8_t CV_ARRAY_RAM[CV_ARRAY_SIZE] __attribute__((aligned(4)));
+cv_fields_t cv_fields = {0};
+#if PROFILING
+profile_stats_t profile_stats[PROFILE_POINTS];
+#endif
+#if LOG_DEFERRED && LOGLEVEL > 0
+// Trace ring per core, each core is the only producer of its ring and core0 is the consumer of both
+static log_record_t log_ring_buf[NUM_CORES][LOG_RING_LEN];
+static spsc_queue_t log_rings[NUM_CORES] = {
+    {.buf = (uint8_t *) log_ring_buf[0], .elem_size = sizeof(log_record_t), .mask = LOG_RING_LEN - 1},
+    {.buf = (uint8_t *) log_ring_buf[1], .elem_size = sizeof(log_record_t), .mask = LOG_RING_LEN - 1}
+};
+static uint32_t log_reported_overflows[NUM_CORES];
+#endif
+#if TELEMETRY
+// Controller samples, core1 is the producer and core0 the consumer
+static telemetry_sample_t telemetry_buf[TELEMETRY_QUEUE_LEN];
+static spsc_queue_t telemetry_queue = {
+    .buf = (uint8_t *) telemetry_buf, .elem_size = sizeof(telemetry_sample_t), .mask = TELEMETRY_QUEUE_LEN - 1
+};
+static uint16_t telemetry_sequence;
+#endif
 
 // Functions in shared.c are accessed by both cores
 
-// retrieve 4Bytes from CV_ARRAY_FLASH at once and return 32-Bit value
+static void decode_cv_fields() {
+    // Derive the runtime values of frequently used CVs, each field is written with a single aligned store
+    cv_fields.accel_rate = CV_ARRAY_RAM[2];
+    cv_fields.decel_rate = CV_ARRAY_RAM[3];
+    cv_fields.motor_max_level = _125M / (CV_ARRAY_RAM[8] * 100 + 10000);
+}
+
+void load_cv_array_ram(const uint8_t *const source) {
+    // Copy the whole CV array (e.g. from flash at boot) into RAM
+    memcpy(CV_ARRAY_RAM, source, CV_ARRAY_SIZE);
+    decode_cv_fields();
+}
+
+void write_cv_array_ram(uint16_t const cv_index, uint8_t const cv_data) {
+    // Single byte store, readers on the other core see either the old or the new value
+    CV_ARRAY_RAM[cv_index] = cv_data;
+    decode_cv_fields();
+}
+
+// retrieve 4Bytes from CV_ARRAY_RAM at once and return 32-Bit value
 uint32_t get_32bit_CV (uint16_t CV_start_index){
-    uint8_t byte_3 = CV_ARRAY_FLASH[CV_start_index];
-    uint8_t byte_2 = CV_ARRAY_FLASH[CV_start_index+1];
-    uint8_t byte_1 = CV_ARRAY_FLASH[CV_start_index+2];
-    uint8_t byte_0 = CV_ARRAY_FLASH[CV_start_index+3];
+    uint8_t byte_3 = CV_ARRAY_RAM[CV_start_index];
+    uint8_t byte_2 = CV_ARRAY_RAM[CV_start_index+1];
+    uint8_t byte_1 = CV_ARRAY_RAM[CV_start_index+2];
+    uint8_t byte_0 = CV_ARRAY_RAM[CV_start_index+3];
     return (byte_0) + (byte_1<<8) + (byte_2<<16) + (byte_3<<24);
 }
 
 
-// retrieve 2Bytes from CV_ARRAY_FLASH at once and return 16-Bit value
+// retrieve 2Bytes from CV_ARRAY_RAM at once and return 16-Bit value
 uint16_t get_16bit_CV (uint16_t CV_start_index){
-    uint8_t byte_1 = CV_ARRAY_FLASH[CV_start_index];
-    uint8_t byte_0 = CV_ARRAY_FLASH[CV_start_index+1];
+    uint8_t byte_1 = CV_ARRAY_RAM[CV_start_index];
+    uint8_t byte_0 = CV_ARRAY_RAM[CV_start_index+1];
     return (byte_0) + (byte_1<<8);
 }
 
@@ -63,4 +106,254 @@ void clear_all_errors(){
 
 error_t get_error_state(){
     return error_state;
+}
+
+
+// Profiler, all functions are empty when PROFILING is 0
+
+#if PROFILING
+// clk_sys cycles per us and the SysTick range in us, set once as clock_get_hz() is not available while the flash is busy
+static uint32_t profile_cycles_per_us;
+static uint32_t profile_systick_range_us = UINT32_MAX;
+#endif
+
+void profile_init() {
+    #if PROFILING
+        profile_cycles_per_us = clock_get_hz(clk_sys) / 1000000;
+        profile_systick_range_us = 0x01000000 / profile_cycles_per_us;
+        // Free-running 24-bit down counter clocked by clk_sys
+        systick_hw->rvr = 0x00FFFFFF;
+        systick_hw->cvr = 0;
+        systick_hw->csr = M0PLUS_SYST_CSR_CLKSOURCE_BITS | M0PLUS_SYST_CSR_ENABLE_BITS;
+    #endif
+}
+
+void __not_in_flash_func(profile_record)(profile_point_t const point, uint32_t const start, uint32_t const start_us) {
+    #if PROFILING
+        uint32_t cycles = (start - systick_hw->cvr) & 0x00FFFFFF;
+        // SysTick wraps after 2^24 cycles, longer durations are only known in us
+        const uint32_t us = time_us_32() - start_us;
+        if (us >= profile_systick_range_us) {
+            cycles = us > UINT32_MAX / profile_cycles_per_us ? UINT32_MAX : us * profile_cycles_per_us;
+        }
+        profile_stats_t *const stats = &profile_stats[point];
+        if (stats->count == 0 || cycles < stats->min) {
+            stats->min = cycles;
+        }
+        if (cycles > stats->max) {
+            stats->max = cycles;
+        }
+        stats->count++;
+        stats->sum += cycles;
+        const uint32_t bin = cycles ? 32 - __builtin_clz(cycles) : 0;
+        stats->hist[bin < PROFILE_HIST_BINS ? bin : PROFILE_HIST_BINS - 1]++;
+    #endif
+}
+
+void profile_reset() {
+    #if PROFILING
+        memset(profile_stats, 0, sizeof(profile_stats));
+    #endif
+}
+
+void profile_dump() {
+    #if PROFILING && LOGLEVEL > 0
+        static const char *const names[PROFILE_POINTS] = {
+            "decode_dcc_half_bits", "evaluate_packet", "set_outputs", "run_flash_writer", "measure", "controller_general"
+        };
+        const uint32_t cycles_per_us = clock_get_hz(clk_sys) / 1000000;
+        printf("Profile (clk_sys cycles, %u cycles/us)\n", cycles_per_us);
+        for (uint8_t i = 0; i < PROFILE_POINTS; i++) {
+            const profile_stats_t *const stats = &profile_stats[i];
+            if (stats->count == 0) {
+                printf("%-20s no measurements\n", names[i]);
+                continue;
+            }
+            const uint32_t mean = (uint32_t) (stats->sum / stats->count);
+            printf("%-20s count %u min %u mean %u max %u (max %u us)\n", names[i], stats->count, stats->min, mean,
+                   stats->max, stats->max / cycles_per_us);
+            for (uint8_t bin = 0; bin < PROFILE_HIST_BINS; bin++) {
+                if (stats->hist[bin] && bin == PROFILE_HIST_BINS - 1) {
+                    printf("   >= %8u: %u\n", 1u << (bin - 1), stats->hist[bin]);
+                } else if (stats->hist[bin]) {
+                    printf("    < %8u: %u\n", 1u << bin, stats->hist[bin]);
+                }
+            }
+        }
+    #endif
+}
+
+
+// Deferred logging, all functions are empty when LOG_DEFERRED or LOGLEVEL is 0
+
+void log_write(const char *const fmt, uint32_t const nargs, const uintptr_t *const args) {
+    #if LOG_DEFERRED && LOGLEVEL > 0
+        spsc_queue_t *const ring = &log_rings[get_core_num()];
+        // Interrupt handlers of the same core may log as well, they must not interleave with the producer
+        const uint32_t irq_state = save_and_disable_interrupts();
+        log_record_t *const record = spsc_queue_write_slot(ring);
+        if (record != NULL) {
+            record->timestamp_us = time_us_64();
+            record->fmt = fmt;
+            record->nargs = nargs;
+            memcpy(record->args, args, nargs * sizeof(uintptr_t));
+            spsc_queue_commit(ring);
+        }
+        restore_interrupts(irq_state);
+    #endif
+}
+
+#if LOG_DEFERRED && LOGLEVEL > 0
+static void log_print(uint const core, const log_record_t *const record) {
+    printf("[core%u @ %u ms] ", core, (uint32_t) (record->timestamp_us / 1000));
+    const char *fmt = record->fmt;
+    uint32_t arg = 0;
+    while (*fmt != '\0') {
+        // Literal text up to the next conversion specification
+        const char *const percent = strchr(fmt, '%');
+        if (percent == NULL) {
+            printf("%s", fmt);
+            return;
+        }
+        if (percent != fmt) {
+            printf("%.*s", (int) (percent - fmt), fmt);
+        }
+        if (percent[1] == '%') {
+            putchar('%');
+            fmt = percent + 2;
+            continue;
+        }
+        // Copy the conversion specification (flags, width, precision, length) and format the argument with it
+        char spec[16];
+        size_t len = 1;
+        while (percent[len] != '\0' && strchr("diouxXcsfFeEgGaAp", percent[len]) == NULL && len < sizeof(spec) - 2) {
+            len++;
+        }
+        if (percent[len] == '\0') {
+            return;
+        }
+        memcpy(spec, percent, len + 1);
+        spec[len + 1] = '\0';
+        const uintptr_t value = arg < record->nargs ? record->args[arg++] : 0;
+        switch (percent[len]) {
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': {
+                union { uint32_t u; float f; } bits = { .u = (uint32_t) value };
+                printf(spec, (double) bits.f);
+                break;
+            }
+            case 's':
+            case 'p':
+                printf(spec, (const void *) value);
+                break;
+            default:
+                printf(spec, (uint32_t) value);
+                break;
+        }
+        fmt = percent + len + 1;
+    }
+}
+
+static void log_put_bytes(const void *const data, size_t const len, uint8_t *const checksum) {
+    const uint8_t *const bytes = data;
+    for (size_t i = 0; i < len; i++) {
+        putchar_raw(bytes[i]);
+        *checksum += bytes[i];
+    }
+}
+
+static void log_put_frame(uint const core, uint64_t const timestamp_us, const char *const fmt, uint32_t const nargs,
+                          const uintptr_t *const args) {
+    // Binary frame, see log_drain(), putchar_raw() skips the CR/LF translation of stdio
+    uint8_t checksum = 0;
+    putchar_raw(LOG_FRAME_SYNC0);
+    putchar_raw(LOG_FRAME_SYNC1);
+    const uint8_t header = (uint8_t) (core << 4 | nargs);
+    log_put_bytes(&header, sizeof(header), &checksum);
+    log_put_bytes(&timestamp_us, sizeof(timestamp_us), &checksum);
+    const uint32_t fmt_addr = (uint32_t) (uintptr_t) fmt;
+    log_put_bytes(&fmt_addr, sizeof(fmt_addr), &checksum);
+    for (uint32_t i = 0; i < nargs; i++) {
+        const uint32_t value = (uint32_t) args[i];
+        log_put_bytes(&value, sizeof(value), &checksum);
+    }
+    putchar_raw(checksum);
+}
+#endif
+
+bool log_drain() {
+    #if LOG_DEFERRED && LOGLEVEL > 0
+        // Report discarded records first, a binary frame with a NULL format string carries the number of records
+        for (uint core = 0; core < NUM_CORES; core++) {
+            const uint32_t overflows = log_rings[core].overflows;
+            if (overflows != log_reported_overflows[core]) {
+                const uintptr_t dropped = overflows - log_reported_overflows[core];
+                log_reported_overflows[core] = overflows;
+                #if LOG_DEFERRED == 2
+                    log_put_frame(core, time_us_64(), NULL, 1, &dropped);
+                #else
+                    printf("[core%u] %u log records dropped\n", core, (uint32_t) dropped);
+                #endif
+                return true;
+            }
+        }
+        // Oldest record of both rings first, so the output is in chronological order
+        const log_record_t *const record0 = spsc_queue_read_slot(&log_rings[0]);
+        const log_record_t *const record1 = spsc_queue_read_slot(&log_rings[1]);
+        if (record0 == NULL && record1 == NULL) {
+            return false;
+        }
+        const uint core = (record0 == NULL || (record1 != NULL && record1->timestamp_us < record0->timestamp_us)) ? 1 : 0;
+        const log_record_t *const record = core ? record1 : record0;
+        #if LOG_DEFERRED == 2
+            log_put_frame(core, record->timestamp_us, record->fmt, record->nargs, record->args);
+        #else
+            log_print(core, record);
+        #endif
+        spsc_queue_release(&log_rings[core]);
+        return true;
+    #else
+        return false;
+    #endif
+}
+
+void log_flush() {
+    while (log_drain()) {
+        tight_loop_contents();
+    }
+}
+
+
+// Controller telemetry, all functions are empty when TELEMETRY is 0
+
+void telemetry_push(telemetry_sample_t *const sample) {
+    #if TELEMETRY
+        sample->timestamp_us = time_us_32();
+        sample->sequence = telemetry_sequence++;
+        sample->reserved = 0;
+        spsc_queue_push(&telemetry_queue, sample);
+    #endif
+}
+
+bool telemetry_send() {
+    #if TELEMETRY
+        const telemetry_sample_t *const sample = spsc_queue_read_slot(&telemetry_queue);
+        if (sample == NULL) {
+            return false;
+        }
+        // putchar_raw() skips the CR/LF translation of stdio, the USB CDC driver buffers the frame
+        const uint8_t *const payload = (const uint8_t *) sample;
+        uint8_t checksum = sizeof(telemetry_sample_t);
+        putchar_raw(TELEMETRY_FRAME_SYNC0);
+        putchar_raw(TELEMETRY_FRAME_SYNC1);
+        putchar_raw(sizeof(telemetry_sample_t));
+        for (size_t i = 0; i < sizeof(telemetry_sample_t); i++) {
+            putchar_raw(payload[i]);
+            checksum += payload[i];
+        }
+        putchar_raw(checksum);
+        spsc_queue_release(&telemetry_queue);
+        return true;
+    #else
+        return false;
+    #endif
 }
\ No newline at end of file
@@ -14,10 +14,34 @@
 #include "pico/flash.h"
 #include "hardware/pwm.h"
 #include "hardware/adc.h"
+#include "hardware/pio.h"
+#include "hardware/dma.h"
 #include "hardware/flash.h"
 #include "hardware/gpio.h"
 #include "hardware/watchdog.h"
 #include "hardware/exception.h"
+#include "hardware/sync.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
+
+/**
+ * @def LOG_MAX_ARGS
+ * @brief Maximum number of arguments of a LOG() message besides the format string.
+ */
+#define LOG_MAX_ARGS 6
+
+/**
+ * @def LOG_RING_LEN
+ * @brief Number of records in the trace ring of each core (LOG_DEFERRED > 0), must be a power of two.
+ */
+#define LOG_RING_LEN 128
+
+/**
+ * @def LOG_FRAME_SYNC0
+ * @brief First byte of every binary trace frame (LOG_DEFERRED == 2), followed by LOG_FRAME_SYNC1, see log_drain().
+ */
+#define LOG_FRAME_SYNC0 0xA5
+#define LOG_FRAME_SYNC1 0x5A
 
 /**
  * @brief Logs a message with a specified log level.
@@ -25,15 +49,63 @@
  * This macro logs a message if the specified log level is less than or equal to the global LOGLEVEL.
  * The log message includes the core number and the time since boot in milliseconds.
  *
+ * With LOG_DEFERRED > 0 the message is not formatted by the caller. Instead the time stamp, the address of the format
+ * string and the arguments are stored as a log_record_t in the trace ring of the calling core and formatted later by
+ * log_drain() on core0. The format string has to be a string literal, at most LOG_MAX_ARGS 32-bit arguments are
+ * supported (integers, float/double and string literals).
+ *
  * @param level The log level of the message.
  * @param ... The format string and arguments for the log message.
  */
+#if LOG_DEFERRED
+#define LOG(level, ...) { \
+    if (level <= LOGLEVEL) { \
+        LOG_WRITE(__VA_ARGS__); \
+    } \
+}
+#else
 #define LOG(level, ...) { \
     if (level <= LOGLEVEL) { \
         printf("[core%u @ %u ms] ", get_core_num(), to_ms_since_boot(get_absolute_time())); \
         printf(__VA_ARGS__); \
     } \
 }
+#endif
+
+// Helpers of LOG() for LOG_DEFERRED > 0: count the arguments and convert each of them with LOG_ARG()
+#define LOG_WRITE(fmt, ...) log_write(fmt, LOG_NARGS(__VA_ARGS__), \
+                                      (const uintptr_t[]) {0, LOG_MAP(LOG_NARGS(__VA_ARGS__), ##__VA_ARGS__)} + 1)
+#define LOG_NARGS(...) LOG_NARGS_(0, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+#define LOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, n, ...) n
+#define LOG_MAP(n, ...) LOG_MAP_(n, ##__VA_ARGS__)
+#define LOG_MAP_(n, ...) LOG_MAP_##n(__VA_ARGS__)
+#define LOG_MAP_0()
+#define LOG_MAP_1(a) LOG_ARG(a)
+#define LOG_MAP_2(a, ...) LOG_ARG(a), LOG_MAP_1(__VA_ARGS__)
+#define LOG_MAP_3(a, ...) LOG_ARG(a), LOG_MAP_2(__VA_ARGS__)
+#define LOG_MAP_4(a, ...) LOG_ARG(a), LOG_MAP_3(__VA_ARGS__)
+#define LOG_MAP_5(a, ...) LOG_ARG(a), LOG_MAP_4(__VA_ARGS__)
+#define LOG_MAP_6(a, ...) LOG_ARG(a), LOG_MAP_5(__VA_ARGS__)
+#define LOG_ARG(x) _Generic((x), \
+    float: log_arg_float, \
+    double: log_arg_float, \
+    char *: log_arg_str, \
+    const char *: log_arg_str, \
+    default: log_arg_int)(x)
+
+static inline uintptr_t log_arg_float(float const x) {
+    // Stored as the bits of a float, variadic printf arguments are promoted to double again when formatting
+    union { float f; uint32_t u; } bits = { .f = x };
+    return bits.u;
+}
+
+static inline uintptr_t log_arg_str(const char *const x) {
+    return (uintptr_t) x;
+}
+
+static inline uintptr_t log_arg_int(uintptr_t const x) {
+    return x;
+}
 
 /**
  * @def _125M
@@ -59,6 +131,7 @@ typedef enum {
    STDIO_INIT_FAILURE = (1<<4), /**< Indicates a failure during the initialization of stdio. */
    REBOOT_BY_WATCHDOG = (1<<5), /**< Indicates that the system rebooted due to the watchdog timer. */
    INVALID_DIRECTION = (1<<6), /**< Indicates an invalid direction was specified. */
+   CORE1_TASK_OVERRUN = (1<<7), /**< Indicates that a core1 task missed its deadline. */
 } error_t;
 
 
@@ -336,11 +409,95 @@ typedef enum {
 } speed_step_t;
 
 
+/**
+ * @def CV_ARRAY_SIZE
+ * @brief Number of CVs, CV_1 is stored at index 0.
+ */
+#define CV_ARRAY_SIZE 1024
+
+/**
+ * @brief Frequently used CVs decoded into the types used at runtime.
+ *
+ * Derived from CV_ARRAY_RAM and updated whenever it changes (see load_cv_array_ram() and write_cv_array_ram()).
+ * All fields are naturally aligned, so each field is updated atomically with respect to the other core.
+ *
+ * @struct cv_fields_t
+ */
+typedef struct cv_fields_t {
+    /*! Acceleration rate (CV_3). */
+    uint8_t accel_rate;
+    /*! Deceleration rate (CV_4). */
+    uint8_t decel_rate;
+    /*! Maximum motor PWM level i.e. PWM wrap counter + 1, depends on the PWM frequency (CV_9). */
+    uint16_t motor_max_level;
+} cv_fields_t;
+
+/**
+ * @brief Values of CV_180 (motor controller autotune), see autotune_controller().
+ *
+ * @enum autotune_status_t
+ */
+typedef enum {
+    AUTOTUNE_STATUS_DONE = 0, /**< Autotune off, or the last autotune succeeded */
+    AUTOTUNE_STATUS_ARMED = 1, /**< Autotune runs at the next nonzero speed step after power-up */
+    AUTOTUNE_STATUS_NOT_REACHED = 2, /**< Failed: the back-EMF didn't reach an operating point at the maximum level */
+    AUTOTUNE_STATUS_NO_OSCILLATION = 3, /**< Failed: the relay didn't switch within AUTOTUNE_TIMEOUT_MS */
+} autotune_status_t;
+
+/**
+ * @brief Handshake states of autotune_result.
+ *
+ * @enum autotune_handoff_t
+ */
+typedef enum {
+    AUTOTUNE_RESULT_NONE = 0, /**< No result pending */
+    AUTOTUNE_RESULT_READY = 1, /**< Written by core1, the CVs are ready to be persisted */
+    AUTOTUNE_RESULT_APPLIED = 2, /**< Written by core0, the CVs are in CV_ARRAY_RAM and their commit is queued */
+} autotune_handoff_t;
+
+/**
+ * @def AUTOTUNE_RESULT_CVS
+ * @brief Maximum number of CVs written by an autotune run
+ */
+#define AUTOTUNE_RESULT_CVS 12
+
+/**
+ * @brief CVs computed by the autotune on core1, persisted by core0 in a single CV journal transaction.
+ *
+ * core1 may neither write CV_ARRAY_RAM nor submit flash jobs, so it fills the CVs and sets state to
+ * AUTOTUNE_RESULT_READY. core0 copies them into CV_ARRAY_RAM, commits them and sets state to AUTOTUNE_RESULT_APPLIED,
+ * after which core1 reinitializes the controller with the new CVs.
+ *
+ * @typedef autotune_result_t
+ * @struct autotune_result_t
+ */
+typedef struct autotune_result_t {
+    uint16_t cv_index[AUTOTUNE_RESULT_CVS];     /*!< CV indices, CV_1 has index 0 */
+    uint8_t cv_data[AUTOTUNE_RESULT_CVS];       /*!< Values */
+    uint8_t count;                              /*!< Number of CVs */
+    volatile uint8_t state;                     /*!< autotune_handoff_t */
+} autotune_result_t;
+
 /**
  * @brief Pointer to the uint8_t array in flash which stores the CVs.
+ *
+ * Only used for persisting and loading the CVs, at runtime the CVs are read from CV_ARRAY_RAM.
  */
 extern const uint8_t *CV_ARRAY_FLASH;
 
+/**
+ * @brief Copy of the CVs in RAM, loaded from flash at boot.
+ *
+ * Read by both cores instead of CV_ARRAY_FLASH, so reading CVs never stalls on XIP cache misses or flash
+ * programming. Only written by core0 via load_cv_array_ram() and write_cv_array_ram().
+ */
+extern uint8_t CV_ARRAY_RAM[CV_ARRAY_SIZE];
+
+/**
+ * @brief Decoded CVs, see cv_fields_t.
+ */
+extern cv_fields_t cv_fields;
+
 /**
  * @brief Target speed step for the decoder.
  * 
@@ -382,6 +539,11 @@ extern bool flash_safe_execute_core_init_done;
  */
 extern error_t error_state;
 
+/**
+ * @brief CVs of the latest autotune run, handed from core1 to core0, see autotune_result_t.
+ */
+extern autotune_result_t autotune_result;
+
 
 /**
  * @brief Entry point for the second core (core 1).
@@ -390,6 +552,23 @@ extern error_t error_state;
  */
 void core1_entry();
 
+/**
+ * @brief Loads the whole CV array into CV_ARRAY_RAM and updates cv_fields.
+ *
+ * @param source CV array of CV_ARRAY_SIZE bytes, e.g. CV_ARRAY_FLASH or CV_ARRAY_DEFAULT.
+ */
+void load_cv_array_ram(const uint8_t *source);
+
+/**
+ * @brief Writes a single CV to CV_ARRAY_RAM and updates cv_fields.
+ *
+ * The CV isn't persisted, this is up to the caller.
+ *
+ * @param cv_index CV index, CV_1 has index 0.
+ * @param cv_data Value of the CV.
+ */
+void write_cv_array_ram(uint16_t cv_index, uint8_t cv_data);
+
 /**
  * @brief Retrieves a 32-bit Configuration Variable (CV) starting from the specified index.
  *
@@ -478,3 +657,195 @@ void clear_all_errors();
  * @return error_t The current error state.
  */
 error_t get_error_state();
+
+
+/**
+ * @enum profile_point_t
+ * @brief Code sections measured by the profiler (PROFILING, see CMakeLists.txt).
+ *
+ * Every point is only measured by one core, so the statistics of a point are never written concurrently.
+ */
+typedef enum {
+   PROFILE_DECODE_HALF_BITS = 0, /**< core0: decode_dcc_half_bits(), only calls which decoded half-bits */
+   PROFILE_EVALUATE_PACKET, /**< core0: evaluate_packet() */
+   PROFILE_SET_OUTPUTS, /**< core0: set_outputs() */
+   PROFILE_FLASH_WRITER, /**< core0: run_flash_writer(), every step of a flash job */
+   PROFILE_MEASURE, /**< core1: measure() */
+   PROFILE_CONTROLLER, /**< core1: controller_general() including measure() */
+   PROFILE_POINTS /**< Number of profile points */
+} profile_point_t;
+
+/**
+ * @def PROFILE_HIST_BINS
+ * @brief Number of log2 histogram bins, bin n counts durations of 2^(n-1) to 2^n - 1 cycles, the last bin counts all
+ * durations from 2^23 cycles on.
+ */
+#define PROFILE_HIST_BINS 25
+
+/**
+ * @brief Statistics of a profile point in clk_sys cycles.
+ *
+ * @struct profile_stats_t
+ */
+typedef struct profile_stats_t {
+    uint32_t count;                     /*!< Number of measurements */
+    uint32_t min;                       /*!< Shortest duration */
+    uint32_t max;                       /*!< Longest duration */
+    uint64_t sum;                       /*!< Sum of all durations, mean = sum / count */
+    uint32_t hist[PROFILE_HIST_BINS];   /*!< log2 histogram */
+} profile_stats_t;
+
+#if PROFILING
+/**
+ * @brief Statistics of all profile points, can also be read with a debugger when logging is disabled.
+ */
+extern profile_stats_t profile_stats[PROFILE_POINTS];
+
+/**
+ * @brief Starts measuring a profile point, has to be followed by PROFILE_END() with the same point in the same scope.
+ *
+ * Reads the SysTick counter of the calling core, which counts clk_sys cycles down from 2^24 - 1, and the microsecond
+ * timer for sections longer than SysTick covers (134ms at 125MHz, e.g. flash erases). Expands to nothing when
+ * PROFILING is 0.
+ */
+#define PROFILE_START(point) \
+    const uint32_t profile_start_##point = systick_hw->cvr; \
+    const uint32_t profile_start_us_##point = time_us_32()
+/**
+ * @brief Ends measuring a profile point and records the duration, see PROFILE_START().
+ */
+#define PROFILE_END(point) profile_record(point, profile_start_##point, profile_start_us_##point)
+#else
+#define PROFILE_START(point)
+#define PROFILE_END(point)
+#endif
+
+/**
+ * @brief Starts the SysTick counter of the calling core for the profiler, has to be called by both cores.
+ */
+void profile_init();
+
+/**
+ * @brief Records a duration of a profile point.
+ *
+ * Durations beyond the range of SysTick are taken from the microsecond timer, saturated at UINT32_MAX cycles.
+ *
+ * @param point Profile point.
+ * @param start SysTick counter value at the start of the measurement.
+ * @param start_us time_us_32() at the start of the measurement.
+ */
+void profile_record(profile_point_t point, uint32_t start, uint32_t start_us);
+
+/**
+ * @brief Clears the statistics of all profile points.
+ */
+void profile_reset();
+
+/**
+ * @brief Prints the statistics and histograms of all profile points via stdio (LOGLEVEL > 0).
+ */
+void profile_dump();
+
+
+/**
+ * @brief Record of a deferred LOG() message (LOG_DEFERRED > 0).
+ *
+ * The format string isn't copied, its address identifies the message.
+ *
+ * @typedef log_record_t
+ * @struct log_record_t
+ */
+typedef struct log_record_t {
+    uint64_t timestamp_us;          /*!< time_us_64() when the message was logged */
+    const char *fmt;                /*!< Format string */
+    uint32_t nargs;                 /*!< Number of arguments */
+    uintptr_t args[LOG_MAX_ARGS];   /*!< Arguments converted by LOG_ARG() */
+} log_record_t;
+
+/**
+ * @brief Appends a record to the trace ring of the calling core, called by LOG() when LOG_DEFERRED > 0.
+ *
+ * Interrupts are disabled while the record is written, so interrupt handlers can log as well. When the ring is full
+ * the record is discarded and counted, log_drain() reports the number of discarded records.
+ *
+ * @param fmt Format string, has to be a string literal.
+ * @param nargs Number of arguments.
+ * @param args Arguments converted by LOG_ARG().
+ */
+void log_write(const char *fmt, uint32_t nargs, const uintptr_t *args);
+
+/**
+ * @brief Emits the oldest record of both trace rings via stdio, called by core0 when idle.
+ *
+ * LOG_DEFERRED 1 formats the record as text, the same way LOG() does with LOG_DEFERRED 0. LOG_DEFERRED 2 writes a
+ * binary frame instead, which is decoded on the host by scripts/decode_log.py:
+ * LOG_FRAME_SYNC0, LOG_FRAME_SYNC1, core << 4 | nargs, 64-bit time stamp in us, 32-bit format string address,
+ * nargs 32-bit arguments and the 8-bit sum of all bytes after the sync bytes. All values are little-endian.
+ *
+ * @return true when a record has been emitted, false when both rings are empty.
+ */
+bool log_drain();
+
+/**
+ * @brief Emits all records of both trace rings, e.g. before a reboot or while waiting for input. Must only
+ * be called by core0, the single consumer of the rings.
+ */
+void log_flush();
+
+
+/**
+ * @def TELEMETRY_QUEUE_LEN
+ * @brief Number of controller samples buffered between core1 and core0 (TELEMETRY), must be a power of two.
+ */
+#define TELEMETRY_QUEUE_LEN 64
+
+/**
+ * @def TELEMETRY_FRAME_SYNC0
+ * @brief First byte of every telemetry frame, followed by TELEMETRY_FRAME_SYNC1, see telemetry_send().
+ */
+#define TELEMETRY_FRAME_SYNC0 0xA5
+#define TELEMETRY_FRAME_SYNC1 0x5B
+
+/**
+ * @brief Controller state of one control period, streamed when TELEMETRY is enabled (see CMakeLists.txt).
+ *
+ * All values are Q16.16 fixed-point unless noted otherwise. The layout has no padding and is sent as is (little-endian),
+ * see scripts/capture_telemetry.py.
+ *
+ * @typedef telemetry_sample_t
+ * @struct telemetry_sample_t
+ */
+typedef struct telemetry_sample_t {
+    uint32_t timestamp_us;          /*!< time_us_32() at the end of the control period */
+    int32_t measurement;            /*!< Back-EMF measurement in ADC counts */
+    int32_t measurement_corrected;  /*!< Measurement minus ADC offset */
+    int32_t p;                      /*!< Proportional part, 0 in startup mode */
+    int32_t i;                      /*!< Integral part after limiting, 0 in startup mode */
+    int32_t d;                      /*!< Derivative part, 0 in startup mode */
+    int32_t feed_fwd;               /*!< Feed-forward */
+    uint16_t setpoint;              /*!< Setpoint in ADC counts (integer) */
+    uint16_t level;                 /*!< Motor PWM level set by the controller (integer) */
+    uint16_t sequence;              /*!< Sample counter, gaps indicate samples discarded because the queue was full */
+    uint8_t mode;                   /*!< controller_mode_t */
+    uint8_t reserved;               /*!< Always 0 */
+} telemetry_sample_t;
+
+/**
+ * @brief Queues a controller sample for telemetry_send(), called by core1 after every control period (TELEMETRY).
+ *
+ * Sets the time stamp and sequence number of the sample and only copies it into a RAM queue, so the control loop
+ * isn't delayed by stdio. When the queue is full the sample is discarded.
+ *
+ * @param sample Pointer to the sample.
+ */
+void telemetry_push(telemetry_sample_t *sample);
+
+/**
+ * @brief Sends the oldest queued controller sample as binary frame via stdio, called by core0 when idle.
+ *
+ * Frame: TELEMETRY_FRAME_SYNC0, TELEMETRY_FRAME_SYNC1, payload length, telemetry_sample_t and the 8-bit sum of the
+ * payload length and payload bytes. Does nothing when TELEMETRY is 0.
+ *
+ * @return true when a frame has been sent, false when the queue is empty.
+ */
+bool telemetry_send();
\ No newline at end of file
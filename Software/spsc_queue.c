@@ -0,0 +1,80 @@
+//////////////////////////
+//   RP2040-Decoder     //
+// Gabriel Koppenstein  //
+//    spsc_queue.c      //
+//////////////////////////
+
+#include "spsc_queue.h"
+#include "string.h"
+
+bool spsc_queue_init(spsc_queue_t *const q, void *const buf, uint32_t const elem_size, uint32_t const capacity) {
+    // Capacity must be a power of two, so the slot index can be computed by masking the free running indices
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+        return false;
+    }
+    q->buf = buf;
+    q->elem_size = elem_size;
+    q->mask = capacity - 1;
+    q->wr_idx = 0;
+    q->rd_idx = 0;
+    q->overflows = 0;
+    q->high_water_mark = 0;
+    return true;
+}
+
+void *spsc_queue_write_slot(spsc_queue_t *const q) {
+    // rd_idx is written by the consumer, the barrier makes sure the slot isn't reused before the consumer is done with it
+    const uint32_t rd_idx = q->rd_idx;
+    __dmb();
+    if (q->wr_idx - rd_idx > q->mask) {
+        // Queue is full, never overwrite unread elements
+        q->overflows++;
+        return NULL;
+    }
+    return &q->buf[(q->wr_idx & q->mask) * q->elem_size];
+}
+
+void spsc_queue_commit(spsc_queue_t *const q) {
+    // Element data has to be written completely before the consumer can see the new write index
+    __dmb();
+    q->wr_idx++;
+    const uint32_t count = q->wr_idx - q->rd_idx;
+    if (count > q->high_water_mark) {
+        q->high_water_mark = count;
+    }
+}
+
+bool spsc_queue_push(spsc_queue_t *const q, const void *const elem) {
+    void *slot = spsc_queue_write_slot(q);
+    if (slot == NULL) {
+        return false;
+    }
+    memcpy(slot, elem, q->elem_size);
+    spsc_queue_commit(q);
+    return true;
+}
+
+const void *spsc_queue_read_slot(spsc_queue_t *const q) {
+    if (q->wr_idx == q->rd_idx) {
+        return NULL;
+    }
+    // wr_idx is written by the producer, the barrier makes sure the element data is read after the write index
+    __dmb();
+    return &q->buf[(q->rd_idx & q->mask) * q->elem_size];
+}
+
+void spsc_queue_release(spsc_queue_t *const q) {
+    // Element data has to be read completely before the producer can reuse the slot
+    __dmb();
+    q->rd_idx++;
+}
+
+bool spsc_queue_pop(spsc_queue_t *const q, void *const elem) {
+    const void *slot = spsc_queue_read_slot(q);
+    if (slot == NULL) {
+        return false;
+    }
+    memcpy(elem, slot, q->elem_size);
+    spsc_queue_release(q);
+    return true;
+}
@@ -0,0 +1,107 @@
+/*!
+ *
+ * \file spsc_queue.h
+ * Lock-free single-producer/single-consumer queue
+ *
+ * The queue stores fixed size elements in a caller provided buffer with a power of two capacity.
+ * Read and write indices are free running 32-bit counters, the slot index is obtained by masking.
+ * The producer only ever writes wr_idx and the consumer only ever writes rd_idx, which makes the queue safe to use
+ * between an interrupt handler and the main loop or between both cores without locks.
+ * Data memory barriers order the element accesses against the index updates.
+ *
+ * A full queue never overwrites unread elements, instead the new element is discarded and counted as overflow.
+ *
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "hardware/sync.h"
+
+/**
+ * @brief Structure representing a single-producer/single-consumer queue.
+ *
+ * @typedef spsc_queue_t
+ * @struct spsc_queue_t
+ */
+typedef struct spsc_queue_t {
+    uint8_t *buf;                       /**< Element storage, capacity * elem_size bytes */
+    uint32_t elem_size;                 /**< Size of one element in bytes */
+    uint32_t mask;                      /**< capacity - 1 */
+    volatile uint32_t wr_idx;           /**< Free running write index, only modified by the producer */
+    volatile uint32_t rd_idx;           /**< Free running read index, only modified by the consumer */
+    volatile uint32_t overflows;        /**< Number of elements discarded because the queue was full */
+    volatile uint32_t high_water_mark;  /**< Highest number of elements in the queue at once */
+} spsc_queue_t;
+
+/**
+ * @brief Initializes a queue.
+ *
+ * @param q Pointer to the queue.
+ * @param buf Element storage of at least capacity * elem_size bytes.
+ * @param elem_size Size of one element in bytes.
+ * @param capacity Maximum number of elements, must be a power of two.
+ * @return true on success, false when capacity is not a power of two.
+ */
+bool spsc_queue_init(spsc_queue_t *q, void *buf, uint32_t elem_size, uint32_t capacity);
+
+/**
+ * @brief Returns the number of elements currently in the queue.
+ *
+ * @param q Pointer to the queue.
+ * @return Number of elements in the queue.
+ */
+static inline uint32_t spsc_queue_count(const spsc_queue_t *q) {
+    return q->wr_idx - q->rd_idx;
+}
+
+/**
+ * @brief Producer: returns a pointer to the next free slot.
+ *
+ * The element is only visible to the consumer after spsc_queue_commit() has been called.
+ * When the queue is full the overflow counter is incremented and NULL is returned.
+ *
+ * @param q Pointer to the queue.
+ * @return Pointer to the free slot or NULL when the queue is full.
+ */
+void *spsc_queue_write_slot(spsc_queue_t *q);
+
+/**
+ * @brief Producer: publishes the element written into the slot returned by spsc_queue_write_slot().
+ *
+ * @param q Pointer to the queue.
+ */
+void spsc_queue_commit(spsc_queue_t *q);
+
+/**
+ * @brief Producer: copies an element into the queue.
+ *
+ * @param q Pointer to the queue.
+ * @param elem Pointer to the element (elem_size bytes).
+ * @return true on success, false when the queue is full and the element was discarded.
+ */
+bool spsc_queue_push(spsc_queue_t *q, const void *elem);
+
+/**
+ * @brief Consumer: returns a pointer to the oldest element without removing it.
+ *
+ * @param q Pointer to the queue.
+ * @return Pointer to the oldest element or NULL when the queue is empty.
+ */
+const void *spsc_queue_read_slot(spsc_queue_t *q);
+
+/**
+ * @brief Consumer: removes the element returned by spsc_queue_read_slot() and frees its slot.
+ *
+ * @param q Pointer to the queue.
+ */
+void spsc_queue_release(spsc_queue_t *q);
+
+/**
+ * @brief Consumer: copies the oldest element out of the queue and removes it.
+ *
+ * @param q Pointer to the queue.
+ * @param elem Pointer to the destination (elem_size bytes).
+ * @return true on success, false when the queue is empty.
+ */
+bool spsc_queue_pop(spsc_queue_t *q, void *elem);
@@ -0,0 +1,192 @@
+# Capture tool for the controller telemetry of the firmware (TELEMETRY 1, see Software/CMakeLists.txt)
+#
+# Frame layout, see telemetry_send() in Software/shared.h:
+#
+#   0xA5 0x5B | payload length | telemetry_sample_t (little-endian) | checksum
+#
+# The checksum is the 8-bit sum of the payload length and the payload bytes. Other bytes on the same stdio stream,
+# e.g. log messages, are written to stderr.
+#
+# Usage:
+#   python capture_telemetry.py /dev/ttyACM0 -o run1.csv --plot
+#   python capture_telemetry.py capture.bin -o run1.csv --plot-file run1.png
+#
+# Serial ports have to be in raw mode, e.g. stty -F /dev/ttyACM0 raw. The capture of a serial port ends with Ctrl+C
+# or after --duration seconds.
+
+import argparse
+import csv
+import struct
+import sys
+import time
+
+SYNC = b"\xA5\x5B"
+# telemetry_sample_t: timestamp_us, measurement, measurement_corrected, p, i, d, feed_fwd, setpoint, level, sequence,
+# mode, reserved
+SAMPLE = struct.Struct("<IiiiiiiHHHBB")
+Q16_ONE = 65536.0
+MODES = {0: "startup", 1: "pid"}
+
+COLUMNS = ["time_ms", "sequence", "mode", "setpoint", "measurement", "measurement_corrected", "error", "p", "i", "d",
+           "feed_fwd", "level"]
+
+
+class TelemetryDecoder:
+    """
+    Splits a byte stream into telemetry samples and other output.
+    """
+
+    def __init__(self):
+        self.buffer = b""
+        self.first_timestamp = None
+        self.last_timestamp = None
+        self.timestamp_offset = 0
+        self.last_sequence = None
+        self.samples = 0
+        self.lost = 0
+
+    def feed(self, data, text_output):
+        """
+        Decodes the data and returns the complete samples as dicts, other bytes are written to text_output.
+        """
+        self.buffer += data
+        samples = []
+        while self.buffer:
+            sync = self.buffer.find(SYNC)
+            if sync < 0:
+                # Keep a trailing first sync byte, the second one may follow with the next data
+                keep = 1 if self.buffer[-1:] == SYNC[:1] else 0
+                self._write_text(self.buffer[:len(self.buffer) - keep], text_output)
+                self.buffer = self.buffer[len(self.buffer) - keep:]
+                break
+            self._write_text(self.buffer[:sync], text_output)
+            self.buffer = self.buffer[sync:]
+            if len(self.buffer) < 3:
+                break
+            length = self.buffer[2]
+            if length != SAMPLE.size:
+                self._write_text(self.buffer[:1], text_output)
+                self.buffer = self.buffer[1:]
+                continue
+            if len(self.buffer) < 3 + length + 1:
+                break
+            if sum(self.buffer[2:3 + length]) & 0xFF != self.buffer[3 + length]:
+                self._write_text(self.buffer[:1], text_output)
+                self.buffer = self.buffer[1:]
+                continue
+            samples.append(self._decode_sample(self.buffer[3:3 + length]))
+            self.buffer = self.buffer[3 + length + 1:]
+        return samples
+
+    @staticmethod
+    def _write_text(data, text_output):
+        if data and text_output is not None:
+            text_output.write(data.decode("utf-8", errors="replace"))
+
+    def _decode_sample(self, payload):
+        (timestamp_us, measurement, measurement_corrected, p, i, d, feed_fwd, setpoint, level, sequence, mode,
+         _) = SAMPLE.unpack(payload)
+        # 32-bit time stamp in us wraps after about 71 minutes
+        if self.last_timestamp is not None and timestamp_us < self.last_timestamp:
+            self.timestamp_offset += 1 << 32
+        self.last_timestamp = timestamp_us
+        timestamp_us += self.timestamp_offset
+        if self.first_timestamp is None:
+            self.first_timestamp = timestamp_us
+        # Gaps in the 16-bit sequence number are samples discarded by the firmware
+        if self.last_sequence is not None:
+            self.lost += (sequence - self.last_sequence - 1) & 0xFFFF
+        self.last_sequence = sequence
+        self.samples += 1
+        corrected = measurement_corrected / Q16_ONE
+        return {
+            "time_ms": (timestamp_us - self.first_timestamp) / 1000.0,
+            "sequence": sequence,
+            "mode": MODES.get(mode, mode),
+            "setpoint": setpoint,
+            "measurement": measurement / Q16_ONE,
+            "measurement_corrected": corrected,
+            "error": setpoint - corrected,
+            "p": p / Q16_ONE,
+            "i": i / Q16_ONE,
+            "d": d / Q16_ONE,
+            "feed_fwd": feed_fwd / Q16_ONE,
+            "level": level,
+        }
+
+
+def capture(input_path, output_path, duration=None, text_output=sys.stderr):
+    """
+    Captures samples from a capture file or serial port into a CSV file and returns the samples.
+    """
+    decoder = TelemetryDecoder()
+    all_samples = []
+    stream = sys.stdin.buffer if input_path == "-" else open(input_path, "rb", buffering=0)
+    start = time.monotonic()
+    try:
+        with open(output_path, "w", newline="") as csv_file:
+            writer = csv.DictWriter(csv_file, fieldnames=COLUMNS)
+            writer.writeheader()
+            while duration is None or time.monotonic() - start < duration:
+                data = stream.read1(4096) if hasattr(stream, "read1") else stream.read(4096)
+                if not data:
+                    break
+                samples = decoder.feed(data, text_output)
+                writer.writerows(samples)
+                all_samples.extend(samples)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if stream is not sys.stdin.buffer:
+            stream.close()
+    print(f"{decoder.samples} samples written to {output_path}, {decoder.lost} samples lost", file=sys.stderr)
+    return all_samples
+
+
+def plot(samples, plot_file=None):
+    """
+    Plots setpoint and back-EMF as well as the controller terms and output over time.
+    """
+    import matplotlib.pyplot as plt
+
+    t = [s["time_ms"] for s in samples]
+    fig, (ax_speed, ax_terms) = plt.subplots(2, 1, sharex=True, figsize=(12, 8))
+    ax_speed.plot(t, [s["setpoint"] for s in samples], label="setpoint")
+    ax_speed.plot(t, [s["measurement_corrected"] for s in samples], label="back-EMF (corrected)")
+    ax_speed.set_ylabel("ADC counts")
+    ax_speed.legend()
+    ax_speed.grid(True)
+    for key in ("p", "i", "d", "feed_fwd", "level"):
+        ax_terms.plot(t, [s[key] for s in samples], label=key)
+    ax_terms.set_xlabel("time in ms")
+    ax_terms.set_ylabel("PWM level")
+    ax_terms.legend()
+    ax_terms.grid(True)
+    fig.tight_layout()
+    if plot_file:
+        fig.savefig(plot_file)
+        print(f"Plot saved as {plot_file}", file=sys.stderr)
+    else:
+        plt.show()
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Capture the controller telemetry of the RP2040-Decoder firmware.")
+    parser.add_argument("input", type=str, help="Serial port or capture file, - reads from stdin.")
+    parser.add_argument("-o", "--output", type=str, default="telemetry.csv", help="CSV output file.")
+    parser.add_argument("-d", "--duration", type=float, default=None, help="Capture duration in seconds.")
+    parser.add_argument("--plot", action="store_true", help="Show a plot after the capture (requires matplotlib).")
+    parser.add_argument("--plot-file", type=str, default=None, help="Save the plot to a file instead of showing it.")
+    args = parser.parse_args()
+
+    try:
+        captured = capture(args.input, args.output, args.duration)
+    except OSError as e:
+        print(f"Error: {e}")
+        sys.exit(1)
+    if (args.plot or args.plot_file) and captured:
+        try:
+            plot(captured, args.plot_file)
+        except ImportError:
+            print("Error: plotting requires matplotlib (pip install matplotlib), the CSV file has been written")
+            sys.exit(1)
@@ -0,0 +1,181 @@
+# Decoder for the binary trace frames of the firmware (LOG_DEFERRED 2, see Software/CMakeLists.txt)
+#
+# Frame layout (little-endian), see log_drain() in Software/shared.h:
+#
+#   0xA5 0x5A | core << 4 | nargs | timestamp_us (u64) | format string address (u32) | nargs x argument (u32) | checksum
+#
+# The checksum is the 8-bit sum of all bytes after the two sync bytes. The format strings aren't transmitted, they are
+# looked up by their address in the ELF file of the build that produced the frames. Bytes outside of valid frames,
+# e.g. the output of profile_dump(), are passed through unchanged.
+#
+# Usage:
+#   python decode_log.py build/RP2040-Decoder.elf /dev/ttyACM0
+#   python decode_log.py build/RP2040-Decoder.elf capture.bin
+#   cat capture.bin | python decode_log.py build/RP2040-Decoder.elf -
+#
+# Serial ports have to be in raw mode, e.g. stty -F /dev/ttyACM0 raw
+
+import argparse
+import re
+import struct
+import sys
+
+SYNC = b"\xA5\x5A"
+HEADER_SIZE = 2 + 1 + 8 + 4
+MAX_ARGS = 6
+
+# Conversion specification of printf: flags, width, precision, length and conversion
+CONVERSION = re.compile(r"%([-+ #0]*[0-9*]*(?:\.[0-9*]*)?)(hh|h|ll|l|j|z|t|L)?([diouxXcsfFeEgGaAp%])")
+FLOAT_CONVERSIONS = "fFeEgGaA"
+
+
+class ElfImage:
+    """
+    Loadable sections of an ELF file, used to read the format strings and string arguments by their address.
+    """
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            data = f.read()
+        if data[:4] != b"\x7fELF":
+            raise ValueError(f"{path} is not an ELF file")
+        is_64bit = data[4] == 2
+        endian = "<" if data[5] == 1 else ">"
+        if is_64bit:
+            shoff, = struct.unpack_from(endian + "Q", data, 0x28)
+            shentsize, shnum = struct.unpack_from(endian + "HH", data, 0x3A)
+            section_format = endian + "IIQQQQIIQQ"
+        else:
+            shoff, = struct.unpack_from(endian + "I", data, 0x20)
+            shentsize, shnum = struct.unpack_from(endian + "HH", data, 0x2E)
+            section_format = endian + "IIIIIIIIII"
+        self.sections = []
+        for i in range(shnum):
+            _, sh_type, sh_flags, sh_addr, sh_offset, sh_size = struct.unpack_from(section_format, data,
+                                                                                    shoff + i * shentsize)[:6]
+            # SHF_ALLOC sections with contents in the file (not SHT_NOBITS)
+            if sh_flags & 0x2 and sh_type != 8 and sh_addr != 0 and sh_size > 0:
+                self.sections.append((sh_addr, data[sh_offset:sh_offset + sh_size]))
+
+    def read_string(self, address):
+        """
+        Returns the NUL terminated string at the given address or None when the address isn't part of the image.
+        """
+        for start, contents in self.sections:
+            if start <= address < start + len(contents):
+                offset = address - start
+                end = contents.find(b"\0", offset)
+                return contents[offset:end if end >= 0 else len(contents)].decode("utf-8", errors="replace")
+        return None
+
+
+def format_message(elf, fmt, args):
+    """
+    Formats a message like printf() of the firmware, args are the raw 32-bit arguments of the frame.
+    """
+    args = list(args)
+
+    def convert(match):
+        flags, _, conversion = match.groups()
+        if conversion == "%":
+            return "%"
+        value = args.pop(0) if args else 0
+        if conversion in FLOAT_CONVERSIONS:
+            return ("%" + flags + conversion.replace("F", "f").replace("a", "e").replace("A", "E")) % \
+                struct.unpack("<f", struct.pack("<I", value))[0]
+        if conversion == "s":
+            string = elf.read_string(value)
+            return ("%" + flags + "s") % (string if string is not None else f"<0x{value:08x}>")
+        if conversion == "p":
+            return f"0x{value:08x}"
+        if conversion in "di":
+            value = value - (1 << 32) if value & 0x80000000 else value
+        elif conversion == "c":
+            return ("%" + flags + "c") % chr(value & 0xFF)
+        return ("%" + flags + conversion.replace("u", "d")) % value
+
+    return CONVERSION.sub(convert, fmt)
+
+
+def decode_frame(elf, buffer):
+    """
+    Decodes the frame at the start of the buffer (starting with the sync bytes).
+
+    Returns (text, frame length), (None, 0) when more data is needed or (None, -1) when it isn't a valid frame.
+    """
+    if len(buffer) < HEADER_SIZE:
+        return None, 0
+    header = buffer[2]
+    core, nargs = header >> 4, header & 0x0F
+    if core > 1 or nargs > MAX_ARGS:
+        return None, -1
+    length = HEADER_SIZE + 4 * nargs + 1
+    if len(buffer) < length:
+        return None, 0
+    if sum(buffer[2:length - 1]) & 0xFF != buffer[length - 1]:
+        return None, -1
+    timestamp_us, fmt_addr = struct.unpack_from("<QI", buffer, 3)
+    args = struct.unpack_from(f"<{nargs}I", buffer, HEADER_SIZE)
+    if fmt_addr == 0:
+        # Records discarded because the trace ring was full
+        return f"[core{core}] {args[0] if args else 0} log records dropped\n", length
+    fmt = elf.read_string(fmt_addr)
+    if fmt is None:
+        message = f"<unknown format string 0x{fmt_addr:08x}> {' '.join(f'0x{a:08x}' for a in args)}\n"
+    else:
+        message = format_message(elf, fmt, args)
+    return f"[core{core} @ {timestamp_us // 1000} ms] {message}", length
+
+
+def decode_stream(elf, stream, output):
+    """
+    Decodes frames read from stream and writes the text to output, other bytes are passed through.
+    """
+    buffer = b""
+    while True:
+        chunk = stream.read1(4096) if hasattr(stream, "read1") else stream.read(4096)
+        if not chunk:
+            break
+        buffer += chunk
+        while buffer:
+            sync = buffer.find(SYNC)
+            if sync < 0:
+                # Keep a trailing first sync byte, the second one may follow in the next chunk
+                keep = 1 if buffer[-1:] == SYNC[:1] else 0
+                output.write(buffer[:len(buffer) - keep].decode("utf-8", errors="replace"))
+                buffer = buffer[len(buffer) - keep:]
+                break
+            if sync > 0:
+                output.write(buffer[:sync].decode("utf-8", errors="replace"))
+                buffer = buffer[sync:]
+            text, length = decode_frame(elf, buffer)
+            if length == 0:
+                break
+            if length < 0:
+                # Not a frame, pass the first sync byte through and search again
+                output.write(buffer[:1].decode("utf-8", errors="replace"))
+                buffer = buffer[1:]
+                continue
+            output.write(text)
+            buffer = buffer[length:]
+        output.flush()
+    output.write(buffer.decode("utf-8", errors="replace"))
+    output.flush()
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Decode binary trace frames of the RP2040-Decoder firmware.")
+    parser.add_argument("elf", type=str, help="ELF file of the firmware build that produced the frames.")
+    parser.add_argument("input", type=str, help="Capture file or serial port, - reads from stdin.")
+    args = parser.parse_args()
+
+    try:
+        elf_image = ElfImage(args.elf)
+    except (OSError, ValueError) as e:
+        print(f"Error: {e}")
+        sys.exit(1)
+    if args.input == "-":
+        decode_stream(elf_image, sys.stdin.buffer, sys.stdout)
+    else:
+        with open(args.input, "rb", buffering=0) as input_stream:
+            decode_stream(elf_image, input_stream, sys.stdout)